@@ -0,0 +1,950 @@
+#include "approach.h"
+#include "arena.h"
+#include "body.h"
+#include "catalog.h"
+#include "clock.h"
+#include "cubemap.h"
+#include "ephemeris.h"
+#include "events.h"
+#include "frame_builder.h"
+#include "picking.h"
+#include "ring.h"
+#include "ring_particles.h"
+#include "stb_image.h"
+#include "terrain.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// cpu-only microbenchmarks. nothing here touches GL, so it runs on machines
+// without a GPU or display. run from the repository root so the bundled
+// textures are found.
+
+struct BenchOptions {
+  int samples;
+  bool large;         // include the slow cases (10M row catalog, 8k texture)
+  string filter;      // only run cases whose name contains this
+  string jsonPath;    // write results here as well as the table on stdout
+  string scratchPath; // synthetic catalogs are written here
+};
+
+// timings are seconds per iteration
+struct BenchResult {
+  string name;
+  long iterations;
+  double median;
+  double min;
+  double stddev;
+  double itemsPerSecond; // 0 when the case has no item count
+};
+
+static BenchOptions options;
+static vector<BenchResult> results;
+
+// results are folded into this so the optimiser can't drop the work
+static volatile float sink = 0.0f;
+
+static string formatTime(double seconds) {
+  char buffer[32];
+  if (seconds < 1e-6)
+    snprintf(buffer, sizeof(buffer), "%.1f ns", seconds * 1e9);
+  else if (seconds < 1e-3)
+    snprintf(buffer, sizeof(buffer), "%.2f us", seconds * 1e6);
+  else if (seconds < 1.0)
+    snprintf(buffer, sizeof(buffer), "%.2f ms", seconds * 1e3);
+  else
+    snprintf(buffer, sizeof(buffer), "%.3f s", seconds);
+  return buffer;
+}
+
+static bool selected(const string &name) {
+  return options.filter.empty() || name.find(options.filter) != string::npos;
+}
+
+static string formatRate(double perSecond) {
+  char buffer[32];
+  if (perSecond >= 1e9)
+    snprintf(buffer, sizeof(buffer), "%.2f G/s", perSecond * 1e-9);
+  else if (perSecond >= 1e6)
+    snprintf(buffer, sizeof(buffer), "%.2f M/s", perSecond * 1e-6);
+  else
+    snprintf(buffer, sizeof(buffer), "%.2f k/s", perSecond * 1e-3);
+  return buffer;
+}
+
+// times `body` in batches of `iterations` calls. with iterations == 0 the
+// batch size is doubled until one batch takes at least 20 ms, which also
+// serves as the warm-up run. `items` is the work one call does (particles,
+// rows, ...), it adds a throughput column based on the median
+static void run(const string &name, const function<void()> &body,
+                long iterations = 0, long items = 0) {
+  if (!selected(name))
+    return;
+
+  const double minBatchTime = 0.02;
+
+  if (iterations == 0) {
+    iterations = 1;
+    while (true) {
+      double start = now();
+      for (long i = 0; i < iterations; ++i)
+        body();
+      if (now() - start >= minBatchTime || iterations >= (1L << 30))
+        break;
+      iterations *= 2;
+    }
+  } else {
+    body(); // warm caches and lazily built state
+  }
+
+  vector<double> samples;
+  for (int s = 0; s < options.samples; ++s) {
+    double start = now();
+    for (long i = 0; i < iterations; ++i)
+      body();
+    samples.push_back((now() - start) / iterations);
+  }
+
+  sort(samples.begin(), samples.end());
+  size_t count = samples.size();
+  double median = count % 2 ? samples[count / 2]
+                            : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+  double mean = 0.0;
+  for (double t : samples)
+    mean += t;
+  mean /= count;
+  double variance = 0.0;
+  for (double t : samples)
+    variance += (t - mean) * (t - mean);
+  double stddev = count > 1 ? sqrt(variance / (count - 1)) : 0.0;
+
+  double rate = items > 0 && median > 0.0 ? items / median : 0.0;
+  BenchResult result = {name, iterations, median, samples[0], stddev, rate};
+  results.push_back(result);
+
+  printf("%-40s %10ld %12s %12s %12s", name.c_str(), iterations,
+         formatTime(median).c_str(), formatTime(samples[0]).c_str(),
+         formatTime(stddev).c_str());
+  if (rate > 0.0)
+    printf(" %12s", formatRate(rate).c_str());
+  printf("\n");
+  fflush(stdout);
+}
+
+static string caseName(const char *group, const char *param, long value) {
+  char buffer[96];
+  snprintf(buffer, sizeof(buffer), "%s/%s=%ld", group, param, value);
+  return buffer;
+}
+
+static void benchSphereMesh() {
+  const int tessellations[] = {8, 30, 64, 128, 256};
+
+  for (int n : tessellations) {
+    run(caseName("sphere_vertices", "stacks", n), [n]() {
+      int vertexCount;
+      Vertex *vertices = CelestialBody::createSphereVertices(
+          vec3(0.0f), 1.0f, n, n, vertexCount);
+      sink = sink + vertices[vertexCount / 2].x;
+      delete[] vertices;
+    });
+  }
+
+  for (int n : tessellations) {
+    run(caseName("sphere_indices", "stacks", n), [n]() {
+      int indexCount;
+      unsigned int *indices =
+          CelestialBody::createSphereIndices(n, n, indexCount);
+      sink = sink + indices[indexCount / 2];
+      delete[] indices;
+    });
+  }
+}
+
+static void benchRingGeometry() {
+  const int segmentCounts[] = {100, 1000, 10000};
+
+  for (int n : segmentCounts) {
+    run(caseName("ring_geometry", "segments", n), [n]() {
+      float *vertices;
+      unsigned int *indices;
+      int vertexCount, indexCount;
+      Ring::createRingGeometry(1.2f, 2.0f, n, vertices, vertexCount, indices,
+                               indexCount);
+      sink = sink + vertices[vertexCount] + indices[indexCount / 2];
+      delete[] vertices;
+      delete[] indices;
+    });
+  }
+}
+
+// chunks are generated on worker threads while flying close to a planet, one
+// of them has to finish well within a frame
+static void benchTerrainChunks() {
+  const int resolutions[] = {16, 32, 64};
+
+  for (int n : resolutions) {
+    vector<float> positions;
+    run(caseName("terrain_chunk", "resolution", n),
+        [n, &positions]() {
+          TerrainRenderer::generateChunk(2, 6, 17, 41, n, 0.001f, positions);
+          sink = sink + positions[positions.size() / 2];
+        },
+        0, (n + 1) * (n + 1));
+  }
+}
+
+// the gpu evaluates the orbits every frame, the cpu only builds them once at
+// startup, which for millions of particles is the part worth watching
+static void benchRingParticles() {
+  vector<int> particleCounts = {100000, 1000000};
+  if (options.large)
+    particleCounts.push_back(10000000);
+
+  for (int count : particleCounts) {
+    vector<RingParticles::Instance> instances;
+    run(caseName("ring_particles", "particles", count),
+        [count, &instances]() {
+          RingParticles::createInstances(count, 11.3f, 21.7f, 0.02f, 0.004f,
+                                         0.03f, 20.0f, instances);
+          sink = sink + instances.back().orbit.x;
+        },
+        0, count);
+  }
+}
+
+// same columns and value ranges as assets/data/planets.csv
+static bool writeSyntheticCatalog(const string &path, long rows) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+
+  mt19937 rng(7);
+  uniform_real_distribution<float> speed(0.01f, 5.0f);
+  uniform_real_distribution<float> orbit(0.3f, 40.0f);
+  uniform_real_distribution<float> size(0.1f, 12.0f);
+  uniform_real_distribution<float> spin(-400.0f, 400.0f);
+
+  fprintf(file,
+          "planet,orbit_speed,orbit_radius,size,texture,rotation_speed,type\n");
+  for (long i = 0; i < rows; ++i) {
+    bool gas = (i % 3) == 0;
+    fprintf(file, "Body%ld,%.3f,%.3f,%.3f,assets/textures/%s,%.1f,%s\n", i,
+            speed(rng), orbit(rng), size(rng),
+            gas ? "2k_jupiter.jpg" : "2k_mars.jpg", spin(rng),
+            gas ? "gas" : "rocky");
+  }
+
+  bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
+
+static void benchCatalog() {
+  vector<long> rowCounts = {1000, 10000, 100000, 1000000};
+  if (options.large)
+    rowCounts.push_back(10000000);
+
+  for (long rows : rowCounts) {
+    string name = caseName("load_csv", "rows", rows);
+    if (!selected(name))
+      continue;
+
+    if (!writeSyntheticCatalog(options.scratchPath, rows)) {
+      fprintf(stderr, "Failed to write %s, skipping %s\n",
+              options.scratchPath.c_str(), name.c_str());
+      continue;
+    }
+
+    // large catalogs take seconds per load, so don't calibrate a batch
+    long iterations = rows >= 1000000 ? 1 : 0;
+    run(name,
+        [rows]() {
+          vector<PlanetData> planets = loadPlanetsFromCSV(options.scratchPath);
+          if ((long)planets.size() != rows) {
+            fprintf(stderr, "Catalog loaded %zu of %ld rows\n", planets.size(),
+                    rows);
+            exit(1);
+          }
+          sink = sink + planets.back().orbitRadius;
+        },
+        iterations);
+  }
+
+  remove(options.scratchPath.c_str());
+}
+
+static void benchBodyUpdate() {
+  vector<int> bodyCounts = {10, 1000, 100000};
+  if (options.large)
+    bodyCounts.push_back(1000000);
+
+  for (int count : bodyCounts) {
+    string name = caseName("body_update", "bodies", count);
+    if (!selected(name))
+      continue;
+
+    // planets around a sun, every fourth body a moon of the one before it,
+    // so the parent lookups are exercised like in the real scene
+    mt19937 rng(11);
+    uniform_real_distribution<float> orbit(0.3f, 40.0f);
+    uniform_real_distribution<float> speed(0.01f, 5.0f);
+
+    CelestialBody sun(1.0f);
+    vector<CelestialBody *> bodies;
+    bodies.reserve(count);
+    for (int i = 0; i < count; ++i) {
+      CelestialBody *body = new CelestialBody(0.5f);
+      body->setOrbit(orbit(rng), speed(rng));
+      body->setRotationSpeed(speed(rng) * 100.0f);
+      body->setParent(i % 4 == 3 ? bodies.back() : &sun);
+      bodies.push_back(body);
+    }
+
+    run(name, [&bodies]() {
+      for (CelestialBody *body : bodies)
+        body->update(1.0f / 60.0f);
+      sink = sink + bodies.back()->getPosition().x;
+    });
+
+    for (CelestialBody *body : bodies)
+      delete body;
+  }
+}
+
+// a scene's worth of bodies created, updated once and torn down, one heap
+// allocation per body against a pool in an arena
+static void benchSceneAlloc() {
+  vector<int> bodyCounts = {10, 1000, 100000};
+  if (options.large)
+    bodyCounts.push_back(1000000);
+
+  for (int count : bodyCounts) {
+    run(caseName("scene_alloc/heap", "bodies", count), [count]() {
+      vector<CelestialBody *> bodies;
+      bodies.reserve(count);
+      for (int i = 0; i < count; ++i) {
+        bodies.push_back(new CelestialBody(0.5f));
+        bodies.back()->setOrbit(1.0f + i, 1.0f);
+      }
+      for (CelestialBody *body : bodies)
+        body->update(1.0f / 60.0f);
+      sink = sink + bodies.back()->getPosition().x;
+      for (CelestialBody *body : bodies)
+        delete body;
+    }, 0, count);
+
+    run(caseName("scene_alloc/arena", "bodies", count), [count]() {
+      Arena arena(64 * 1024);
+      Pool<CelestialBody> bodies;
+      bodies.reserve(arena, count);
+      for (int i = 0; i < count; ++i)
+        bodies[bodies.add(0.5f)].setOrbit(1.0f + i, 1.0f);
+      for (CelestialBody &body : bodies)
+        body.update(1.0f / 60.0f);
+      sink = sink + bodies[bodies.size() - 1].getPosition().x;
+    }, 0, count);
+  }
+}
+
+static void benchTextureDecode() {
+  vector<const char *> textures = {
+      "assets/textures/2k_earth_daymap.jpg",
+      "assets/textures/2k_jupiter.jpg",
+      "assets/textures/2k_moon.jpg",
+      "assets/textures/2k_saturn_ring_alpha.png",
+      "assets/textures/2k_stars_milky_way.jpg",
+      "assets/textures/2k_sun.jpg",
+  };
+  if (options.large)
+    textures.push_back("assets/textures/8k_stars_milky_way.jpg");
+
+  for (const char *path : textures) {
+    const char *file = strrchr(path, '/') + 1;
+    string name = string("stbi_load/") + file;
+    if (!selected(name))
+      continue;
+
+    int width, height, channels;
+    if (!stbi_info(path, &width, &height, &channels)) {
+      fprintf(stderr, "Failed to open %s, skipping\n", path);
+      continue;
+    }
+
+    run(name,
+        [path]() {
+          int w, h, c;
+          unsigned char *data = stbi_load(path, &w, &h, &c, 0);
+          if (!data) {
+            fprintf(stderr, "Failed to decode %s\n", path);
+            exit(1);
+          }
+          sink = sink + data[(w * h * c) / 2];
+          stbi_image_free(data);
+        },
+        1);
+  }
+}
+
+// equirect to cubemap resampling at load time: the scalar reference, the sse2
+// path and the sse2 path on a pool. throughput is in cubemap texels
+static void benchCubemap() {
+  vector<const char *> textures = {"assets/textures/2k_earth_daymap.jpg"};
+  if (options.large)
+    textures.push_back("assets/textures/8k_stars_milky_way.jpg");
+
+  unsigned int threads = max(1u, thread::hardware_concurrency());
+  ThreadPool pool(threads);
+
+  for (const char *path : textures) {
+    string prefix = string("cubemap/") + (strrchr(path, '/') + 1);
+    string scalarName = prefix + "/scalar";
+    string simdName = prefix + "/sse2";
+    string poolName = caseName(simdName.c_str(), "threads", threads);
+    if (!selected(scalarName) && !selected(simdName) && !selected(poolName))
+      continue;
+
+    int width, height, channels;
+    unsigned char *data = stbi_load(path, &width, &height, &channels, 0);
+    if (!data) {
+      fprintf(stderr, "Failed to open %s, skipping\n", path);
+      continue;
+    }
+    int faceSize = cubemapFaceSize(width);
+    long texels = 6L * faceSize * faceSize;
+    CubemapImage cubemap;
+
+    run(scalarName,
+        [&]() {
+          convertEquirect(data, width, height, channels, faceSize, nullptr,
+                          cubemap, false);
+          sink = sink + cubemap.levels[0][0];
+        },
+        1, texels);
+    run(simdName,
+        [&]() {
+          convertEquirect(data, width, height, channels, faceSize, nullptr,
+                          cubemap);
+          sink = sink + cubemap.levels[0][0];
+        },
+        1, texels);
+    run(poolName,
+        [&]() {
+          convertEquirect(data, width, height, channels, faceSize, &pool,
+                          cubemap);
+          sink = sink + cubemap.levels[0][0];
+        },
+        1, texels);
+    stbi_image_free(data);
+  }
+}
+
+// bodies scattered on circular orbits in a thin disk, like the real scene
+static vector<BodyBVH::Primitive> makeBodies(int count, float angleOffset,
+                                             mt19937 &rng) {
+  uniform_real_distribution<float> orbit(5.0f, 3000.0f);
+  uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+  uniform_real_distribution<float> height(-20.0f, 20.0f);
+  uniform_real_distribution<float> size(0.05f, 2.0f);
+
+  vector<BodyBVH::Primitive> bodies(count);
+  for (int i = 0; i < count; ++i) {
+    float r = orbit(rng);
+    float a = angle(rng) + angleOffset / sqrt(r);
+    bodies[i].type = BodyBVH::PRIMITIVE_SPHERE;
+    bodies[i].center = vec3(r * cos(a), height(rng), r * sin(a));
+    bodies[i].radius = size(rng);
+    bodies[i].innerRadius = 0.0f;
+    bodies[i].normal = vec3(0.0f, 1.0f, 0.0f);
+    bodies[i].id = i;
+  }
+  return bodies;
+}
+
+static void benchPicking() {
+  vector<int> bodyCounts = {1000, 10000, 100000};
+  if (options.large)
+    bodyCounts.push_back(1000000);
+
+  for (int count : bodyCounts) {
+    mt19937 rng(42);
+    vector<BodyBVH::Primitive> bodies = makeBodies(count, 0.0f, rng);
+
+    run(caseName("bvh_build", "bodies", count), [&bodies]() {
+      BodyBVH bvh;
+      bvh.build(bodies);
+      sink = sink + bvh.getNodeCount();
+    });
+
+    BodyBVH bvh;
+    bvh.build(bodies);
+
+    // one simulation step: every body moves a little along its orbit
+    mt19937 moveRng(42);
+    vector<BodyBVH::Primitive> moved = makeBodies(count, 0.01f, moveRng);
+    run(caseName("bvh_refit", "bodies", count), [&bvh, &moved]() {
+      for (size_t i = 0; i < moved.size(); ++i)
+        bvh.setSphere(i, moved[i].center, moved[i].radius);
+      bvh.refit();
+    });
+
+    // rays from a camera above the disk, aimed at random bodies, and at
+    // random points in the disk plane (mostly misses that still descend
+    // through the tree)
+    const int queries = 4096;
+    uniform_int_distribution<int> pickBody(0, count - 1);
+    uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    vector<vec3> origins(queries), aimed(queries), scattered(queries);
+    for (int i = 0; i < queries; ++i) {
+      origins[i] = vec3(unit(rng) * 3000.0f, 500.0f, unit(rng) * 3000.0f);
+      aimed[i] = moved[pickBody(rng)].center - origins[i];
+      scattered[i] = vec3(unit(rng) * 3000.0f, 0.0f, unit(rng) * 3000.0f) -
+                     origins[i];
+    }
+
+    int next = 0;
+    run(caseName("bvh_ray_hit", "bodies", count),
+        [&bvh, &origins, &aimed, &next]() {
+          RayHit hit;
+          int i = next++ & (queries - 1);
+          if (bvh.raycast(origins[i], aimed[i], hit))
+            sink = sink + hit.distance;
+        });
+
+    run(caseName("bvh_ray_scatter", "bodies", count),
+        [&bvh, &origins, &scattered, &next]() {
+          RayHit hit;
+          int i = next++ & (queries - 1);
+          if (bvh.raycast(origins[i], scattered[i], hit))
+            sink = sink + hit.distance;
+        });
+  }
+}
+
+// 1, the powers of two below the hardware thread count and the count itself
+static vector<unsigned int> benchThreadCounts() {
+  vector<unsigned int> counts = {1};
+  unsigned int hardware = max(thread::hardware_concurrency(), 1u);
+  for (unsigned int t = 2; t < hardware; t *= 2)
+    counts.push_back(t);
+  if (hardware > 1)
+    counts.push_back(hardware);
+  return counts;
+}
+
+// a belt of small bodies, sized like the asteroid belt, so most cells hold
+// one or two bodies and a few thousand pairs are close. every thread count up
+// to the hardware's is timed on the same bodies
+static void benchApproach() {
+  vector<int> bodyCounts = {100000, 1000000};
+  if (options.large)
+    bodyCounts.push_back(4000000);
+
+  vector<unsigned int> threadCounts = benchThreadCounts();
+
+  for (int count : bodyCounts) {
+    mt19937 rng(5);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vector<vec3> positions(count);
+    vector<float> radii(count);
+    for (int i = 0; i < count; ++i) {
+      float angle = unit(rng) * 6.2831853f;
+      float r = 220.0f + 100.0f * unit(rng);
+      positions[i] = vec3(r * cos(angle), (unit(rng) - 0.5f) * 20.0f,
+                          r * sin(angle));
+      float t = unit(rng);
+      radii[i] = 0.01f + 0.11f * t * t * t;
+    }
+
+    for (unsigned int threads : threadCounts) {
+      char name[96];
+      snprintf(name, sizeof(name), "approach/bodies=%d/threads=%u", count,
+               threads);
+      if (!selected(name))
+        continue;
+
+      ApproachDetector detector(threads, 0.05f, 1.0f / 60.0f);
+      vector<ApproachEvent> events;
+      run(name,
+          [&]() {
+            sink = sink + detector.detect(positions, radii);
+            detector.takeEvents(events);
+            events.clear();
+          },
+          0, count);
+    }
+  }
+}
+
+// ten years of hourly positions for the bodies of planets.csv plus a moon,
+// written to the scratch file at every thread count, then played back at the
+// rate of the interactive mode and read at random times
+static void benchEphemeris() {
+  vector<EphemerisBody> bodies;
+  EphemerisBody sun = {"Sun", 0.0f, 0.0f, 10.0f, -1};
+  bodies.push_back(sun);
+  vector<PlanetData> planets = loadPlanetsFromCSV("assets/data/planets.csv");
+  for (const PlanetData &planet : planets) {
+    EphemerisBody body = {planet.name, planet.orbitRadius, planet.orbitSpeed,
+                          planet.rotationSpeed, -1};
+    bodies.push_back(body);
+  }
+  EphemerisBody moon = {"Moon", 0.087f, 13.4f, 50.0f, 3};
+  bodies.push_back(moon);
+
+  double step = 360.0 / (365.25 * 24.0);
+  uint64_t samples = 10 * 8766 + 1;
+  long positions = (long)(samples * bodies.size());
+  string path = options.scratchPath + ".ephemeris";
+
+  vector<unsigned int> threadCounts = benchThreadCounts();
+
+  bool written = false;
+  for (unsigned int threads : threadCounts) {
+    char name[96];
+    snprintf(name, sizeof(name), "ephemeris/write/threads=%u", threads);
+    if (!selected(name))
+      continue;
+
+    ThreadPool pool(threads);
+    EphemerisStats stats;
+    run(name,
+        [&]() {
+          written = writeEphemeris(path.c_str(), bodies, 0.0, step, samples,
+                                   4096, 0.001, pool, stats);
+        },
+        1, positions);
+    printf("  %.1f MB as floats, %.1f MB written\n",
+           stats.rawBytes / 1048576.0, stats.fileBytes / 1048576.0);
+  }
+
+  if (selected("ephemeris/read/playback") ||
+      selected("ephemeris/read/seek")) {
+    if (!written) {
+      ThreadPool pool;
+      EphemerisStats stats;
+      written = writeEphemeris(path.c_str(), bodies, 0.0, step, samples,
+                               4096, 0.001, pool, stats);
+    }
+    EphemerisReader reader;
+    if (!written || !reader.open(path.c_str())) {
+      fprintf(stderr, "Failed to write %s, skipping ephemeris/read\n",
+              path.c_str());
+      remove(path.c_str());
+      return;
+    }
+
+    // 30 steps per simulation second through the whole range
+    vector<vec3> frame;
+    long frames = (long)(reader.getEndTime() * 30.0);
+    run("ephemeris/read/playback",
+        [&]() {
+          for (long f = 0; f < frames; ++f)
+            reader.positionsAt(f / 30.0, frame);
+          sink = sink + frame.back().x;
+        },
+        1, frames * (long)bodies.size());
+
+    mt19937 rng(5);
+    uniform_real_distribution<double> time(0.0, reader.getEndTime());
+    run("ephemeris/read/seek",
+        [&]() {
+          vec3 position;
+          reader.positionAt((int)(rng() % bodies.size()), time(rng),
+                            position);
+          sink = sink + position.x;
+        });
+  }
+  remove(path.c_str());
+}
+
+// eclipses, transits, conjunctions seen from the earth and a fixed camera's
+// frustum over a century of the solar system of planets.csv, at every thread
+// count, then one year checked against stepping CelestialBody::evaluate at a
+// hundredth of the coarse step
+static void benchEvents() {
+  vector<PlanetData> planets = loadPlanetsFromCSV("assets/data/planets.csv");
+  vector<CelestialBody> storage;
+  storage.reserve(planets.size() + 2);
+  storage.emplace_back(2.0f);
+  int earth = -1, venus = -1, mercury = -1, jupiter = -1;
+  for (const PlanetData &planet : planets) {
+    storage.emplace_back(planet.size);
+    storage.back().setOrbit(planet.orbitRadius, planet.orbitSpeed);
+    int index = (int)storage.size() - 1;
+    if (planet.name == "Earth")
+      earth = index;
+    else if (planet.name == "Venus")
+      venus = index;
+    else if (planet.name == "Mercury")
+      mercury = index;
+    else if (planet.name == "Jupiter")
+      jupiter = index;
+  }
+  if (earth < 0 || venus < 0 || mercury < 0 || jupiter < 0) {
+    fprintf(stderr, "planets.csv lacks a planet, skipping events\n");
+    return;
+  }
+  storage.emplace_back(0.273f);
+  storage.back().setOrbit(0.087f, 13.4f);
+  storage.back().setParent(&storage[earth]);
+  int moon = (int)storage.size() - 1;
+
+  vector<CelestialBody *> bodies;
+  for (CelestialBody &body : storage)
+    bodies.push_back(&body);
+
+  mat4 camera = perspective(radians(45.0f), 16.0f / 9.0f, 1.0f, 1e5f) *
+                lookAt(vec3(0.0f, 200.0f, 600.0f), vec3(0.0f),
+                       vec3(0.0f, 1.0f, 0.0f));
+  auto addQueries = [&](EventSearch &search) {
+    search.addOccultation(earth, 0, moon); // solar eclipses
+    search.addOccultation(moon, 0, earth); // lunar eclipses
+    search.addOccultation(earth, 0, mercury);
+    search.addOccultation(earth, 0, venus);
+    for (int a = 1; a < moon; ++a) {
+      for (int b = a + 1; b < moon; ++b) {
+        if (a != earth && b != earth)
+          search.addConjunction(earth, a, b, radians(1.0));
+      }
+    }
+    search.addFrustumEntry(jupiter, camera);
+  };
+
+  vector<unsigned int> threadCounts = benchThreadCounts();
+
+  // a year is one earth orbit, 360 simulation seconds
+  vector<int> spans = {100};
+  if (options.large)
+    spans.push_back(1000);
+  for (int years : spans) {
+    for (unsigned int threads : threadCounts) {
+      char name[96];
+      snprintf(name, sizeof(name), "events/years=%d/threads=%u", years,
+               threads);
+      if (!selected(name))
+        continue;
+
+      EventSearch search(bodies, threads);
+      addQueries(search);
+      long samples = (long)ceil(years * 360.0 / search.suggestStep()) + 1;
+      vector<SearchEvent> events;
+      run(name,
+          [&]() {
+            search.search(0.0, years * 360.0, 0.0, events);
+            sink = sink + (float)events.size();
+          },
+          1, samples);
+      printf("  %zu events, %zu samples, %zu refinement evaluations\n",
+             events.size(), search.getSampleCount(),
+             search.getRefineCount());
+    }
+  }
+
+  if (!selected("events/validate"))
+    return;
+  EventSearch search(bodies, 0);
+  addQueries(search);
+  vector<SearchEvent> fast, reference;
+  double step = search.suggestStep();
+  search.search(0.0, 360.0, step, fast);
+  double start = now();
+  search.searchBruteForce(bodies, 0.0, 360.0, step / 100.0, reference);
+  double bruteTime = now() - start;
+
+  // events are matched by query and order, the brute force step bounds the
+  // error of its interpolated times
+  size_t matched = 0;
+  double worst = 0.0;
+  for (const SearchEvent &event : reference) {
+    for (const SearchEvent &candidate : fast) {
+      if (candidate.query == event.query &&
+          fabs(candidate.start - event.start) < step) {
+        worst = max(worst, max(fabs(candidate.start - event.start),
+                               fabs(candidate.end - event.end)));
+        ++matched;
+        break;
+      }
+    }
+  }
+  printf("%-40s %zu events, brute force %zu (%s), %zu matched, worst "
+         "%.2g s\n",
+         "events/validate", fast.size(), reference.size(),
+         formatTime(bruteTime).c_str(), matched, worst);
+  if (matched != reference.size() || fast.size() != reference.size()) {
+    fprintf(stderr, "Event search disagrees with the brute force\n");
+    exit(1);
+  }
+}
+
+// the per-body part of a frame packet for a field of small moons around the
+// camera's target, about half of them inside the frustum
+static void benchFrameBuild() {
+  vector<int> bodyCounts = {10000, 100000};
+
+  vector<unsigned int> threadCounts = benchThreadCounts();
+
+  FrameInput input;
+  input.dt = 0.0f;
+  input.width = input.lodWidth = 1920;
+  input.height = input.lodHeight = 1080;
+  input.eye = vec3(0.0f, 200.0f, 600.0f);
+  input.fovY = radians(45.0f);
+  input.cullMargin = radians(10.0f); // as when pipelined
+  input.view = lookAt(input.eye, vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+  input.projection = perspective(input.fovY, 1920.0f / 1080.0f, 1.0f, 1e5f);
+  input.impostorThreshold = 12.0f;
+  input.impostorFadeBand = 6.0f;
+  input.drawOrbits = false;
+  input.drawTrails = false;
+  input.pick = false;
+
+  for (int count : bodyCounts) {
+    mt19937 rng(9);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vector<CelestialBody *> bodies;
+    for (int i = 0; i < count; ++i) {
+      CelestialBody *body = new CelestialBody(0.5f + 4.0f * unit(rng));
+      body->setOrbit(0.5f + 9.5f * unit(rng), 10.0f);
+      body->setRotationSpeed(30.0f);
+      body->update(unit(rng) * 36.0f);
+      bodies.push_back(body);
+    }
+
+    for (unsigned int threads : threadCounts) {
+      char name[96];
+      snprintf(name, sizeof(name), "frame_build/bodies=%d/threads=%u", count,
+               threads);
+      if (!selected(name))
+        continue;
+
+      FrameBuilder builder(threads, 256);
+      vector<BodyDraw> draws;
+      vector<TextureRequest> requests;
+      run(name,
+          [&]() {
+            draws.clear();
+            requests.clear();
+            builder.build(bodies, input, draws, requests);
+            sink = sink + (float)draws.size();
+          },
+          0, count);
+    }
+
+    for (CelestialBody *body : bodies)
+      delete body;
+  }
+}
+
+static string jsonEscape(const string &text) {
+  string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
+
+static bool writeJson(const string &path) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "{\n  \"samples\": %d,\n  \"results\": [\n", options.samples);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult &r = results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"iterations\": %ld, \"median_ns\": %.3f, "
+            "\"min_ns\": %.3f, \"stddev_ns\": %.3f",
+            jsonEscape(r.name).c_str(), r.iterations, r.median * 1e9,
+            r.min * 1e9, r.stddev * 1e9);
+    if (r.itemsPerSecond > 0.0)
+      fprintf(file, ", \"items_per_s\": %.1f", r.itemsPerSecond);
+    fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+
+  bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
+
+static bool parseOptions(int argc, char **argv) {
+  options.samples = 7;
+  options.large = false;
+  options.scratchPath = "bin/bench_catalog.csv";
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (arg == "--samples" && hasValue) {
+      options.samples = atoi(argv[++i]);
+    } else if (arg == "--filter" && hasValue) {
+      options.filter = argv[++i];
+    } else if (arg == "--json" && hasValue) {
+      options.jsonPath = argv[++i];
+    } else if (arg == "--scratch" && hasValue) {
+      options.scratchPath = argv[++i];
+    } else if (arg == "--large") {
+      options.large = true;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--samples N] [--filter TEXT] [--json PATH] "
+              "[--scratch PATH] [--large]\n",
+              argv[0]);
+      return false;
+    }
+  }
+
+  if (options.samples < 1) {
+    fprintf(stderr, "--samples must be at least 1\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (!parseOptions(argc, argv))
+    return 1;
+
+  printf("%-40s %10s %12s %12s %12s %12s\n", "case", "iters", "median", "min",
+         "stddev", "throughput");
+
+  benchSphereMesh();
+  benchRingGeometry();
+  benchTerrainChunks();
+  benchRingParticles();
+  benchCatalog();
+  benchBodyUpdate();
+  benchSceneAlloc();
+  benchTextureDecode();
+  benchCubemap();
+  benchPicking();
+  benchApproach();
+  benchFrameBuild();
+  benchEphemeris();
+  benchEvents();
+
+  if (!options.jsonPath.empty()) {
+    if (!writeJson(options.jsonPath)) {
+      fprintf(stderr, "Failed to write %s\n", options.jsonPath.c_str());
+      return 1;
+    }
+    printf("Wrote %zu results to %s\n", results.size(),
+           options.jsonPath.c_str());
+  }
+  return 0;
+}
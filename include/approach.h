@@ -0,0 +1,103 @@
+#ifndef APPROACH_H
+#define APPROACH_H
+
+#include "thread_pool.h"
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// a pair of bodies whose surfaces came within the margin of each other.
+// a < b, both index the arrays passed to detect()
+struct ApproachEvent {
+  int a;
+  int b;
+  float distance; // between the surfaces, negative when they overlap
+  bool collision;
+};
+
+// finds every pair of spheres closer than a margin, every simulation step.
+//
+// broad phase: a uniform spatial hash. every body is entered into each cell
+// its margin-padded bounds touch, the entries are partitioned by bucket
+// range and each partition is sorted and scanned on its own worker, so all of
+// it runs in parallel. a pair sharing several cells is only tested in the
+// cell holding the min corner of the overlap of their bounds. bodies far
+// larger than a cell would fill thousands of cells; they are kept aside and
+// tested against every body instead.
+//
+// narrow phase: exact sphere distance.
+//
+// events are published when a pair starts approaching, not for every step it
+// stays close: to the callback on the calling thread, and to a queue that
+// another thread can drain.
+class ApproachDetector {
+public:
+  typedef function<void(const ApproachEvent &)> Callback;
+
+private:
+  struct Bounds {
+    ivec3 minCell;
+    ivec3 maxCell;
+  };
+
+  ThreadPool pool;
+  float margin;
+  float cellSize; // 0 picks one from the radii each step
+  float timeBudget;
+
+  // per step scratch, kept to avoid reallocating
+  vector<Bounds> bounds;
+  vector<int> large; // bodies kept out of the grid
+  vector<uint64_t> entries;     // cell hash << 32 | body, by partition
+  vector<uint32_t> bucketStart; // into cellBodies
+  vector<uint64_t> cellBodies;  // entries sorted by bucket
+  vector<vector<ApproachEvent>> found; // per task
+  vector<uint64_t> active;             // pairs closer than the margin, sorted
+  vector<uint64_t> current;
+
+  uint32_t bucketMask;
+  float stepCellSize;
+
+  Callback callback;
+  mutex queueMutex;
+  vector<ApproachEvent> queue;
+
+  // stats of the last detect()
+  size_t entryCount;
+  size_t candidatePairs;
+  size_t approachCount;
+  double lastTime;
+
+public:
+  // 0 threads means one per hardware thread. timeBudgetSeconds only feeds
+  // isOverBudget()
+  ApproachDetector(unsigned int threads, float approachMargin,
+                   float timeBudgetSeconds);
+  ~ApproachDetector();
+
+  // 0 picks the cell size from the radii every step
+  void setCellSize(float size) { cellSize = size; }
+  void setCallback(const Callback &cb) { callback = cb; }
+
+  // runs both phases, publishes the new approaches and returns how many
+  // pairs are currently within the margin. positions and radii must have
+  // the same size and fewer than 2^31 entries
+  int detect(const vector<vec3> &positions, const vector<float> &radii);
+
+  // moves the queued events into `events`, safe to call from any thread
+  void takeEvents(vector<ApproachEvent> &events);
+
+  size_t getEntryCount() const { return entryCount; }
+  size_t getCandidatePairs() const { return candidatePairs; }
+  size_t getApproachCount() const { return approachCount; }
+  double getLastTime() const { return lastTime; }
+  bool isOverBudget() const { return lastTime > timeBudget; }
+  unsigned int getThreadCount() const { return pool.size(); }
+};
+
+#endif
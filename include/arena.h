@@ -0,0 +1,134 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// bump allocator for objects that live as long as their owner, like the
+// bodies and gl wrappers of a scene. memory comes from a few large blocks
+// instead of one heap allocation per object and is given back all at once.
+// objects with a destructor are chained into a list that reset walks newest
+// first, so teardown is that list plus one free per block. pointers stay
+// valid until reset; not thread safe.
+class Arena {
+private:
+  struct Block {
+    char *data;
+    size_t size;
+    size_t used;
+  };
+
+  // lives in the arena itself, count is read at reset so a pool can keep
+  // constructing into the array it covers
+  struct Cleanup {
+    void (*destroy)(void *objects, size_t count);
+    void *objects;
+    size_t count;
+    Cleanup *next;
+  };
+
+  vector<Block> blocks;
+  Cleanup *cleanups;
+  size_t blockSize;
+  size_t usedBytes;
+  size_t peakBytes;
+  size_t allocations;
+
+  void addBlock(size_t minimum);
+  void trackMemory() const;
+
+  template <class T> static void destroy(void *objects, size_t count) {
+    T *items = static_cast<T *>(objects);
+    for (size_t i = count; i-- > 0;)
+      items[i].~T();
+  }
+
+public:
+  explicit Arena(size_t blockBytes);
+  ~Arena();
+
+  // uninitialised, aligned for any scalar type when align is 0
+  void *allocate(size_t size, size_t align = 0);
+
+  template <class T, class... Args> T *create(Args &&...args) {
+    T *object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if (!is_trivially_destructible<T>::value)
+      *onReset(&Arena::destroy<T>, object) = 1;
+    return object;
+  }
+
+  // room for count objects of T, constructed by the caller. the returned
+  // count says how many of them reset destroys, starting at 0
+  template <class T> T *allocateArray(size_t count, size_t *&constructed) {
+    T *objects = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    constructed = onReset(&Arena::destroy<T>, objects);
+    return objects;
+  }
+
+  size_t *onReset(void (*destroy)(void *, size_t), void *objects);
+
+  // destroys every object and frees all blocks but the first
+  void reset();
+
+  size_t getAllocations() const { return allocations; }
+  size_t getUsedBytes() const { return usedBytes; }
+  size_t getPeakBytes() const { return peakBytes; }
+  size_t getReservedBytes() const;
+  size_t getBlockCount() const { return blocks.size(); }
+};
+
+// index into a pool, stays valid as long as the pool. -1 refers to nothing
+template <class T> struct Handle {
+  int index;
+
+  Handle() : index(-1) {}
+  explicit Handle(int i) : index(i) {}
+  bool valid() const { return index >= 0; }
+};
+
+// objects of one type side by side in a single arena allocation, reserved
+// once with the final count so iteration walks contiguous memory and
+// pointers never move. destroyed by the arena's reset
+template <class T> class Pool {
+private:
+  T *items;
+  size_t *count; // owned by the arena's cleanup record
+  size_t capacity;
+
+public:
+  Pool() : items(nullptr), count(nullptr), capacity(0) {}
+
+  void reserve(Arena &arena, size_t size) {
+    items = arena.allocateArray<T>(size, count);
+    capacity = size;
+  }
+
+  // an invalid handle once the reserved capacity is used up
+  template <class... Args> Handle<T> add(Args &&...args) {
+    if (size() >= capacity)
+      return Handle<T>();
+    new (items + *count) T(std::forward<Args>(args)...);
+    return Handle<T>((int)(*count)++);
+  }
+
+  T &operator[](Handle<T> handle) { return items[handle.index]; }
+  const T &operator[](Handle<T> handle) const { return items[handle.index]; }
+  T &operator[](size_t index) { return items[index]; }
+  const T &operator[](size_t index) const { return items[index]; }
+  // null for an invalid handle
+  T *get(Handle<T> handle) const {
+    return handle.valid() ? items + handle.index : nullptr;
+  }
+
+  size_t size() const { return count ? *count : 0; }
+  T *begin() const { return items; }
+  T *end() const { return items + size(); }
+};
+
+#endif
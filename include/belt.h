@@ -0,0 +1,62 @@
+#ifndef BELT_H
+#define BELT_H
+
+#include "mesh.h"
+#include "shader.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// asteroids on circular orbits, animated and culled entirely on the gpu. a
+// transform feedback pass evaluates every orbit, drops asteroids outside the
+// frustum or smaller than a pixel, and writes the survivors into a compact
+// buffer. the number written comes from a GL_PRIMITIVES_GENERATED query.
+//
+// reading that query right away would stall until the pass has run, so the
+// output is double buffered: each frame draws what the previous frame's pass
+// produced, and the frustum is widened a little to hide the one frame lag.
+class AsteroidBelt {
+private:
+  static const int BUFFERS = 2;
+
+  int asteroidCount;
+
+  unsigned int instanceVBO; // static orbit data, one entry per asteroid
+  unsigned int cullVAO;
+
+  Mesh *mesh; // coarsest shared unit sphere, scaled per instance
+
+  unsigned int feedbackBuffers[BUFFERS]; // compacted survivors
+  unsigned int drawVAOs[BUFFERS];        // rock mesh + one survivor buffer
+  unsigned int queries[BUFFERS];
+  bool queryPending[BUFFERS];
+  GLuint visible[BUFFERS];
+  int current; // buffer the next pass writes into
+
+  GLuint drawnCount; // instances in the last draw
+
+  void createInstances(float innerAu, float outerAu, float thicknessAu,
+                       float minSize, float maxSize, float unitsPerAu,
+                       float degreesPerSecond);
+
+public:
+  // radii and thickness in au, sizes in world units. degreesPerSecond is the
+  // speed of an orbit at 1 au, further out is slower following kepler
+  AsteroidBelt(int count, float innerAu, float outerAu, float thicknessAu,
+               float minSize, float maxSize, float unitsPerAu,
+               float degreesPerSecond);
+  ~AsteroidBelt();
+
+  // runs the cull pass for this frame and draws the previous frame's result.
+  // needs the FrameData block bound for both shaders. frustumMargin widens
+  // the cull frustum, as the survivors are drawn a frame later
+  void render(Shader &cullShader, Shader &drawShader, float time,
+              float viewportHeight, float minPixelSize, float frustumMargin);
+
+  int getAsteroidCount() const { return asteroidCount; }
+  int getDrawnCount() const { return (int)drawnCount; }
+  int getCulledCount() const { return asteroidCount - (int)drawnCount; }
+};
+
+#endif
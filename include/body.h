@@ -1,6 +1,7 @@
 #ifndef BODY_H
 #define BODY_H
 
+#include "mesh.h"
 #include "shader.h"
 #include "texture.h"
 #include <GL/glew.h>
@@ -34,18 +35,19 @@ protected:
   vec3 materialKs;         // specular reflection
   float materialShininess; // specular exponent
 
-  unsigned int VAO, VBO, IBO;
-  int indexCount;
+  Mesh *mesh; // shared unit sphere, scaled by radius in the model matrix
   Texture *texture;
+  bool ownsTexture;
 
-  static const int STACKS = 30;
-  static const int SECTORS = 30;
+  static const int MESH_LOD = 2; // 30 x 30, see tools/meshgen.cpp
 
-  void setupMesh(const Vertex *vertices, int vertexCount,
-                 const unsigned int *indices, int idxCount);
+  // position from orbitAngle and the parent's position
+  void placeOnOrbit();
 
 public:
   CelestialBody(float rad, const char *texturePath);
+  CelestialBody(float rad, Texture *sharedTexture);
+  explicit CelestialBody(float rad); // no mesh or texture, never rendered
   virtual ~CelestialBody();
   void setOrbit(float orbRadius, float orbSpeed);
   void setRotationSpeed(float speed);
@@ -53,10 +55,33 @@ public:
   void setMaterial(const vec3 &ka, const vec3 &kd, const vec3 &ks,
                    float shininess);
   virtual void update(float deltaTime);
-  virtual void render(Shader &shader, const mat4 &view, const mat4 &projection);
+  // the state after `time` seconds of updates from the start, the parent
+  // evaluated first. independent of the previous state, so any time can be
+  // evaluated in any order
+  void evaluate(double time);
+  // replaces the orbit position, e.g. with one played back from a file
+  void setPosition(const vec3 &pos) { position = pos; }
+  // view and projection come from the FrameData uniform block
+  virtual void render(Shader &shader);
 
   vec3 getPosition() const { return position; }
   float getRadius() const { return radius; }
+  float getOrbitRadius() const { return orbitRadius; } // after setOrbit's scale
+  float getOrbitSpeed() const { return orbitSpeed; }   // degrees per second
+  CelestialBody *getParent() const { return parent; }
+  Texture *getTexture() const { return texture; }
+  Mesh *getMesh() const { return mesh; }
+  float getRotationAngle() const { return rotationAngle; } // degrees
+  vec3 getMaterialKa() const { return materialKa; }
+  vec3 getMaterialKd() const { return materialKd; }
+  vec3 getMaterialKs() const { return materialKs; }
+  float getMaterialShininess() const { return materialShininess; }
+
+  // translation, spin and the radius scale of the unit sphere
+  mat4 getModelMatrix() const;
+
+  // projected diameter in pixels, fovY in radians
+  float getScreenSize(const vec3 &eye, float fovY, float viewportHeight) const;
 
   static Vertex *createSphereVertices(vec3 center, float radius, int stacks,
                                       int sectors, int &vertexCount);
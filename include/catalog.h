@@ -0,0 +1,22 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// one row of assets/data/planets.csv
+struct PlanetData {
+  string name;
+  float orbitSpeed;
+  float orbitRadius;
+  float size;
+  string texture;
+  float rotationSpeed;
+  string type;
+};
+
+vector<PlanetData> loadPlanetsFromCSV(const string &filepath);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+// seconds on the steady clock, for timing intervals on any thread. unlike
+// glfwGetTime it needs no glfw, so cpu-only code and the tools can use it
+double now();
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <cstddef>
 #include <glm/glm.hpp>
 
 // window configuration
@@ -24,21 +25,104 @@ const float SPEED_SCALE = 1.0f;
 
 // sun properties
 const float SUN_SIZE = 2.0f;
+const float SUN_ROTATION_SPEED = 10.0f;
 const char *SUN_TEXTURE = "assets/textures/2k_sun.jpg";
 
 // background properties
 const float BACKGROUND_SIZE = 8000.0f;
 const char *BACKGROUND_TEXTURE = "assets/textures/8k_stars_milky_way.jpg";
 
+// star field: stars from a binary catalog (make writes a synthetic one with
+// tools/stargen) drawn as point sprites over a low resolution milky way
+// instead of the 8k background. stars down to STAR_MAGNITUDE_LIMIT are drawn
+// at STAR_REFERENCE_FOV, zooming in shows fainter ones. off by default: the
+// synthetic catalog is random, point STAR_CATALOG at a real one to use it
+const bool STAR_FIELD = false;
+const char *STAR_CATALOG = "build/generated/stars.bin";
+const char *STAR_GLOW_TEXTURE = "assets/textures/2k_stars_milky_way.jpg";
+const float STAR_MAGNITUDE_LIMIT = 6.5f;
+const float STAR_REFERENCE_FOV = 45.0f; // degrees, the default zoom
+const float STAR_MIN_SIZE = 1.5f;       // pixels
+const float STAR_MAX_SIZE = 6.0f;
+const float STAR_LIMIT_BRIGHTNESS = 0.25f; // of a star at the limit, 0..1
+
 // moon properties
 const float MOON_SIZE = 0.273f * PLANET_SIZE_SCALE;
 const float MOON_ORBIT_RADIUS = 0.087f;
 const float MOON_ORBIT_SPEED = 13.4f;
+const float MOON_ROTATION_SPEED = 50.0f;
 const char *MOON_TEXTURE = "assets/textures/2k_moon.jpg";
 
 // orbit rendering
 const glm::vec3 ORBIT_COLOR = glm::vec3(1.0f, 1.0f, 1.0f);
 
+// asteroid belt between mars and jupiter, animated and culled on the gpu
+const int BELT_ASTEROIDS = 250000;
+const float BELT_INNER_RADIUS = 2.2f; // au, same units as planets.csv
+const float BELT_OUTER_RADIUS = 3.2f;
+const float BELT_THICKNESS = 0.15f;  // au, spread above and below the plane
+const float BELT_MIN_SIZE = 0.01f;   // world units
+const float BELT_MAX_SIZE = 0.12f;
+const float BELT_MIN_PIXELS = 0.5f;  // projected diameter below which we cull
+// widens the belt's cull frustum by this factor, survivors are drawn a frame
+// later
+const float BELT_FRUSTUM_MARGIN = 1.1f;
+// with RENDER_PIPELINING bodies are culled with the camera of the frame
+// before the one drawn, so the side planes are turned out by this angle. a
+// turn larger than this between the two latches the older camera instead
+const float BODY_FRUSTUM_MARGIN = 10.0f; // degrees
+const glm::vec3 BELT_COLOR = glm::vec3(0.55f, 0.5f, 0.45f);
+
+// saturn's rings up close: instanced particles instead of the textured
+// annulus within RING_PARTICLE_DISTANCE outer radii of the ring. the count
+// follows the ring's screen coverage and is capped so the particle pass stays
+// within RING_PARTICLE_BUDGET of gpu time
+const int RING_PARTICLES = 2000000;
+const float RING_PARTICLE_THICKNESS = 0.02f; // world units
+const float RING_PARTICLE_MIN_SIZE = 0.004f;
+const float RING_PARTICLE_MAX_SIZE = 0.03f;
+const float RING_PARTICLE_SPEED = 20.0f; // degrees per second at the inner edge
+const float RING_PARTICLE_DISTANCE = 4.0f;
+const float RING_PARTICLE_BUDGET = 0.002f; // seconds
+const float RING_PARTICLE_MIN_PIXELS = 1.0f;
+
+// bodies projected smaller than IMPOSTOR_THRESHOLD pixels across are drawn as
+// ray-traced quads instead of sphere meshes, with a dithered cross-fade over
+// the next IMPOSTOR_FADE_BAND pixels. [ and ] scale the threshold at runtime
+const float IMPOSTOR_THRESHOLD = 12.0f;
+const float IMPOSTOR_FADE_BAND = 6.0f;
+const float IMPOSTOR_THRESHOLD_STEP = 1.25f; // factor per key press
+
+// planets at least TERRAIN_MIN_PIXELS across are drawn as cube-sphere
+// quadtrees refined until a chunk's error is under TERRAIN_MAX_PIXEL_ERROR
+// pixels. chunks are generated on their own thread pool and cached in
+// TERRAIN_BUDGET_BYTES of vertex buffers. off by default
+const bool TERRAIN = false;
+const int TERRAIN_CHUNK_RESOLUTION = 32; // quads along a chunk edge
+const size_t TERRAIN_BUDGET_BYTES = 32 * 1024 * 1024;
+const float TERRAIN_MAX_PIXEL_ERROR = 1.0f;
+const float TERRAIN_MIN_PIXELS = 300.0f;
+const int TERRAIN_MAX_LEVEL = 16;
+const unsigned int TERRAIN_THREADS = 0;  // 0 = one per hardware thread
+const int TERRAIN_UPLOADS_PER_FRAME = 8; // chunks
+const int TERRAIN_MAX_PENDING = 64;      // chunks queued for generation
+
+// close approaches: pairs of bodies whose surfaces come within
+// APPROACH_MARGIN world units are reported once when they get that close.
+// the check runs every simulation step on its own thread pool
+const float APPROACH_MARGIN = 5.0f;
+const unsigned int APPROACH_THREADS = 0;  // 0 = one per hardware thread
+const float APPROACH_BUDGET = 0.002f;     // seconds per step, see profiler
+
+// body trails: every trail keeps TRAIL_LENGTH positions, one recorded every
+// TRAIL_SAMPLE_INTERVAL seconds, in buffers sized for TRAIL_CAPACITY trails
+const int TRAIL_CAPACITY = 1024;
+const int TRAIL_LENGTH = 512;
+const float TRAIL_SAMPLE_INTERVAL = 0.05f;
+const glm::vec3 TRAIL_ROCKY_COLOR = glm::vec3(0.9f, 0.6f, 0.4f);
+const glm::vec3 TRAIL_GAS_COLOR = glm::vec3(0.5f, 0.7f, 1.0f);
+const glm::vec3 TRAIL_MOON_COLOR = glm::vec3(0.8f, 0.8f, 0.8f);
+
 // sun light intensities
 const glm::vec3 LIGHT_AMBIENT = glm::vec3(0.15f, 0.15f, 0.15f);
 const glm::vec3 LIGHT_DIFFUSE = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -56,4 +140,95 @@ const glm::vec3 GAS_KD = glm::vec3(0.9f, 0.9f, 0.9f);
 const glm::vec3 GAS_KS = glm::vec3(0.5f, 0.5f, 0.5f);
 const float GAS_SHININESS = 64.0f;
 
+// texture streaming: fine mip levels are decoded from the file and uploaded in
+// tiles when a body is big enough on screen, and evicted least recently used
+// first over the budget. a level is resident in full or not at all
+const bool TEXTURE_STREAMING = true;
+const size_t TEXTURE_BUDGET_BYTES = 192 * 1024 * 1024;
+const int TEXTURE_TILE_SIZE = 256;
+const int TEXTURE_FALLBACK_SIZE = 512; // levels this size or smaller stay
+const int TEXTURE_TILES_PER_FRAME = 16;
+
+// cubemaps: the body and sky maps are resampled from equirectangular into
+// cubemaps at load time (or read from make cubemaps) and sampled by
+// direction. 25% less memory for 78.5% of the equator resolution at the face
+// centres, and resident in full instead of streamed
+const bool CUBEMAP_TEXTURES = false;
+const char *CUBEMAP_DIR = "build/generated/cubemaps";
+const unsigned int CUBEMAP_THREADS = 0; // 0 = one per hardware thread
+
+// dynamic resolution: the scene is rendered at a fraction of the window size
+// that is adjusted to keep the gpu frame time near the target (toggle with R)
+const bool DYNAMIC_RESOLUTION = false;
+const float DYNAMIC_RESOLUTION_TARGET = 1.0f / 60.0f; // seconds of gpu time
+const float DYNAMIC_RESOLUTION_MIN_SCALE = 0.5f;
+const float DYNAMIC_RESOLUTION_STEP = 0.05f;       // scale changes in these steps
+const float DYNAMIC_RESOLUTION_HYSTERESIS = 0.1f;  // +-10% of the target
+const int DYNAMIC_RESOLUTION_SETTLE_FRAMES = 30;   // samples between changes
+
+// frames the driver may queue ahead of the gpu. 1 gives the lowest input
+// latency, raise it if the cpu and gpu need to overlap for throughput
+const int MAX_FRAMES_IN_FLIGHT = 1;
+
+// frame pipelining: the simulation and the frame packet (transforms,
+// culling, lod, sorting) of frame n + 1 are prepared on a frame thread while
+// the main thread submits frame n. the camera is still latched from the
+// input sampled right before the draws, only the simulation, culling and lod
+// see input a frame late (culling widened by BODY_FRUSTUM_MARGIN). off
+// prepares each frame right before its draws
+const bool RENDER_PIPELINING = true;
+const unsigned int FRAME_BUILD_THREADS = 0; // 0 = one per hardware thread
+const int FRAME_BUILD_MIN_BODIES = 256;     // per task, fewer run inline
+
+// gl state cache: program, vertex array, texture, blend and depth changes
+// that set what is already set are dropped before they reach the driver. off
+// forwards every call, for comparing. the stats add the issued and elided
+// calls per frame to the profiler line and the export summary
+const bool GL_STATE_CACHE = true;
+const bool GL_STATE_STATS = true;
+
+// bodies that might be hidden behind ones drawn before them are tested with
+// a box in an occlusion query and only drawn if some of it shows. off draws
+// every body, for comparing the per-pass fragment counts
+const bool OCCLUSION_CULLING = true;
+
+// profiler
+const float PROFILER_REPORT_INTERVAL = 2.0f; // seconds between stat lines
+
+// memory budgets in bytes, a warning is printed when one is crossed. 0 turns
+// a budget off. categories are listed in memory.h
+const size_t MEMORY_BUDGET_GPU = 512 * 1024 * 1024;
+const size_t MEMORY_BUDGET_CPU = 1024 * 1024 * 1024;
+const size_t MEMORY_BUDGET_TEXTURES = 256 * 1024 * 1024;
+const size_t MEMORY_BUDGET_CPU_TEXTURES = 512 * 1024 * 1024;
+
+// the planets, orbits, rings and renderers of a scene are allocated from
+// blocks of this size and freed together when the scene goes
+const size_t SCENE_ARENA_BLOCK = 64 * 1024;
+
+// ephemeris (--ephemeris): every body every EPHEMERIS_DEFAULT_STEP_HOURS
+// over EPHEMERIS_DEFAULT_YEARS, where a year is one orbit of a body with
+// orbit_speed 1 in planets.csv (the earth). blocks of EPHEMERIS_BLOCK_SAMPLES
+// are evaluated in parallel and positions are stored to EPHEMERIS_QUANTUM
+// world units
+const double EPHEMERIS_YEAR = 360.0 / SPEED_SCALE; // simulation seconds
+const double EPHEMERIS_DEFAULT_YEARS = 100.0;
+const double EPHEMERIS_DEFAULT_STEP_HOURS = 1.0;
+const unsigned int EPHEMERIS_BLOCK_SAMPLES = 4096;
+const double EPHEMERIS_QUANTUM = 0.001;
+const unsigned int EPHEMERIS_THREADS = 0; // 0 = one per hardware thread
+
+// offscreen export (--export)
+const int EXPORT_DEFAULT_WIDTH = 1920;
+const int EXPORT_DEFAULT_HEIGHT = 1080;
+const int EXPORT_DEFAULT_FRAMES = 300;
+const float EXPORT_FRAME_RATE = 30.0f; // simulation steps per exported second
+const int EXPORT_PBO_COUNT = 3;        // frames in flight between gpu and cpu
+const unsigned int EXPORT_ENCODER_THREADS = 0; // 0 = one per hardware thread
+
+// scripted camera path used by the export mode
+const float FLYTHROUGH_RADIUS = 120.0f;
+const float FLYTHROUGH_HEIGHT = 25.0f;
+const float FLYTHROUGH_SPEED = 6.0f; // degrees per second
+
 #endif
@@ -0,0 +1,68 @@
+#ifndef CUBEMAP_H
+#define CUBEMAP_H
+
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// resamples the equirectangular maps the bodies and the sky are drawn with
+// into cubemaps. a cubemap spends its texels evenly instead of crowding them
+// at the poles and is sampled with the direction itself, no atan/asin per
+// fragment. cpu only, shared by tools/cubegen and the loader.
+//
+// faces are in gl order (+x, -x, +y, -y, +z, -z) with rows top to bottom as
+// uploaded, and a direction maps to the same equirect texel as the spherical
+// mapping in the shaders: u = 0.5 + atan(z, x) / 2pi, v = 0.5 - asin(y) / pi.
+
+const char CUBEMAP_MAGIC[4] = {'C', 'U', 'B', 'E'};
+const uint32_t CUBEMAP_VERSION = 1;
+
+// file layout: this header, then every level finest first, each the six
+// faces back to back
+struct CubemapHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t faceSize;
+  uint32_t channels;
+  uint32_t levelCount;
+};
+
+struct CubemapImage {
+  int faceSize; // of level 0
+  int channels;
+  // prefiltered mip chain down to 1x1, each level the six faces back to back
+  vector<vector<unsigned char>> levels;
+
+  int levelSize(int level) const;
+  size_t faceBytes(int level) const;
+  const unsigned char *face(int level, int face) const;
+  size_t getBytes() const;
+};
+
+// a quarter of the equator per face, 25% fewer texels than the equirect. the
+// trade is resolution at the face centres, where cube texels are coarsest:
+// about 27% wider than at the equirect equator (78.5% of its linear
+// resolution). a face of width / pi would match it at ~22% more texels
+int cubemapFaceSize(int equirectWidth);
+
+// linear resolution at the face centres relative to the equirect equator,
+// 1 when they match
+double cubemapCentreResolution(int faceSize, int equirectWidth);
+
+// bilinear resampling of level 0 and a 2x2 box filter for the mips, split
+// into rows across the pool (inline without one). simd picks the sse2 path
+// where it is compiled in, off runs the scalar reference
+void convertEquirect(const unsigned char *pixels, int width, int height,
+                     int channels, int faceSize, ThreadPool *pool,
+                     CubemapImage &out, bool simd = true);
+
+bool writeCubemap(const char *path, const CubemapImage &image);
+bool readCubemap(const char *path, CubemapImage &image);
+
+// bytes of an equirect map with its full mip chain, for comparisons
+size_t equirectBytes(int width, int height, int channels);
+
+#endif
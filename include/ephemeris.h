@@ -0,0 +1,112 @@
+#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+
+#include "thread_pool.h"
+#include <cstdint>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// body positions precomputed over a long time range with the orbit logic of
+// CelestialBody, written to a compressed file that playback reads instead of
+// running the simulation. cpu only.
+
+const char EPHEMERIS_MAGIC[4] = {'E', 'P', 'H', 'M'};
+const uint32_t EPHEMERIS_VERSION = 1;
+
+// what places a body at any time, as passed to CelestialBody::setOrbit and
+// setRotationSpeed by the scene
+struct EphemerisBody {
+  string name;
+  float orbitRadius;
+  float orbitSpeed;
+  float rotationSpeed;
+  int parent; // index of an earlier body, -1 for none
+};
+
+// file layout: this header, the body names (a uint32 length and the bytes
+// each), the blocks, then one index entry per block. a block covers
+// blockSamples samples plus the first of the next block, so interpolating
+// never needs two blocks. it stores 3 columns per body (x, y, z), each
+// quantized to multiples of quantum and coded as zigzag varints of the first
+// value, the first delta and then the deltas of deltas, with runs of zeros
+// collapsed into a count. the column sizes in bytes lead the block, so a
+// single body can be decoded without the others
+struct EphemerisHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t bodyCount;
+  uint32_t blockSamples;
+  uint64_t sampleCount;
+  double startTime;
+  double step;
+  double quantum;
+  uint64_t indexOffset; // patched in once the blocks are written
+};
+
+// the time index, blocks are variable in size
+struct EphemerisIndexEntry {
+  double time;     // of the block's first sample
+  uint64_t offset; // from the start of the file
+  uint64_t bytes;
+};
+
+struct EphemerisStats {
+  double seconds;
+  uint64_t rawBytes;  // 3 floats per body and sample
+  uint64_t fileBytes;
+};
+
+// evaluates the samples block by block on the pool and streams the blocks
+// out in order as they finish, with at most two blocks per thread in memory.
+// the positions are exactly what CelestialBody::evaluate gives, quantized
+bool writeEphemeris(const char *path, const vector<EphemerisBody> &bodies,
+                    double startTime, double step, uint64_t sampleCount,
+                    uint32_t blockSamples, double quantum, ThreadPool &pool,
+                    EphemerisStats &stats);
+
+// random access by time through the index. the block read last is kept
+// decoded, so playing forward decodes each block once
+class EphemerisReader {
+private:
+  FILE *file;
+  EphemerisHeader header;
+  vector<string> names;
+  vector<EphemerisIndexEntry> index;
+
+  long long cachedBlock; // -1 if none
+  vector<vec3> cached;   // sample-major, sample * bodyCount + body
+
+  uint32_t blockSize(uint64_t block) const; // samples stored in the block
+  bool readBlock(uint64_t block, vector<unsigned char> &bytes);
+  bool loadBlock(uint64_t block);
+  // sample index and interpolation weight of a time, clamped to the range
+  uint64_t locate(double time, float &weight) const;
+
+public:
+  EphemerisReader();
+  ~EphemerisReader();
+
+  bool open(const char *path);
+  void close();
+  bool isOpen() const { return file != nullptr; }
+
+  int getBodyCount() const { return (int)names.size(); }
+  const string &getName(int body) const { return names[body]; }
+  int findBody(const string &name) const; // -1 if missing
+  uint64_t getSampleCount() const { return header.sampleCount; }
+  double getStartTime() const { return header.startTime; }
+  double getEndTime() const;
+
+  // every body at a time, interpolated linearly between samples. false if
+  // the file cannot be read
+  bool positionsAt(double time, vector<vec3> &positions);
+  // one body, decoding only its columns unless its block is already cached
+  bool positionAt(int body, double time, vec3 &position);
+};
+
+#endif
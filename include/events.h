@@ -0,0 +1,135 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "body.h"
+#include "thread_pool.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+enum EventKind {
+  EVENT_CONJUNCTION, // two bodies within an angle of each other
+  EVENT_OCCULTATION, // eclipses and transits: one disk in front of another
+  EVENT_FRUSTUM      // a body inside a fixed camera's frustum
+};
+
+// an interval in which a query's function is below zero, times in simulation
+// seconds like CelestialBody::evaluate
+struct SearchEvent {
+  int query;
+  EventKind kind;
+  double start;
+  double end;
+  double peak;  // where the function is lowest
+  double value; // the function there: radians past the threshold for
+                // conjunctions and occultations, world units for frustums
+  bool clipped; // already under way at the window start or still at its end
+};
+
+// finds when events happen between two times without stepping through them.
+//
+// every query is a function of time that is below zero during its event. it
+// is sampled on a coarse grid, fine enough that each dip of the function
+// spans a few samples, and refined around sign changes (bisection for the
+// start and end) and around sampled minima that stay above zero (golden
+// section, to catch events shorter than a step). the window is split into
+// time chunks that are sampled and refined on the pool.
+//
+// positions are evaluated with the orbits of the bodies handed in, walked
+// up their parents like CelestialBody::evaluate, for a batch of samples at a
+// time with one rotation per step instead of a sin and cos per sample.
+class EventSearch {
+private:
+  struct Orbit {
+    double radius;
+    double speed; // radians per second
+    int parent;   // earlier in the list, -1 for none
+    double size;  // body radius
+  };
+
+  struct Query {
+    EventKind kind;
+    int observer; // conjunctions and occultations
+    int a, b;     // the two bodies, occultations: source then occluder
+    double threshold;
+    vec4 planes[6]; // frustums, normalised, pointing inwards
+  };
+
+  struct Crossing {
+    double time;
+    bool entering;
+  };
+
+  // positions of every body for a run of samples, body-major
+  struct Batch {
+    int count;
+    vector<double> x, y, z;
+  };
+
+  ThreadPool pool;
+  vector<Orbit> orbits;
+  vector<Query> queries;
+  double tolerance;
+
+  size_t sampleCount; // of the last search
+  size_t refineCount; // function evaluations spent refining
+  double lastTime;
+
+  dvec3 positionAt(int body, double time) const;
+  void sampleBatch(double start, double step, int count, Batch &batch) const;
+  double evaluate(const Query &query, const dvec3 *positions) const;
+  double evaluateAt(const Query &query, double time,
+                    vector<dvec3> &scratch) const;
+  double findRoot(const Query &query, double lo, double hi, bool entering,
+                  vector<dvec3> &scratch, size_t &evaluations) const;
+  double findMinimum(const Query &query, double lo, double hi, double &value,
+                     vector<dvec3> &scratch, size_t &evaluations) const;
+  void scanChunk(double start, double step, size_t first, size_t last,
+                 size_t total, vector<vector<Crossing>> &crossings,
+                 vector<char> &insideAtStart, size_t &evaluations) const;
+  void pairCrossings(int query, const vector<Crossing> &crossings,
+                     bool inside, double start, double end,
+                     vector<SearchEvent> &events, size_t &evaluations) const;
+
+public:
+  // the bodies with their orbits and parents as set up for the scene. every
+  // parent has to be in the list before its children. 0 threads means one
+  // per hardware thread
+  EventSearch(const vector<CelestialBody *> &bodies, unsigned int threads);
+
+  // query ids count up from 0. body arguments index the list above.
+  // a and b closer than maxSeparation radians as seen from the observer
+  int addConjunction(int observer, int a, int b, double maxSeparation);
+  // the occluder's disk overlapping the source's, seen from the observer:
+  // a solar eclipse from the earth with the moon in front of the sun, a
+  // lunar one from the moon with the earth in front, transits likewise
+  int addOccultation(int observer, int source, int occluder);
+  // the body's sphere touching the frustum of a camera that stays put
+  int addFrustumEntry(int body, const mat4 &viewProjection);
+
+  // coarse step that resolves every query's dips: a fraction of the
+  // shortest orbital period among the bodies involved
+  double suggestStep() const;
+  // seconds, refinement stops below this
+  void setTolerance(double seconds) { tolerance = seconds; }
+
+  // events of every query between start and end, ordered by start time.
+  // step 0 uses suggestStep()
+  void search(double start, double end, double step,
+              vector<SearchEvent> &events);
+  // the reference: CelestialBody::evaluate on the bodies the search was
+  // built from at every step (they are left at the last one), events between
+  // the samples where a function changes sign, times linearly interpolated.
+  // single threaded and slow
+  void searchBruteForce(const vector<CelestialBody *> &bodies, double start,
+                        double end, double step,
+                        vector<SearchEvent> &events) const;
+
+  size_t getSampleCount() const { return sampleCount; }
+  size_t getRefineCount() const { return refineCount; }
+  double getLastTime() const { return lastTime; }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "framebuffer.h"
+#include "thread_pool.h"
+#include <GL/glew.h>
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum ExportFormat { EXPORT_PNG, EXPORT_RAW };
+
+// reads frames back from a framebuffer through a ring of pixel buffer objects
+// so glReadPixels never blocks, encoding happens on worker threads
+class FrameExporter {
+private:
+  enum SlotState { SLOT_FREE, SLOT_READING, SLOT_ENCODING };
+
+  struct Slot {
+    unsigned int PBO;
+    GLsync fence;
+    SlotState state;
+    int frameIndex;
+    future<void> encoded;
+  };
+
+  int width;
+  int height;
+  string outputDir;
+  ExportFormat format;
+
+  vector<Slot> slots;
+  int nextSlot;
+  int framesCaptured;
+  int readbackStalls;
+  atomic<long long> bytesWritten;
+  atomic<int> framesFailed; // not mapped or not written
+  ThreadPool encoders;
+
+  void dispatch(Slot &slot);
+  void release(Slot &slot);
+  void encode(const unsigned char *pixels, int frameIndex);
+
+public:
+  FrameExporter(int w, int h, const string &dir, ExportFormat fmt,
+                int pboCount, unsigned int encoderThreads);
+  ~FrameExporter();
+
+  void capture(const Framebuffer &source);
+  void poll();
+  void finish();
+
+  int getFramesCaptured() const { return framesCaptured; }
+  int getReadbackStalls() const { return readbackStalls; }
+  long long getBytesWritten() const { return bytesWritten.load(); }
+  int getFramesFailed() const { return framesFailed.load(); }
+
+  // creates dir and any missing parents, false if it is not a writable
+  // directory afterwards
+  static bool createDirectory(const string &dir);
+
+  // bytes written to the file, -1 if it could not be written
+  static long long writePNG(const string &path, const unsigned char *rgba,
+                            int w, int h);
+  static long long writeRaw(const string &path, const unsigned char *rgba,
+                            int w, int h);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FRAME_BUILDER_H
+#define FRAME_BUILDER_H
+
+#include "body.h"
+#include "frame_packet.h"
+#include "thread_pool.h"
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// turns bodies into draws for a frame packet: model matrix, frustum test,
+// projected size, impostor fade and the texel demand for texture streaming.
+// bodies are split into chunks that run on a pool of workers, small scenes
+// stay on the calling thread. uses only the bodies' getters, so it is safe
+// while nothing updates them.
+class FrameBuilder {
+private:
+  ThreadPool pool;
+  int minBodiesPerTask;
+
+  // per call scratch, kept to avoid reallocating
+  vector<BodyDraw> draws;
+  vector<float> texels;
+  vector<char> visible;
+
+  double lastTime;
+
+public:
+  // 0 threads means one per hardware thread
+  FrameBuilder(unsigned int threads, int minBodiesPerTask);
+
+  // appends the visible bodies to `out`, sorted front to back, and one
+  // texture request per visible body
+  void build(const vector<CelestialBody *> &bodies, const FrameInput &input,
+             vector<BodyDraw> &out, vector<TextureRequest> &requests);
+
+  // draw of a single body without culling or fade, e.g. the sky
+  static BodyDraw makeDraw(const CelestialBody &body, const vec3 &eye);
+
+  // normalised planes of clip = projection * view: left, right, bottom, top,
+  // near, far. the four side planes pass through the eye
+  static void frustumPlanes(const mat4 &clip, vec4 planes[6]);
+  // whether a sphere reaches into the frustum with its side planes turned
+  // out by an angle of sine sideMargin. distance is from the eye to center
+  static bool sphereInFrustum(const vec4 planes[6], const vec3 &center,
+                              float radius, float distance, float sideMargin);
+
+  double getLastTime() const { return lastTime; }
+  unsigned int getThreadCount() const { return pool.size(); }
+};
+
+#endif
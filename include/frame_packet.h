@@ -0,0 +1,79 @@
+#ifndef FRAME_PACKET_H
+#define FRAME_PACKET_H
+
+#include "mesh.h"
+#include "texture.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// camera and toggles sampled on the main thread for one frame
+struct FrameInput {
+  float dt; // simulation step that leads to this frame
+  double sampleTime; // when it was sampled, seconds on the clock.h clock
+  mat4 view;
+  mat4 projection;
+  vec3 eye;
+  float fovY;              // radians
+  float cullMargin;        // radians the side planes are turned out by
+  int width, height;       // window size
+  int lodWidth, lodHeight; // render size used to pick levels of detail
+  float impostorThreshold; // pixels
+  float impostorFadeBand;  // pixels
+  bool drawOrbits;
+  bool drawTrails;
+  bool pick; // pick through the screen center
+};
+
+// one body ready to draw, everything the draw needs is copied out of the
+// simulation so nothing reads the bodies while the next frame updates them
+struct BodyDraw {
+  mat4 model;
+  vec3 center;
+  float radius;
+  float rotation; // radians around y, the impostor rebuilds its frame from it
+  Mesh *mesh;
+  Texture *texture;
+  vec3 ka, kd, ks;
+  float shininess;
+  float fade;  // impostor share, 0 mesh only, 1 impostor only
+  float depth; // distance from the eye
+  int id;      // index into the list the draw was built from, -1 if none
+};
+
+struct TextureRequest {
+  Texture *texture;
+  float texels; // across the full map width
+};
+
+// everything the submission side needs for one frame. prepareFrame fills it
+// on the frame thread, afterwards it is only read
+struct FramePacket {
+  FrameInput input;
+  double elapsed; // simulation time, a float only where the shaders take it
+  vec3 sunPosition;
+
+  BodyDraw background;
+  vector<BodyDraw> unlit;  // the sun when it is in view
+  vector<BodyDraw> bodies; // lit bodies in view, front to back
+  vector<TextureRequest> textureRequests;
+  vector<vec3> trailPositions; // by trail id
+  bool hasMoonOrbit;
+  mat4 moonOrbitModel;
+  bool hasRing;
+  vec3 ringPosition;
+
+  // results for the main thread to report
+  bool picked;
+  string pickedName;
+  float pickedDistance;
+  int culledCount;
+  double approachTime; // seconds
+  double buildTime;    // seconds in the frame builder
+  double prepareTime;  // seconds for the whole preparation
+};
+
+#endif
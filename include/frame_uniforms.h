@@ -0,0 +1,61 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// per-frame camera data (the FrameData uniform block in the shaders), kept in
+// a ring of slots with one fence each. writing a slot waits for the frame
+// that last used it, which also caps how many frames the driver can queue.
+// the camera is written as late as possible, right before the draws.
+class FrameUniforms {
+private:
+  // std140 layout of the FrameData block
+  struct Block {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+  };
+
+  struct Slot {
+    GLsync fence;      // signalled when the gpu finished the frame
+    double sampleTime; // when the camera input for that frame was sampled
+  };
+
+  unsigned int UBO;
+  GLsizeiptr slotStride; // block size rounded up to the offset alignment
+  vector<Slot> slots;
+  int current;
+
+  double latency;  // input sampled -> gpu finished, last completed frame
+  double waitTime; // time blocked in the last acquire()
+
+  void poll();
+  void retire(Slot &slot, double now);
+
+public:
+  static const unsigned int BINDING = 0; // uniform block binding point
+
+  explicit FrameUniforms(int framesInFlight);
+  ~FrameUniforms();
+
+  // waits until the next slot is free, i.e. until at most framesInFlight - 1
+  // frames are still queued on the gpu
+  void acquire();
+  // writes the camera into the slot and binds it for the following draws.
+  // the latency is measured from sampleTime (clock.h), when the camera
+  // input was read
+  void latch(const mat4 &view, const mat4 &projection, const vec3 &viewPos,
+             double sampleTime);
+  // fences the frame after it has been submitted (after the swap)
+  void submit();
+
+  double getLatency() const { return latency; }
+  double getWaitTime() const { return waitTime; }
+};
+
+#endif
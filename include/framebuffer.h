@@ -0,0 +1,31 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <GL/glew.h>
+
+// offscreen render target: color texture + depth renderbuffer
+class Framebuffer {
+private:
+  int width;
+  int height;
+
+  void create();
+  void destroy();
+
+public:
+  unsigned int ID;
+  unsigned int colorTexture;
+  unsigned int depthBuffer;
+
+  Framebuffer(int w, int h);
+  ~Framebuffer();
+
+  void resize(int w, int h);
+  void bind() const;
+  void unbind() const;
+
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+};
+
+#endif
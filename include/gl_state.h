@@ -0,0 +1,81 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+
+// the gl state the renderer changes per draw, shadowed on the cpu so calls
+// that would set what is already set never reach the driver. passes declare
+// the state they need instead of restoring the previous one afterwards, so
+// consecutive passes that agree cost nothing. every bind, enable and delete
+// of the tracked state has to go through here or the shadow goes stale; gl
+// thread only. issued and elided calls are counted per frame.
+class GLState {
+private:
+  static const int TEXTURE_UNITS = 16;
+  // the texture targets that are tracked, others pass straight through
+  enum TextureTarget {
+    TARGET_2D,
+    TARGET_CUBE_MAP,
+    TARGET_BUFFER,
+    TARGET_COUNT
+  };
+  enum Capability {
+    CAP_BLEND,
+    CAP_DEPTH_TEST,
+    CAP_CULL_FACE,
+    CAP_PROGRAM_POINT_SIZE,
+    CAP_RASTERIZER_DISCARD,
+    CAP_COUNT
+  };
+
+  static bool caching;
+  static unsigned int program;
+  static unsigned int vertexArray;
+  static unsigned int activeUnit;
+  static unsigned int textures[TEXTURE_UNITS][TARGET_COUNT];
+  static int capabilities[CAP_COUNT]; // 0 or 1, -1 after invalidate
+  static GLenum blendSource, blendDestination;
+  static int depthWrite;
+  static GLenum depthCompare;
+
+  static unsigned long issued, elided;
+  static unsigned long lastIssued, lastElided;
+
+  // counts the call and tells whether it has to reach the driver
+  static bool changes(bool differs);
+  static int textureTarget(GLenum target);
+  static int capabilityIndex(GLenum cap);
+
+public:
+  static void useProgram(unsigned int id);
+  static void bindVertexArray(unsigned int id);
+  static void activeTexture(unsigned int unit);
+  // binds on the active unit, like glBindTexture
+  static void bindTexture(GLenum target, unsigned int id);
+  static void setCapability(GLenum cap, bool enabled);
+  static void blendFunc(GLenum source, GLenum destination);
+  static void depthMask(bool write);
+  static void depthFunc(GLenum compare);
+
+  // the state of the common passes: depth tested (GL_LESS) and written
+  // without blending, and alpha blended with or without depth writes
+  static void setOpaque();
+  static void setBlended(GLenum source, GLenum destination, bool depthWrite);
+
+  // gl reuses deleted names and unbinds them, so the shadow forgets them too
+  static void deleteVertexArrays(int count, const unsigned int *ids);
+  static void deleteTextures(int count, const unsigned int *ids);
+
+  // after gl calls that bypassed the cache, the next call of each kind is
+  // issued again
+  static void invalidate();
+  // off forwards every call, to compare against the cached path
+  static void setCaching(bool enabled);
+
+  // latches the counts of the frame that just ended and starts a new one
+  static void endFrame();
+  static unsigned long getIssuedCalls() { return lastIssued; }
+  static unsigned long getElidedCalls() { return lastElided; }
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+// gpu time of one pass per frame from a pair of timestamp queries. timestamps
+// can run inside the frame's GL_TIME_ELAPSED query; results are read a few
+// frames late so the cpu never waits for them, and a frame whose query slot
+// is still in flight is not timed.
+class GpuTimer {
+private:
+  static const int QUERY_COUNT = 4;
+
+  unsigned int queries[QUERY_COUNT][2]; // start and end timestamps
+  bool queryPending[QUERY_COUNT];
+  int queryIndex;
+  bool timing; // begin() started a query this frame
+  double time; // smoothed seconds
+
+  void collectQueries();
+
+public:
+  GpuTimer();
+  ~GpuTimer();
+
+  void begin();
+  void end();
+
+  double getTime() const { return time; }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "frame_packet.h"
+#include "shader.h"
+#include "texture.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// far away bodies drawn as camera-facing quads instead of sphere meshes. the
+// fragment shader intersects the view ray with the sphere, so the shading,
+// texture lookup and depth match the mesh path at a fraction of the vertex
+// work. bodies are queued each frame and drawn with one instanced call per
+// texture.
+//
+// fade is the impostor's share while crossing over to the mesh: both paths
+// discard complementary halves of an ordered dither pattern, so there is no
+// blending and no sorting.
+class ImpostorRenderer {
+private:
+  struct Instance {
+    vec4 sphere; // world center, radius
+    vec4 params; // rotation (radians), fade, shininess, unused
+    vec3 ka, kd, ks;
+  };
+
+  struct Queued {
+    Texture *texture;
+    Instance instance;
+  };
+
+  vector<Queued> queued;
+  vector<Instance> instances; // queued, grouped by texture for the upload
+
+  unsigned int VAO, quadVBO, instanceVBO;
+  size_t capacity; // instances the buffer has room for
+
+  int drawCalls; // in the last render
+
+  void setInstanceOffset(size_t first);
+
+public:
+  ImpostorRenderer();
+  ~ImpostorRenderer();
+
+  // queued with the draw's fade
+  void add(const BodyDraw &draw);
+
+  // draws and clears everything queued since the last call. needs the
+  // FrameData block bound and the lighting uniforms set
+  void render(Shader &shader);
+
+  int getDrawCalls() const { return drawCalls; }
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+enum MemoryCategory {
+  // gpu
+  MEMORY_TEXTURES,   // sampled images including their mip chains
+  MEMORY_GEOMETRY,   // static vertex and index buffers
+  MEMORY_INSTANCES,  // per-instance, particle, feedback and trail buffers
+  MEMORY_TARGETS,    // offscreen color and depth attachments
+  MEMORY_TRANSFER,   // uniform ring buffers and readback pbos
+  // cpu
+  MEMORY_CPU_TEXTURES, // decoded levels while they stream in
+  MEMORY_CPU_SCENE,    // per-body arrays, trails, acceleration structures
+  MEMORY_CATEGORY_COUNT
+};
+
+// bytes held by gl objects and large cpu arrays, by category. gl objects are
+// keyed by their name so a release or a respecified buffer needs no size;
+// cpu arrays are keyed by their owner. budgets are checked on every change
+// and crossing one queues a warning once until usage drops below it again.
+class MemoryTracker {
+private:
+  enum ObjectKind { BUFFER, TEXTURE, RENDERBUFFER, CPU };
+
+  struct Entry {
+    MemoryCategory category;
+    size_t bytes;
+  };
+
+  static mutex lock;
+  static map<pair<int, size_t>, Entry> entries;
+  static size_t bytes[MEMORY_CATEGORY_COUNT];
+  static size_t peakBytes[MEMORY_CATEGORY_COUNT];
+  static size_t budgets[MEMORY_CATEGORY_COUNT];
+  static bool overBudget[MEMORY_CATEGORY_COUNT];
+  static size_t gpuBudget, cpuBudget;
+  static size_t peakGpu, peakCpu;
+  static bool gpuOver, cpuOver;
+  static vector<string> warnings;
+
+  static void track(ObjectKind kind, size_t key, MemoryCategory category,
+                    size_t size);
+  static void untrack(ObjectKind kind, size_t key);
+  static void change(MemoryCategory category, long long delta);
+  static void checkBudget(const char *name, size_t used, size_t budget,
+                          bool &over);
+  static size_t sum(int first, int last);
+
+public:
+  // replaces whatever was recorded for the object before, e.g. after
+  // glBufferData grows a buffer or a streamed texture gains a level
+  static void trackBuffer(unsigned int id, MemoryCategory category,
+                          size_t size);
+  static void trackTexture(unsigned int id, MemoryCategory category,
+                           size_t size);
+  static void trackRenderbuffer(unsigned int id, MemoryCategory category,
+                                size_t size);
+  static void trackCpu(const void *owner, MemoryCategory category,
+                       size_t size);
+
+  // call next to the matching glDelete*, unknown names are ignored
+  static void releaseBuffer(unsigned int id);
+  static void releaseTexture(unsigned int id);
+  static void releaseRenderbuffer(unsigned int id);
+  static void releaseCpu(const void *owner);
+
+  // bytes of a texture level and the full chain below it
+  static size_t textureBytes(int width, int height, int bytesPerTexel,
+                             bool mipmapped);
+
+  static size_t getBytes(MemoryCategory category);
+  static size_t getPeakBytes(MemoryCategory category);
+  static size_t getGpuBytes();
+  static size_t getCpuBytes();
+  static size_t getPeakGpuBytes();
+  static size_t getPeakCpuBytes();
+  static const char *getCategoryName(MemoryCategory category);
+
+  // 0 disables a budget
+  static void setBudget(MemoryCategory category, size_t size);
+  static void setGpuBudget(size_t size);
+  static void setCpuBudget(size_t size);
+
+  // budget warnings since the last call
+  static vector<string> takeWarnings();
+  // one line with the totals and every non-empty category in MB
+  static string summary(bool peak = false);
+};
+
+#endif
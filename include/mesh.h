@@ -0,0 +1,45 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "vertex_format.h"
+#include <GL/glew.h>
+
+struct MeshData;
+
+// gpu copy of one of the canonical meshes generated at build time
+// (build/generated/mesh_data.h), already packed in its vertex format with
+// 16-bit indices. each mesh is uploaded on first use and shared by every
+// object that acquires it; the last release deletes it.
+class Mesh {
+private:
+  int refCount;
+
+  explicit Mesh(const MeshData &data);
+  ~Mesh();
+
+  static Mesh *acquire(Mesh *&slot, const MeshData &data);
+
+public:
+  // every canonical mesh has fewer than 65536 vertices
+  static const GLenum INDEX_TYPE = GL_UNSIGNED_SHORT;
+
+  unsigned int VAO, VBO, IBO;
+  int indexCount;
+  const VertexFormat *format; // for other vertex arrays over VBO (the belt)
+
+  // unit sphere (position, normal), lod 0 is the coarsest
+  static Mesh *acquireSphere(int lod);
+  static int getSphereLodCount();
+  // ring with unit radii (position, normal, texture coordinates), the ring
+  // shader places inner and outer vertices from u
+  static Mesh *acquireRing();
+  static void release(Mesh *mesh);
+
+  // attribute pointers of the bound vertex buffer, into the bound vertex
+  // array
+  static void setupAttributes(const VertexFormat &format);
+
+  void draw() const;
+};
+
+#endif
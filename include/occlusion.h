@@ -0,0 +1,88 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// samples that passed the depth test in one pass per frame, from
+// GL_SAMPLES_PASSED queries read a few frames late like GpuTimer. with early
+// depth testing that is about the fragments the pass shaded. occlusion
+// queries can't nest, so a pass that issues its own (OcclusionCuller) pauses
+// the count around them; the segments of a frame are summed.
+class FragmentCounter {
+private:
+  static const int QUERY_COUNT = 4;
+
+  vector<unsigned int> queries[QUERY_COUNT]; // one per segment, grown
+  int segments[QUERY_COUNT];                 // used this time round
+  bool queryPending[QUERY_COUNT];
+  int queryIndex;
+  bool counting; // begin() started a count this frame
+  bool active;   // a segment is open
+  double fragments; // smoothed per frame
+
+  void collectQueries();
+  void beginSegment();
+
+public:
+  FragmentCounter();
+  ~FragmentCounter();
+
+  void begin();
+  void pause();
+  void resume();
+  void end();
+
+  double getFragments() const { return fragments; }
+};
+
+// skips bodies hidden behind what is already in the depth buffer. a box
+// around the body is drawn into a GL_ANY_SAMPLES_PASSED query with color and
+// depth writes off, and the body's draw is made conditional on it, so the
+// gpu drops it without the cpu ever waiting for the result. pays off when
+// the bodies are drawn front to back. the results are also read a few
+// frames late to count what was skipped.
+class OcclusionCuller {
+private:
+  static const int QUERY_COUNT = 4;
+
+  unsigned int VAO, VBO, EBO;
+  vector<unsigned int> queries[QUERY_COUNT]; // one per test, grown
+  int tests[QUERY_COUNT];
+  bool queryPending[QUERY_COUNT];
+  int queryIndex;
+  bool conditional; // inside beginDraw/endDraw with a query
+
+  // of the last frame whose results came back
+  int hiddenCount;
+  int lastTested;
+
+  void setupProxy();
+  void collectQueries();
+
+public:
+  OcclusionCuller();
+  ~OcclusionCuller();
+
+  // starts a frame's tests
+  void begin();
+  // draws the proxy of a sphere and returns a query to draw it under, or -1
+  // when the box could reach the near plane from the eye (a clipped box
+  // would hide a visible body). shader is a position-only program with a
+  // "model" uniform, e.g. the orbit shader
+  int test(Shader &shader, const vec3 &center, float radius, const vec3 &eye,
+           float nearPlane, FragmentCounter *counter);
+  // wrap the body's draw, no-ops for query -1
+  void beginDraw(int query);
+  void endDraw();
+  void end();
+
+  int getTestedCount() const { return lastTested; }
+  int getHiddenCount() const { return hiddenCount; }
+};
+
+#endif
@@ -20,9 +20,7 @@ public:
   Orbit(float orbitRadius, const glm::vec3 &orbitColor = glm::vec3(1.0f));
   ~Orbit();
 
-  void render(Shader &shader, const glm::mat4 &view,
-              const glm::mat4 &projection,
-              const glm::mat4 &model = glm::mat4(1.0f));
+  void render(Shader &shader, const glm::mat4 &model = glm::mat4(1.0f));
 };
 
 #endif
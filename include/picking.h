@@ -0,0 +1,93 @@
+#ifndef PICKING_H
+#define PICKING_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+struct RayHit {
+  int id;         // id given to the primitive that was hit
+  float distance; // along the ray, in world units
+  vec3 point;
+};
+
+// bounding volume hierarchy over body bounding spheres and ring annuli.
+// built once as a binary tree and collapsed to four children per node, then
+// refit bottom-up whenever primitives move.
+class BodyBVH {
+public:
+  enum PrimitiveType { PRIMITIVE_SPHERE, PRIMITIVE_ANNULUS };
+
+  struct Primitive {
+    PrimitiveType type;
+    vec3 center;
+    float radius;      // sphere radius, or annulus outer radius
+    float innerRadius; // annulus only
+    vec3 normal;       // annulus only
+    int id;
+  };
+
+private:
+  // binary node, only used while building
+  struct Node {
+    vec3 boundsMin;
+    int leftFirst; // first child if count == 0, else first primitive
+    vec3 boundsMax;
+    int count;     // number of primitives in a leaf, 0 for inner nodes
+  };
+
+  // four child boxes side by side, so one node is two cache lines and a ray
+  // tests all four with the same few loads. halves the depth a ray has to
+  // walk, which is what costs once the tree no longer fits in cache
+  struct WideNode {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    int child[4]; // wide node index, or first primitive of a leaf
+    int count[4]; // primitives in a leaf, 0 for a wide node, -1 if unused
+  };
+
+  static const int LEAF_SIZE = 2;     // always split above this
+  static const int MAX_LEAF_SIZE = 8; // never stop splitting above this
+  static const int SAH_BINS = 12;
+  static const int MAX_DEPTH = 64;
+
+  vector<Primitive> primitives;
+  vector<int> slotOf; // primitive index as given to build() -> storage slot
+  vector<WideNode> nodes;
+
+  void primitiveBounds(const Primitive &prim, vec3 &bmin, vec3 &bmax) const;
+  void rangeBounds(int first, int count, vec3 &bmin, vec3 &bmax) const;
+  void subdivide(vector<Node> &tree, int nodeIndex, vector<int> &order,
+                 const vector<vec3> &boxMin, const vector<vec3> &boxMax,
+                 int depth);
+  int collapse(const vector<Node> &tree, int nodeIndex);
+  bool intersect(const Primitive &prim, const vec3 &origin, const vec3 &dir,
+                 float &t) const;
+
+public:
+  ~BodyBVH();
+
+  void build(const vector<Primitive> &prims);
+
+  // move a primitive, takes effect on the next refit()
+  void setSphere(int index, const vec3 &center, float radius);
+  void setAnnulus(int index, const vec3 &center, const vec3 &normal,
+                  float innerRadius, float outerRadius);
+  void refit();
+
+  bool raycast(const vec3 &origin, const vec3 &dir, RayHit &hit) const;
+  bool pick(float screenX, float screenY, int width, int height,
+            const mat4 &view, const mat4 &projection, RayHit &hit) const;
+
+  size_t getPrimitiveCount() const { return primitives.size(); }
+  size_t getNodeCount() const { return nodes.size(); }
+
+  // world-space ray through a pixel, screen origin at the top left
+  static void screenRay(float screenX, float screenY, int width, int height,
+                        const mat4 &view, const mat4 &projection, vec3 &origin,
+                        vec3 &dir);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// collects per-frame stats and prints them as one line every few seconds
+class Profiler {
+private:
+  struct Stat {
+    string name;
+    double value;
+    double sum;
+    bool averaged;
+  };
+
+  vector<Stat> stats;
+  vector<string> notes;
+  float reportInterval;
+  double intervalStart;
+  double lastFrameStart;
+  double frameTimeSum;
+  int frames;
+
+  Stat &find(const string &name, bool averaged);
+
+public:
+  explicit Profiler(float interval);
+
+  void beginFrame(double now);
+
+  // latest value wins, e.g. resident bytes
+  void set(const string &name, double value);
+  // accumulated and averaged per frame, e.g. draw calls
+  void add(const string &name, double value);
+  // one-off event text, appended to the next report line
+  void note(const string &text);
+
+  // prints the line once the interval has elapsed, returns true if it did
+  bool report(double now);
+
+  double getAverageFrameTime() const;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include "framebuffer.h"
+#include <GL/glew.h>
+#include <string>
+
+using namespace std;
+
+// renders the scene into an offscreen target at a fraction of the window size
+// and upscales it with a linear blit. the fraction is steered by the measured
+// gpu frame time: when the time is over the target the render size shrinks,
+// when there is enough headroom for the next larger step it grows again.
+class DynamicResolution {
+private:
+  static const int QUERY_COUNT = 4; // results are read a few frames late
+
+  Framebuffer target; // window sized, only the scaled corner is drawn into
+  unsigned int queries[QUERY_COUNT];
+  bool queryPending[QUERY_COUNT];
+  int queryIndex;
+  bool timing; // a query was started this frame
+
+  bool enabled;
+  float scale;
+  float minScale;
+  float scaleStep; // scales are multiples of this, so sizes stay stable
+  float targetTime;
+  float hysteresis; // fraction of the target to stay clear of before changing
+  int settleFrames; // samples to collect after a change before the next one
+
+  double gpuTime; // smoothed, seconds
+  bool hasGpuTime;
+  int samplesSinceChange;
+  string lastDecision;
+  int decisions;
+
+  int windowWidth;
+  int windowHeight;
+
+  void collectQueries();
+  void govern(double sample);
+  void setScale(float newScale, const char *reason);
+  float quantize(float value) const;
+
+public:
+  DynamicResolution(int width, int height, float targetFrameTime,
+                    float minimumScale, float step, float hysteresisFraction,
+                    int settle);
+  ~DynamicResolution();
+
+  // binds the scaled target (or the window when disabled) and starts timing
+  void begin(int width, int height);
+  // stops timing, upscales into the window and updates the scale
+  void end();
+
+  void setEnabled(bool enable);
+  bool isEnabled() const { return enabled; }
+
+  float getScale() const { return enabled ? scale : 1.0f; }
+  int getRenderWidth() const;
+  int getRenderHeight() const;
+  double getGpuTime() const { return gpuTime; }
+
+  // description of the last scale change, empty when there was none since
+  // the previous call
+  string takeDecision();
+  int getDecisionCount() const { return decisions; }
+};
+
+#endif
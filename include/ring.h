@@ -1,6 +1,7 @@
 #ifndef RING_H
 #define RING_H
 
+#include "mesh.h"
 #include "shader.h"
 #include "texture.h"
 #include <GL/glew.h>
@@ -16,17 +17,9 @@ private:
   float rotationAngle;
   float tiltAngle;
 
-  unsigned int VAO, VBO, IBO;
-  int indexCount;
+  Mesh *mesh; // shared unit ring, the shader applies the radii
   Texture *texture;
 
-  static const int SEGMENTS = 100;
-
-  void setupMesh(const float *vertices, int vertexCount,
-                 const unsigned int *indices, int idxCount);
-  void createRingGeometry(float *&vertices, int &vertexCount,
-                          unsigned int *&indices, int &idxCount);
-
 public:
   Ring(float innerRad, float outerRad, const char *texturePath);
   ~Ring();
@@ -35,7 +28,18 @@ public:
   void setRotation(float angle);
   void setPosition(const vec3 &pos);
   void update(const vec3 &parentPos, float parentRotation);
-  void render(Shader &shader, const mat4 &view, const mat4 &projection);
+  void render(Shader &shader);
+
+  vec3 getPosition() const { return position; }
+  vec3 getNormal() const;
+  mat4 getModelMatrix() const;
+  float getInnerRadius() const { return innerRadius; }
+  float getOuterRadius() const { return outerRadius; }
+  Texture *getTexture() const { return texture; }
+
+  static void createRingGeometry(float innerRad, float outerRad, int segments,
+                                 float *&vertices, int &vertexCount,
+                                 unsigned int *&indices, int &idxCount);
 };
 
 #endif
@@ -0,0 +1,87 @@
+#ifndef RING_PARTICLES_H
+#define RING_PARTICLES_H
+
+#include "ring.h"
+#include "shader.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// close-up level of detail for a ring: instead of the flat textured annulus,
+// every particle is an instanced camera-facing disc whose orbit is evaluated
+// in the vertex shader. the instances are stored in random order, so drawing
+// the first n of them is an even thinning of the whole ring and the count can
+// change every frame without touching the buffer.
+//
+// the count follows the ring's share of the screen and is capped by a gpu
+// time budget. the particle pass is timed with timestamp queries (they can
+// run inside the frame's GL_TIME_ELAPSED query), read a few frames late.
+class RingParticles {
+public:
+  struct Instance {
+    vec4 orbit; // radius, phase, angular speed (rad/s), height
+    float size;
+  };
+
+private:
+  static const int QUERY_COUNT = 4;
+
+  int maxParticles;
+  float innerRadius, outerRadius;
+
+  unsigned int VAO, quadVBO, instanceVBO;
+
+  unsigned int queries[QUERY_COUNT][2]; // start and end timestamps
+  bool queryPending[QUERY_COUNT];
+  int queryDrawn[QUERY_COUNT]; // particles drawn in the timed pass
+  int queryIndex;
+
+  float switchDistance; // in outer radii, particles are used closer than this
+  float gpuBudget;      // seconds per frame for the particle pass
+
+  bool active;        // particles instead of the annulus this frame
+  int coverageCount;  // particles wanted for the ring's screen coverage
+  int budgetCount;    // particles that fit the gpu budget
+  int drawnCount;     // particles in the last draw
+  double gpuTime;     // smoothed seconds for the particle pass
+  double throughput;  // smoothed particles per second of gpu time
+
+  void createBuffers(const vector<Instance> &instances);
+  void collectQueries();
+
+public:
+  // radii and thickness in ring units, sizes in world units. degreesPerSecond
+  // is the orbit speed at the inner edge, further out is slower following
+  // kepler
+  RingParticles(int count, float innerRad, float outerRad, float thickness,
+                float minSize, float maxSize, float degreesPerSecond,
+                float lodDistance, float gpuBudgetSeconds);
+  ~RingParticles();
+
+  // particle orbits in random order, split out so the bench can time it
+  static void createInstances(int count, float innerRad, float outerRad,
+                              float thickness, float minSize, float maxSize,
+                              float degreesPerSecond,
+                              vector<Instance> &instances);
+
+  // picks particles or the annulus for this view and the particle count
+  void update(const Ring &ring, const vec3 &eye, float fovY,
+              float viewportWidth, float viewportHeight);
+
+  // draws the particles when active, otherwise the ring's own annulus.
+  // needs the FrameData block bound
+  void render(Ring &ring, Shader &particleShader, Shader &ringShader,
+              float time, float viewportHeight);
+
+  bool isActive() const { return active; }
+  int getMaxCount() const { return maxParticles; }
+  int getDrawnCount() const { return active ? drawnCount : 0; }
+  int getBudgetCount() const { return budgetCount; }
+  double getGpuTime() const { return gpuTime; }
+  double getThroughput() const { return throughput; }
+};
+
+#endif
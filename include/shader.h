@@ -3,13 +3,21 @@
 
 #include <GL/glew.h>
 #include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 class Shader {
 public:
     unsigned int ID;
     
-    Shader(const char* vertexPath, const char* fragmentPath);
+    // header goes right after the #version line of both stages, e.g. the
+    // #defines that pick a variant
+    Shader(const char* vertexPath, const char* fragmentPath,
+           const std::string &header = "");
+    // transform feedback program: vertex + geometry stage, no fragment stage,
+    // the listed outputs are captured interleaved into one buffer
+    Shader(const char* vertexPath, const char* geometryPath,
+           const std::vector<std::string> &feedbackVaryings);
     
     void use() const;
     
@@ -19,10 +27,17 @@ public:
     void setVec3(const std::string &name, const glm::vec3 &value) const;
     void setVec3(const std::string &name, float x, float y, float z) const;
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
+
+    // attaches a uniform block to a binding point, no-op if the program
+    // doesn't declare the block
+    void bindUniformBlock(const std::string &name, unsigned int binding) const;
     
 private:
+    unsigned int compileStage(GLenum stage, const char* path, std::string type);
     void checkCompileErrors(unsigned int shader, std::string type);
     std::string loadShaderFromFile(const char* filePath);
+    static std::string insertHeader(const std::string &code,
+                                    const std::string &header);
 };
 
 #endif
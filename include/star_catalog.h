@@ -0,0 +1,26 @@
+#ifndef STAR_CATALOG_H
+#define STAR_CATALOG_H
+
+#include <cstdint>
+
+// binary star catalog written by tools/stargen and read by StarField: a
+// header followed by `count` fixed-size records, brightest star first so a
+// magnitude limit is a prefix of the file. little endian, no padding.
+const char STAR_CATALOG_MAGIC[4] = {'S', 'T', 'A', 'R'};
+const uint32_t STAR_CATALOG_VERSION = 1;
+
+struct StarCatalogHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t recordSize; // sizeof(StarRecord), guards against layout changes
+};
+
+struct StarRecord {
+  int16_t direction[3]; // unit vector towards the star, scaled by 32767
+  int16_t magnitude;    // apparent visual magnitude in thousandths
+  uint8_t color[3];     // srgb of the star's temperature
+  uint8_t padding;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef STARFIELD_H
+#define STARFIELD_H
+
+#include "shader.h"
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// stars of a binary catalog (star_catalog.h) drawn as additive point sprites
+// at infinity, in place of the stars baked into the background texture. the
+// records are uploaded as they are stored, brightest first, so the magnitude
+// limit picks how many to draw. narrowing the field of view raises the limit
+// the way a larger aperture would.
+class StarField {
+private:
+  unsigned int VAO, VBO;
+  vector<float> magnitudes; // brightest first, for the limit search
+
+  float magnitudeLimit; // faintest star drawn at the reference field of view
+  float referenceFovY;  // radians
+  float minSize, maxSize;
+  float limitBrightness; // brightness of a star at the limit, 0..1
+
+  int drawnCount;
+  double loadTime; // seconds to read and upload the catalog
+  size_t gpuBytes;
+
+public:
+  StarField(float magnitudeLimit, float referenceFovY, float minSize,
+            float maxSize, float limitBrightness);
+  ~StarField();
+
+  // false if the file is missing or not a catalog of this version
+  bool load(const char *path);
+
+  void render(Shader &shader, float fovY);
+
+  int getStarCount() const { return (int)magnitudes.size(); }
+  int getDrawnCount() const { return drawnCount; }
+  double getLoadTime() const { return loadTime; }
+  size_t getBytes() const {
+    return gpuBytes + magnitudes.capacity() * sizeof(float);
+  }
+};
+
+#endif
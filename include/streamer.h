@@ -0,0 +1,110 @@
+#ifndef STREAMER_H
+#define STREAMER_H
+
+#include "texture.h"
+#include <GL/glew.h>
+#include <cstddef>
+#include "thread_pool.h"
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// streams the fine mip levels of large textures in tiles, driven by how many
+// texels the object covers on screen, and evicts least recently used levels
+// when the resident size exceeds the budget. residency is per level: a level
+// is either resident in full or not at all, tiles only spread its upload over
+// several frames. the coarse levels at or below the fallback size are
+// uploaded at load time and never evicted. no pixels are kept on the cpu: a
+// finer level is decoded from the file on a worker thread when it is wanted
+// and its copy is dropped once the last tile is up.
+class TextureStreamer {
+private:
+  struct Level {
+    int width;
+    int height;
+    // decoded pixels while the level's tiles upload, empty otherwise
+    shared_ptr<vector<unsigned char>> pixels;
+    bool allocated; // storage exists on the gpu
+    int tilesPending;
+    unsigned long lastUsedFrame;
+  };
+
+  struct StreamedTexture {
+    Texture *texture;
+    string path;
+    GLenum format;
+    int channels;
+    vector<Level> levels;
+    int residentLevel; // finest complete level, mirrors GL_TEXTURE_BASE_LEVEL
+    int loadingLevel;  // level being decoded or uploaded, -1 if none
+    future<void> decoding; // of loadingLevel, invalid once its tiles queue
+    int fallbackLevel; // this level and coarser ones stay resident
+    int wantedLevel;   // finest level requested this frame
+    bool unreadable;   // a decode failed, stays at residentLevel
+  };
+
+  struct TileRequest {
+    int texture;
+    int level;
+    int x, y;
+  };
+
+  vector<StreamedTexture> textures;
+  deque<TileRequest> queue;
+  vector<Texture *> cubemaps; // resident in full, not streamed
+  // every texture by file and target, bodies sharing a file share the texture
+  map<pair<string, GLenum>, Texture *> loaded;
+
+  size_t budgetBytes;
+  size_t residentBytes;
+  int tileSize;
+  int fallbackSize;
+  int tilesPerFrame;
+  unsigned long frame;
+  int sharedLoads; // loads answered from loaded
+  ThreadPool decoder;
+
+  int findTexture(const Texture *texture) const;
+  Texture *findLoaded(const char *path, GLenum target);
+  size_t levelBytes(const StreamedTexture &tex, int level) const;
+  void allocateLevel(StreamedTexture &tex, int level);
+  void freeLevel(StreamedTexture &tex, int level);
+  void trackMemory(const StreamedTexture &tex) const;
+  void schedule(bool wait);
+  void scheduleLevel(int index, int level);
+  void queueTiles(int index);
+  void upload(int maxTiles);
+  void uploadTile(const TileRequest &tile);
+  void setBaseLevel(StreamedTexture &tex, int level);
+  bool evictOne(unsigned long protectFrame);
+
+public:
+  TextureStreamer(size_t budget, int tile, int fallback, int tilesEachFrame);
+  ~TextureStreamer();
+
+  // loading a file again returns the texture of the first load
+  Texture *load(const char *path);
+  // the map resampled into a cubemap, read from cacheDir when tools/cubegen
+  // wrote it there and converted on the given number of threads (0 = one
+  // per hardware thread) otherwise. not streamed and outside the budget
+  Texture *loadCubemap(const char *path, const char *cacheDir,
+                       unsigned int threads);
+
+  // texels: how many texels across the full map width the object needs
+  void request(const Texture *texture, float texels);
+  void update();
+  void flush();
+
+  size_t getResidentBytes() const { return residentBytes; }
+  size_t getBudgetBytes() const { return budgetBytes; }
+  size_t getQueueDepth() const { return queue.size(); }
+  int getTextureCount() const { return (int)loaded.size(); }
+  int getSharedLoads() const { return sharedLoads; }
+};
+
+#endif
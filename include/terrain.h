@@ -0,0 +1,128 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "frame_packet.h"
+#include "shader.h"
+#include "thread_pool.h"
+#include <GL/glew.h>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// close-up level of detail for planets: a body that covers enough of the
+// screen is drawn as a cube projected onto the unit sphere, each face a
+// quadtree of equally sized chunks. a node is split while its geometric error
+// projects to more than maxPixelError pixels, so only the part of the surface
+// near the camera and in view is fine. chunks are generated on worker
+// threads, uploaded a few per frame and kept in a fixed pool of vertex
+// buffers sized by the budget, the least recently drawn is reused first. a
+// node whose children are not resident yet is drawn itself, so missing
+// chunks only delay refinement.
+//
+// chunks use the same object space as the sphere mesh and go through the
+// light shader; the position doubles as the normal.
+class TerrainRenderer {
+private:
+  struct Slot {
+    unsigned int VAO, VBO;
+    uint64_t key;
+    unsigned long lastUsed; // frame the chunk was last traversed
+    bool used;
+  };
+
+  struct Result {
+    uint64_t key;
+    vector<float> positions;
+  };
+
+  // per-body selection of the last update
+  struct Selection {
+    bool active;       // all six roots resident
+    vector<int> slots; // chunks to draw
+  };
+
+  int resolution; // quads along a chunk edge
+  int vertexCount;
+  int indexCount;
+  size_t chunkBytes;
+  float maxPixelError;
+  float minPixels;
+  int maxLevel;
+  int uploadsPerFrame;
+  int maxPending;
+
+  unsigned int IBO; // shared by every chunk
+  vector<Slot> slots;
+  int maxSlots;
+  unordered_map<uint64_t, int> resident; // key -> slot
+  unordered_set<uint64_t> pending;       // queued or being generated
+  unordered_map<int, Selection> selections;
+  unsigned long frame;
+
+  mutex resultMutex;
+  vector<Result> results;
+
+  int drawnChunks;
+  int uploadedChunks; // last update
+
+  ThreadPool pool;
+
+  static uint64_t makeKey(int body, int face, int level, int x, int y);
+
+  // the frustum of the chunks, in the unit sphere's space of one body
+  struct Frustum {
+    vec4 planes[6];
+    float sideMargin; // sine of the angle the side planes are turned out by
+  };
+
+  void select(int body, const BodyDraw &draw, const vec3 &eye,
+              const vec4 planes[6], float sideMargin, float pixelsPerRadian,
+              Selection &selection, bool &requested);
+  void visit(int body, int face, int level, int x, int y, int slot,
+             const vec3 &eyeLocal, const Frustum &frustum,
+             float pixelsPerRadian, vector<int> &out, bool &requested);
+  bool touch(uint64_t key, int &slot);
+  void request(uint64_t key, int face, int level, int x, int y);
+  int uploadResults(int limit);
+  int acquireSlot();
+
+public:
+  TerrainRenderer(int resolution, size_t budgetBytes, float maxPixelError,
+                  float minPixels, int maxLevel, unsigned int threads,
+                  int uploadsPerFrame, int maxPending);
+  ~TerrainRenderer();
+
+  // picks the chunks of every body in `draws` that is at least minPixels
+  // across, queues missing ones and uploads finished ones. chunks outside
+  // the camera's frustum, widened by its cullMargin, are neither drawn nor
+  // refined. bodies are keyed by BodyDraw::id. complete waits until the
+  // selection needs nothing new
+  void update(const vector<BodyDraw> &draws, const FrameInput &camera,
+              float viewportHeight, bool complete);
+
+  // whether the body should be drawn with render() instead of its mesh
+  bool isActive(int id) const;
+  // draws the selected chunks with the light shader's uniforms set per body
+  void render(Shader &shader, const BodyDraw &draw);
+
+  // unit-sphere positions of one chunk: (resolution + 1)^2 grid vertices,
+  // then a skirt of 4 * (resolution + 1) vertices pulled skirtDepth inwards
+  // to hide the cracks between levels
+  static void generateChunk(int face, int level, int x, int y, int resolution,
+                            float skirtDepth, vector<float> &positions);
+  static void generateIndices(int resolution, vector<unsigned short> &indices);
+
+  int getDrawnChunks() const { return drawnChunks; }
+  int getUploadedChunks() const { return uploadedChunks; }
+  int getResidentChunks() const { return (int)resident.size(); }
+  int getPendingChunks() const { return (int)pending.size(); }
+  size_t getResidentBytes() const { return resident.size() * chunkBytes; }
+};
+
+#endif
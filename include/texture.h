@@ -9,10 +9,13 @@ using namespace std;
 class Texture {
 public:
   unsigned int ID;
+  GLenum target; // GL_TEXTURE_2D, or GL_TEXTURE_CUBE_MAP for converted maps
   string type;
   string path;
 
   Texture(const char *texturePath);
+  Texture(unsigned int textureID, const char *texturePath,
+          GLenum textureTarget = GL_TEXTURE_2D);
   void bind(unsigned int unit = 0) const;
   void unbind() const;
   static unsigned int loadFromFile(const char *path);
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// fixed set of worker threads fed from a single task queue
+class ThreadPool {
+private:
+  vector<thread> workers;
+  queue<packaged_task<void()>> tasks;
+  mutex queueMutex;
+  condition_variable taskAvailable;
+  condition_variable allIdle;
+  unsigned int activeTasks;
+  bool stopping;
+
+  void workerLoop();
+
+public:
+  // tasks per worker that parallelFor splits into, so uneven chunks still
+  // balance out
+  static const int TASKS_PER_THREAD = 4;
+
+  // 0 threads means one per hardware thread
+  explicit ThreadPool(unsigned int threadCount = 0);
+  ~ThreadPool();
+
+  future<void> submit(const function<void()> &task);
+  void wait();
+
+  // splits [0, count) into chunks of at least minChunk, at most maxTasks()
+  // of them, and returns once body(task, begin, end) ran for each. task
+  // numbers the chunks from 0, for per-task scratch. the chunking depends
+  // only on count, minChunk and the pool size, so two calls with the same
+  // arguments split alike. runs inline for a single chunk or thread
+  void parallelFor(int count, int minChunk,
+                   const function<void(int, int, int)> &body);
+
+  unsigned int size() const { return (unsigned int)workers.size(); }
+  int maxTasks() const { return (int)workers.size() * TASKS_PER_THREAD; }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TRAIL_H
+#define TRAIL_H
+
+#include "shader.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// recent world positions of moving bodies, drawn as fading lines. all trails
+// share one vertex buffer laid out sample-major: row k holds sample k of every
+// trail, so recording a frame is a single contiguous upload of one row. the
+// rows form a ring, the oldest row is overwritten by the next sample. capacity
+// and length are fixed at construction, nothing is reallocated afterwards.
+class TrailRenderer {
+private:
+  int capacity;    // trails the buffers are sized for
+  int length;      // samples per trail
+  float interval;  // seconds between samples
+  int trailCount;  // trails in use
+
+  unsigned int VAO, VBO, IBO;
+  unsigned int colorBuffer, colorTexture; // per-trail color, a buffer texture
+
+  vector<vec3> samples; // cpu copy of the ring, for seeding new trails
+  vector<bool> seeded;  // history filled with the first position, so a new
+                        // trail starts as a point instead of a line to 0,0,0
+  bool needsFullUpload;
+
+  int head;          // row holding the newest sample
+  float sinceSample; // seconds since head was advanced
+
+  void createBuffers();
+
+public:
+  TrailRenderer(int maxTrails, int samplesPerTrail, float sampleInterval);
+  ~TrailRenderer();
+
+  // returns the trail id, or -1 when all trails are in use
+  int addTrail(const vec3 &color);
+  void setPosition(int trail, const vec3 &position);
+
+  // records this frame's positions into the head row, advancing it every
+  // sample interval. one glBufferSubData per frame.
+  void update(float deltaTime);
+
+  // one draw for every trail, blended and without depth writes
+  void render(Shader &shader);
+
+  int getTrailCount() const { return trailCount; }
+  size_t getMemoryBytes() const;
+};
+
+#endif
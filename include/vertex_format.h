@@ -0,0 +1,100 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <vector>
+
+using namespace std;
+
+// how a vertex is laid out in a gpu buffer. the mesh generators write plain
+// floats (position, normal, texture coordinates); a format picks a compact
+// type per attribute and tools/meshgen packs the canonical meshes with it at
+// build time. Mesh::setupAttributes turns a format into attribute pointers.
+
+enum VertexComponentType {
+  VERTEX_FLOAT,   // 32-bit float
+  VERTEX_SNORM16, // short read as [-1, 1]
+  VERTEX_UNORM16, // unsigned short read as [0, 1]
+};
+
+enum VertexEncoding {
+  ENCODE_DIRECT,     // the source components as they are
+  ENCODE_OCTAHEDRAL, // a unit vector folded onto two components
+};
+
+struct VertexAttribute {
+  int location;
+  int components; // as stored and read by the shader
+  VertexComponentType type;
+  VertexEncoding encoding;
+  int offset; // bytes into the packed vertex
+  int source; // first float of the attribute in the generator's layout
+};
+
+const int MAX_VERTEX_ATTRIBUTES = 4;
+
+struct VertexFormat {
+  const char *name;
+  int stride;       // bytes per packed vertex, a multiple of 4
+  int sourceFloats; // floats per vertex in the generator's layout
+  int attributeCount;
+  VertexAttribute attributes[MAX_VERTEX_ATTRIBUTES];
+};
+
+// unit spheres: the normal is the position, so both attributes read the
+// same three shorts
+const VertexFormat VERTEX_FORMAT_SPHERE = {
+    "sphere",
+    8,
+    6,
+    2,
+    {{0, 3, VERTEX_SNORM16, ENCODE_DIRECT, 0, 0},
+     {1, 3, VERTEX_SNORM16, ENCODE_DIRECT, 0, 0}}};
+
+// unit ring: direction, constant up normal and the edge/angle coordinates
+const VertexFormat VERTEX_FORMAT_RING = {
+    "ring",
+    16,
+    8,
+    3,
+    {{0, 3, VERTEX_SNORM16, ENCODE_DIRECT, 0, 0},
+     {1, 2, VERTEX_SNORM16, ENCODE_OCTAHEDRAL, 8, 3},
+     {2, 2, VERTEX_UNORM16, ENCODE_DIRECT, 12, 6}}};
+
+// terrain chunks stay float, shorts would step visibly on the finest levels.
+// the position doubles as the normal
+const VertexFormat VERTEX_FORMAT_TERRAIN = {
+    "terrain",
+    12,
+    3,
+    2,
+    {{0, 3, VERTEX_FLOAT, ENCODE_DIRECT, 0, 0},
+     {1, 3, VERTEX_FLOAT, ENCODE_DIRECT, 0, 0}}};
+
+// the generators' own layouts, the baseline of the memory report
+const VertexFormat VERTEX_FORMAT_SPHERE_FLOAT = {
+    "sphere float",
+    24,
+    6,
+    2,
+    {{0, 3, VERTEX_FLOAT, ENCODE_DIRECT, 0, 0},
+     {1, 3, VERTEX_FLOAT, ENCODE_DIRECT, 12, 3}}};
+
+const VertexFormat VERTEX_FORMAT_RING_FLOAT = {
+    "ring float",
+    32,
+    8,
+    3,
+    {{0, 3, VERTEX_FLOAT, ENCODE_DIRECT, 0, 0},
+     {1, 3, VERTEX_FLOAT, ENCODE_DIRECT, 12, 3},
+     {2, 2, VERTEX_FLOAT, ENCODE_DIRECT, 24, 6}}};
+
+// packs vertexCount vertices of format.sourceFloats floats each
+void packVertices(const VertexFormat &format, const float *vertices,
+                  int vertexCount, vector<unsigned char> &out);
+
+// reads one attribute of a packed vertex back into floats in the
+// generator's layout (3 for an octahedral vector)
+void unpackAttribute(const VertexAttribute &attribute,
+                     const unsigned char *vertex, float *out);
+
+#endif
@@ -0,0 +1,48 @@
+#version 330 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in vec4 vInstance[];
+
+out vec4 outInstance; // captured by transform feedback, survivors only
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+uniform float viewportHeight; // pixels
+uniform float minPixelSize;   // projected diameter below which we cull
+uniform float frustumMargin;  // widens the frustum, survivors are drawn next frame
+
+void main()
+{
+    vec3 center = (view * vec4(vInstance[0].xyz, 1.0)).xyz;
+    float radius = vInstance[0].w;
+    float depth = -center.z;
+
+    // near and far planes straight from the perspective matrix
+    float nearPlane = projection[3][2] / (projection[2][2] - 1.0);
+    float farPlane = projection[3][2] / (projection[2][2] + 1.0);
+    if (depth + radius < nearPlane || depth - radius > farPlane)
+        return;
+
+    // sphere against the four side planes, which pass through the eye
+    float tanX = frustumMargin / projection[0][0];
+    float tanY = frustumMargin / projection[1][1];
+    if ((abs(center.x) - depth * tanX) * inversesqrt(1.0 + tanX * tanX) > radius ||
+        (abs(center.y) - depth * tanY) * inversesqrt(1.0 + tanY * tanY) > radius)
+        return;
+
+    // too small to cover a pixel
+    float pixels = 2.0 * radius * projection[1][1] * 0.5 * viewportHeight /
+                   max(depth, nearPlane);
+    if (pixels < minPixelSize)
+        return;
+
+    outInstance = vInstance[0];
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec4 aOrbit; // radius, phase, angular speed, height
+layout (location = 1) in float aSize; // asteroid radius
+
+out vec4 vInstance; // world position + radius
+
+uniform float time; // seconds of simulation
+
+void main()
+{
+    // circular orbit around the sun, evaluated here so the cpu never touches
+    // the per-asteroid data after upload
+    float angle = aOrbit.y + aOrbit.z * time;
+    vec3 position = vec3(aOrbit.x * cos(angle), aOrbit.w, aOrbit.x * sin(angle));
+    vInstance = vec4(position, aSize);
+}
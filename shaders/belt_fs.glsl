@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+flat in float Shade;
+
+uniform vec3 sunPos;
+uniform vec3 rockColor;
+uniform vec3 light_La;
+uniform vec3 light_Ld;
+
+void main()
+{
+    // diffuse only, asteroids are dull
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(sunPos - FragPos);
+    float diffuse = max(dot(norm, lightDir), 0.0);
+
+    vec3 color = rockColor * Shade * (light_La + light_Ld * diffuse);
+    FragColor = vec4(color, 1.0);
+}
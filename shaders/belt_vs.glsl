@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;      // unit rock in object space
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec4 aInstance; // world position + radius, per instance
+
+out vec3 FragPos;
+out vec3 Normal;
+flat out float Shade; // per-asteroid brightness variation
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+void main()
+{
+    // only uniform scale and translation, so the normal needs no matrix
+    FragPos = aInstance.xyz + aPos * aInstance.w;
+    Normal = aNormal;
+    Shade = 0.7 + 0.3 * fract(sin(dot(aInstance.xz, vec2(12.9898, 78.233))) * 43758.5453);
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -7,7 +7,13 @@ in vec3 Normal;
 uniform vec3 objectColor;
 uniform vec3 lightColor;
 uniform vec3 lightPos;
-uniform vec3 viewPos;
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 void main()
 {
@@ -23,7 +29,7 @@ void main()
     
     // specular
     float specularStrength = 0.9;
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     vec3 specular = specularStrength * spec * lightColor;
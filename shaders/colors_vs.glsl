@@ -7,8 +7,12 @@ out vec3 FragPos;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 void main()
 {
@@ -0,0 +1,94 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 RayDir;
+flat in vec3 Center;
+flat in vec3 WorldCenter;
+flat in float Radius;
+flat in float Rotation;
+flat in float Fade;
+flat in float Shininess;
+flat in vec3 Ka;
+flat in vec3 Kd;
+flat in vec3 Ks;
+
+// CUBEMAP: the map was resampled into a cubemap, looked up by direction
+#ifdef CUBEMAP
+uniform samplerCube texture1;
+#else
+uniform sampler2D texture1;
+#endif
+uniform vec3 sunPos;
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+// light intensity components
+uniform vec3 light_La;
+uniform vec3 light_Ld;
+uniform vec3 light_Le;
+
+// 4x4 ordered dither threshold, the mesh path uses the same pattern
+float dither4x4(vec2 pixel)
+{
+    const float pattern[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                        3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    int x = int(mod(pixel.x, 4.0));
+    int y = int(mod(pixel.y, 4.0));
+    return (pattern[y * 4 + x] + 0.5) / 16.0;
+}
+
+void main()
+{
+    // the mesh owns the other part of the pattern while they cross-fade
+    if (dither4x4(gl_FragCoord.xy) >= Fade)
+        discard;
+
+    // nearest hit of the view ray with the sphere, camera at the origin
+    vec3 dir = normalize(RayDir);
+    float b = dot(dir, Center);
+    float h = b * b - dot(Center, Center) + Radius * Radius;
+    if (h < 0.0)
+        discard;
+    vec3 hit = dir * (b - sqrt(h));
+
+    // the view matrix is a rotation and a translation, so its transpose
+    // takes directions back to world space
+    vec3 norm = transpose(mat3(view)) * ((hit - Center) / Radius);
+    vec3 fragPos = WorldCenter + norm * Radius;
+
+    vec4 clip = projection * vec4(hit, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // undo the body's spin for the texture lookup, same mapping as light_fs
+    float c = cos(Rotation);
+    float s = sin(Rotation);
+    vec3 localPos = vec3(c * norm.x - s * norm.z, norm.y, s * norm.x + c * norm.z);
+#ifdef CUBEMAP
+    vec3 texColor = texture(texture1, localPos).rgb;
+#else
+    float u = 0.5 + atan(localPos.z, localPos.x) / (2.0 * 3.14159265359);
+    float v = 0.5 - asin(clamp(localPos.y, -1.0, 1.0)) / 3.14159265359;
+    vec3 texColor = texture(texture1, vec2(u, v)).rgb;
+#endif
+
+    // phong lighting, as in light_fs
+    vec3 lightDir = normalize(sunPos - fragPos);
+    vec3 viewDir = normalize(viewPos.xyz - fragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+
+    float distance = length(sunPos - fragPos);
+    float attenuation = 1.0 + 0.00002 * distance;
+
+    vec3 I_ambient = Ka * light_La;
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 I_diffuse = (Kd * light_Ld * diff) / attenuation;
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), Shininess);
+    vec3 I_specular = (Ks * light_Le * spec) / attenuation;
+
+    FragColor = vec4((I_ambient + I_diffuse + I_specular) * texColor, 1.0);
+}
@@ -0,0 +1,54 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;  // quad corner, -1..1
+layout (location = 1) in vec4 aSphere;  // world center, radius
+layout (location = 2) in vec4 aParams;  // rotation, fade, shininess, unused
+layout (location = 3) in vec3 aKa;
+layout (location = 4) in vec3 aKd;
+layout (location = 5) in vec3 aKs;
+
+out vec3 RayDir;             // camera space, through this point of the quad
+flat out vec3 Center;        // camera space
+flat out vec3 WorldCenter;
+flat out float Radius;
+flat out float Rotation;
+flat out float Fade;
+flat out float Shininess;
+flat out vec3 Ka;
+flat out vec3 Kd;
+flat out vec3 Ks;
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+void main()
+{
+    vec3 center = vec3(view * vec4(aSphere.xyz, 1.0));
+    float radius = aSphere.w;
+    float dist = length(center);
+
+    // a quad facing the camera through the center, just large enough for the
+    // sphere's silhouette cone
+    vec3 forward = center / dist;
+    vec3 helper = abs(forward.y) > 0.999 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(forward, helper));
+    vec3 up = cross(right, forward);
+    float extent = radius * dist / sqrt(max(dist * dist - radius * radius, 1e-6));
+    vec3 position = center + (right * aCorner.x + up * aCorner.y) * extent;
+
+    RayDir = position;
+    Center = center;
+    WorldCenter = aSphere.xyz;
+    Radius = radius;
+    Rotation = aParams.x;
+    Fade = aParams.y;
+    Shininess = aParams.z;
+    Ka = aKa;
+    Kd = aKd;
+    Ks = aKs;
+
+    gl_Position = projection * vec4(position, 1.0);
+}
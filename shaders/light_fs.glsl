@@ -5,11 +5,22 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec3 LocalPos;
 
+// CUBEMAP: the map was resampled into a cubemap, looked up by direction
+#ifdef CUBEMAP
+uniform samplerCube texture1;
+#else
 uniform sampler2D texture1;
+#endif
 
 // sun position
 uniform vec3 sunPos;
-uniform vec3 viewPos;
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 // material reflection coefficients
 uniform vec3 material_Ka;
@@ -22,19 +33,40 @@ uniform vec3 light_La;
 uniform vec3 light_Ld;
 uniform vec3 light_Le;
 
+// share of the mesh handed to the impostor while they cross-fade, 0 draws
+// the mesh fully
+uniform float ditherOut;
+
+// 4x4 ordered dither threshold, the impostor path uses the same pattern
+float dither4x4(vec2 pixel)
+{
+    const float pattern[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                        3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    int x = int(mod(pixel.x, 4.0));
+    int y = int(mod(pixel.y, 4.0));
+    return (pattern[y * 4 + x] + 0.5) / 16.0;
+}
+
 void main()
 {
+    if (dither4x4(gl_FragCoord.xy) < ditherOut)
+        discard;
+
     // spherical texture mapping
     vec3 normalizedPos = normalize(LocalPos);
+#ifdef CUBEMAP
+    vec3 texColor = texture(texture1, normalizedPos).rgb;
+#else
     float u = 0.5 + atan(normalizedPos.z, normalizedPos.x) / (2.0 * 3.14159265359);
     float v = 0.5 - asin(normalizedPos.y) / 3.14159265359;
     vec2 texCoords = vec2(u, v);
     vec3 texColor = texture(texture1, texCoords).rgb;
+#endif
     
     // phong lighting model
     vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(sunPos - FragPos);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
     
     // distance attenuation (adjusted for astronomical distances)
@@ -7,8 +7,12 @@ out vec3 Normal;   // normal in world space
 out vec3 LocalPos; // original position in object space (for texture mapping)
 
 uniform mat4 model;      // object space -> world space
-uniform mat4 view;       // world space -> camera space
-uniform mat4 projection; // camera space -> clip space
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 void main()
 {
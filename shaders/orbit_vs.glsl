@@ -2,8 +2,12 @@
 layout (location = 0) in vec3 aPos;  // circle points in object space
 
 uniform mat4 model;      // positions the orbit circle in world space
-uniform mat4 view;       // view from camera
-uniform mat4 projection; // perspective
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 void main()
 {
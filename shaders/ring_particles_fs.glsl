@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 Corner;
+flat in vec3 Color;
+flat in vec3 LightDir;
+
+uniform vec3 light_La;
+uniform vec3 light_Ld;
+
+void main()
+{
+    // round particle, lit as if it were a small sphere facing the camera
+    float r2 = dot(Corner, Corner);
+    if (r2 > 1.0)
+        discard;
+
+    vec3 normal = vec3(Corner, sqrt(1.0 - r2));
+    float diffuse = max(dot(normal, LightDir), 0.0);
+    FragColor = vec4(Color * (light_La + light_Ld * diffuse), 1.0);
+}
@@ -0,0 +1,54 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner; // quad corner, -1..1
+layout (location = 1) in vec4 aOrbit;  // radius, phase, angular speed, height
+layout (location = 2) in float aSize;  // world units, per instance
+
+out vec2 Corner;
+flat out vec3 Color;
+flat out vec3 LightDir; // to the sun, camera space
+
+uniform mat4 model; // ring placement and tilt
+uniform float time;
+uniform float innerRadius;
+uniform float outerRadius;
+uniform float viewportHeight;
+uniform float minPixelSize;
+uniform vec3 sunPos;
+uniform sampler2D texture1; // the annulus texture, u runs inner to outer
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+void main()
+{
+    // the texture alpha is the ring's opacity at this radius, keep that share
+    // of the particles there. the rest collapse to a point and are never
+    // rasterized
+    float u = (aOrbit.x - innerRadius) / (outerRadius - innerRadius);
+    vec4 ringColor = textureLod(texture1, vec2(u, 0.5), 0.0);
+    float keep = fract(sin(aOrbit.y * 12.9898 + aOrbit.x * 78.233) * 43758.5453);
+    if (keep >= ringColor.a) {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
+
+    float angle = aOrbit.y + aOrbit.z * time;
+    vec3 local = vec3(aOrbit.x * cos(angle), aOrbit.w, aOrbit.x * sin(angle));
+    vec4 world = model * vec4(local, 1.0);
+    vec4 eye = view * world;
+
+    // particles below a pixel would flicker in and out, so grow them to
+    // minPixelSize across
+    float pixels = aSize * projection[1][1] * viewportHeight / max(-eye.z, 1e-3);
+    float size = aSize * max(1.0, minPixelSize / max(pixels, 1e-6));
+    eye.xy += aCorner * size;
+
+    Corner = aCorner;
+    Color = ringColor.rgb;
+    LightDir = normalize(mat3(view) * (sunPos - world.xyz));
+    gl_Position = projection * eye;
+}
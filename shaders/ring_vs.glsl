@@ -1,16 +1,24 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec2 aNormal; // octahedral, the ring is unlit
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform float innerRadius;
+uniform float outerRadius;
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    // the shared mesh has unit radii, u picks the inner or the outer edge
+    vec3 position = aPos * mix(innerRadius, outerRadius, aTexCoords.x);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in vec3 Color;
+
+void main()
+{
+    // gaussian point spread, added onto the sky
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(offset, offset);
+    if (r2 > 1.0)
+        discard;
+
+    FragColor = vec4(Color * exp(-4.0 * r2), 1.0);
+}
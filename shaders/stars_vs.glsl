@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) in vec3 aDirection; // unit vector towards the star
+layout (location = 1) in float aMagnitude; // thousandths of a magnitude
+layout (location = 2) in vec3 aColor;
+
+flat out vec3 Color; // premultiplied by the star's brightness
+
+uniform float magnitudeLimit;  // faintest star drawn
+uniform float limitBrightness; // brightness of a star at the limit
+uniform float minSize;         // pixels
+uniform float maxSize;
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+void main()
+{
+    // rotation only, the stars are infinitely far away. z = w puts them on
+    // the far plane whatever the near and far distances are
+    vec4 clip = projection * vec4(mat3(view) * aDirection, 1.0);
+    gl_Position = clip.xyww;
+
+    // every magnitude is 2.512 times fainter. faint stars keep the minimum
+    // size and dim instead, bright ones grow with the square root of their
+    // flux so they read as brighter without turning into discs
+    float magnitude = aMagnitude * 0.001;
+    float brightness =
+        limitBrightness * pow(10.0, 0.4 * (magnitudeLimit - magnitude));
+    gl_PointSize = clamp(minSize * sqrt(brightness / limitBrightness) * 0.5,
+                         minSize, maxSize);
+    Color = aColor * min(brightness, 1.0);
+}
@@ -4,15 +4,24 @@ out vec4 FragColor;
 in vec3 FragPos;
 in vec3 Normal;
 
+// CUBEMAP: the map was resampled into a cubemap, looked up by direction
+#ifdef CUBEMAP
+uniform samplerCube texture1;
+#else
 uniform sampler2D texture1;
+#endif
 
 void main()
 {
     vec3 normalizedPos = normalize(FragPos);
     
+#ifdef CUBEMAP
+    FragColor = texture(texture1, normalizedPos);
+#else
     float u = 0.5 + atan(normalizedPos.z, normalizedPos.x) / (2.0 * 3.14159265359);
     float v = 0.5 - asin(normalizedPos.y) / 3.14159265359;
     
     vec2 texCoords = vec2(u, v);
     FragColor = texture(texture1, texCoords);
+#endif
 }
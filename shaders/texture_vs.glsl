@@ -6,8 +6,12 @@ out vec3 FragPos;  // world space position
 out vec3 Normal;   // world space normal
 
 uniform mat4 model;      // object -> world
-uniform mat4 view;       // world -> camera
-uniform mat4 projection; // camera -> clip
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
 
 void main()
 {
@@ -17,4 +21,9 @@ void main()
     
     // final transformation through all spaces
     gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef SKY
+    // z = w puts the sky on the far plane, where GL_LEQUAL lets it fill only
+    // the pixels nothing was drawn to
+    gl_Position = gl_Position.xyww;
+#endif
 }
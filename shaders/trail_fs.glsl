@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in float Alpha;
+flat in vec3 Color;
+flat in int Seam;
+
+void main()
+{
+    if (Seam != 0)
+        discard;
+    FragColor = vec4(Color, Alpha);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+layout (location = 0) in vec3 aPos; // world position of one trail sample
+
+out float Alpha;
+flat out vec3 Color;
+flat out int Seam; // from the provoking (second) vertex of each line
+
+// per-frame camera, written once per frame just before the draws
+layout (std140) uniform FrameData {
+    mat4 view;       // world space -> camera space
+    mat4 projection; // camera space -> clip space
+    vec4 viewPos;    // camera position in world space
+};
+
+uniform int trailStride; // trails per row of the sample ring
+uniform int sampleCount; // rows in the ring
+uniform int head;        // row with the newest sample
+uniform samplerBuffer trailColors;
+
+void main()
+{
+    // vertex ids are sample-major: row * stride + trail
+    int row = gl_VertexID / trailStride;
+    int trail = gl_VertexID - row * trailStride;
+    int age = (head - row + sampleCount) % sampleCount;
+
+    // the line from the newest sample to the oldest closes the ring, its
+    // second vertex is the only one with the maximum age
+    Seam = age == sampleCount - 1 ? 1 : 0;
+    Alpha = 1.0 - float(age) / float(sampleCount - 1);
+    Color = texelFetch(trailColors, trail).rgb;
+
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
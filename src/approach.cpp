@@ -0,0 +1,303 @@
+#include "approach.h"
+#include "clock.h"
+#include "memory.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// bodies spanning more cells than this on any axis are tested brute force
+static const int MAX_CELL_SPAN = 4;
+
+// floor for cell coordinates, without the libm call
+static inline int floorToInt(float value) {
+  int i = (int)value;
+  return i - (value < (float)i);
+}
+
+static uint64_t pairKey(int a, int b) { return (uint64_t)a << 32 | (uint32_t)b; }
+
+ApproachDetector::ApproachDetector(unsigned int threads, float approachMargin,
+                                   float timeBudgetSeconds)
+    : pool(threads), margin(approachMargin), cellSize(0.0f),
+      timeBudget(timeBudgetSeconds), bucketMask(0), stepCellSize(1.0f),
+      entryCount(0), candidatePairs(0), approachCount(0), lastTime(0.0) {
+  found.resize(pool.maxTasks());
+}
+
+ApproachDetector::~ApproachDetector() { MemoryTracker::releaseCpu(this); }
+
+// full 32 bit hash of a cell, the low bits pick its bucket
+static uint32_t cellHash(int x, int y, int z) {
+  return (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^
+         (uint32_t)z * 83492791u;
+}
+
+int ApproachDetector::detect(const vector<vec3> &positions,
+                             const vector<float> &radii) {
+  double start = now();
+  int n = (int)positions.size();
+  int taskCount = (int)found.size();
+  for (auto &list : found)
+    list.clear();
+
+  // cell size: a few times the typical padded diameter. smaller cells mean
+  // fewer candidates per bucket but more cells per body; at 4x the average
+  // body touches about two cells
+  stepCellSize = cellSize;
+  if (stepCellSize <= 0.0f) {
+    vector<double> sums(taskCount, 0.0);
+    pool.parallelFor(n, 1, [&](int task, int begin, int end) {
+      double sum = 0.0;
+      for (int i = begin; i < end; ++i)
+        sum += radii[i];
+      sums[task] = sum;
+    });
+    double total = 0.0;
+    for (double sum : sums)
+      total += sum;
+    float meanRadius = n > 0 ? (float)(total / n) : 0.0f;
+    stepCellSize = max(4.0f * (2.0f * meanRadius + margin), 1e-6f);
+  }
+
+  // buckets for about two entries each, fixed before the entries are counted
+  uint32_t bucketCount = 1024;
+  while (bucketCount < 2u * (uint32_t)n && bucketCount < (1u << 31))
+    bucketCount <<= 1;
+  bucketMask = bucketCount - 1;
+
+  // the bucket range is split into one partition per task
+  int partitions = taskCount;
+  uint64_t partitionWidth = ((uint64_t)bucketCount + partitions - 1) / partitions;
+
+  // pass 1: cell bounds, grid or large, entries per chunk and partition
+  bounds.resize(n);
+  vector<vector<int>> largeByTask(taskCount);
+  vector<uint32_t> histogram((size_t)taskCount * partitions, 0);
+  float invCell = 1.0f / stepCellSize;
+  float pad = margin * 0.5f;
+
+  pool.parallelFor(n, 1, [&](int task, int begin, int end) {
+    uint32_t *counts = &histogram[(size_t)task * partitions];
+    for (int i = begin; i < end; ++i) {
+      float extent = radii[i] + pad;
+      vec3 lo = (positions[i] - vec3(extent)) * invCell;
+      vec3 hi = (positions[i] + vec3(extent)) * invCell;
+      Bounds &b = bounds[i];
+      b.minCell = ivec3(floorToInt(lo.x), floorToInt(lo.y), floorToInt(lo.z));
+      b.maxCell = ivec3(floorToInt(hi.x), floorToInt(hi.y), floorToInt(hi.z));
+
+      ivec3 span = b.maxCell - b.minCell;
+      if (span.x >= MAX_CELL_SPAN || span.y >= MAX_CELL_SPAN ||
+          span.z >= MAX_CELL_SPAN) {
+        largeByTask[task].push_back(i);
+        continue;
+      }
+
+      for (int z = b.minCell.z; z <= b.maxCell.z; ++z)
+        for (int y = b.minCell.y; y <= b.maxCell.y; ++y)
+          for (int x = b.minCell.x; x <= b.maxCell.x; ++x)
+            counts[(cellHash(x, y, z) & bucketMask) / partitionWidth]++;
+    }
+  });
+
+  large.clear();
+  for (const auto &list : largeByTask)
+    large.insert(large.end(), list.begin(), list.end());
+
+  // partition-major offsets, so every partition is one contiguous range
+  vector<uint64_t> partitionStart(partitions + 1, 0);
+  vector<uint64_t> offsets(histogram.size());
+  uint64_t total = 0;
+  for (int p = 0; p < partitions; ++p) {
+    partitionStart[p] = total;
+    for (int t = 0; t < taskCount; ++t) {
+      offsets[(size_t)t * partitions + p] = total;
+      total += histogram[(size_t)t * partitions + p];
+    }
+  }
+  partitionStart[partitions] = total;
+  entryCount = total;
+
+  // pass 2: scatter the entries into their partitions. same chunking as
+  // pass 1, so every task fills exactly the ranges it counted
+  entries.resize(total);
+  pool.parallelFor(n, 1, [&](int task, int begin, int end) {
+    uint64_t *next = &offsets[(size_t)task * partitions];
+    for (int i = begin; i < end; ++i) {
+      const Bounds &b = bounds[i];
+      ivec3 span = b.maxCell - b.minCell;
+      if (span.x >= MAX_CELL_SPAN || span.y >= MAX_CELL_SPAN ||
+          span.z >= MAX_CELL_SPAN)
+        continue;
+
+      for (int z = b.minCell.z; z <= b.maxCell.z; ++z)
+        for (int y = b.minCell.y; y <= b.maxCell.y; ++y)
+          for (int x = b.minCell.x; x <= b.maxCell.x; ++x) {
+            uint32_t hash = cellHash(x, y, z);
+            entries[next[(hash & bucketMask) / partitionWidth]++] =
+                (uint64_t)hash << 32 | (uint32_t)i;
+          }
+    }
+  });
+
+  float reach = margin;
+  auto narrow = [&](int a, int b, vector<ApproachEvent> &out) {
+    float distance =
+        length(positions[a] - positions[b]) - radii[a] - radii[b];
+    if (distance < reach) {
+      ApproachEvent event = {min(a, b), max(a, b), distance, distance < 0.0f};
+      out.push_back(event);
+    }
+  };
+
+  // pass 3: counting sort of each partition by bucket, then test the pairs
+  // that share a cell within every bucket
+  bucketStart.resize((size_t)bucketCount + 1);
+  cellBodies.resize(total);
+  bucketStart[bucketCount] = (uint32_t)total;
+  vector<size_t> tested(taskCount, 0);
+  pool.parallelFor(partitions, 1, [&](int task, int begin, int end) {
+    vector<ApproachEvent> &out = found[task];
+    for (int p = begin; p < end; ++p) {
+      uint32_t firstBucket = (uint32_t)min((uint64_t)p * partitionWidth,
+                                           (uint64_t)bucketCount);
+      uint32_t lastBucket = (uint32_t)min((uint64_t)(p + 1) * partitionWidth,
+                                          (uint64_t)bucketCount);
+      uint64_t first = partitionStart[p];
+      uint64_t last = partitionStart[p + 1];
+
+      uint32_t *starts = &bucketStart[firstBucket];
+      fill(starts, starts + (lastBucket - firstBucket), 0u);
+      for (uint64_t e = first; e < last; ++e)
+        starts[((uint32_t)(entries[e] >> 32) & bucketMask) - firstBucket]++;
+      uint32_t offset = (uint32_t)first;
+      for (uint32_t k = 0; k < lastBucket - firstBucket; ++k) {
+        uint32_t count = starts[k];
+        starts[k] = offset;
+        offset += count;
+      }
+      // scatter with a moving cursor per bucket, then shift the starts back
+      for (uint64_t e = first; e < last; ++e) {
+        uint32_t k = ((uint32_t)(entries[e] >> 32) & bucketMask) - firstBucket;
+        cellBodies[starts[k]++] = entries[e];
+      }
+      for (uint32_t k = lastBucket - firstBucket; k-- > 1;)
+        starts[k] = starts[k - 1];
+      if (lastBucket > firstBucket)
+        starts[0] = (uint32_t)first;
+
+      for (uint32_t bucket = firstBucket; bucket < lastBucket; ++bucket) {
+        // the next partition's first start may not be written yet
+        uint64_t runEndIndex =
+            bucket + 1 < lastBucket ? bucketStart[bucket + 1] : last;
+        const uint64_t *run = cellBodies.data() + bucketStart[bucket];
+        const uint64_t *runEnd = cellBodies.data() + runEndIndex;
+
+        for (const uint64_t *i = run; i < runEnd; ++i) {
+          uint32_t hash = (uint32_t)(*i >> 32);
+          int a = (int)(uint32_t)*i;
+
+          for (const uint64_t *j = i + 1; j < runEnd; ++j) {
+            // another cell in the same bucket, rejected without touching
+            // the bounds
+            if ((uint32_t)(*j >> 32) != hash)
+              continue;
+            int b = (int)(uint32_t)*j;
+            if (b == a)
+              continue; // two cells of one body with the same full hash
+            const Bounds &ba = bounds[a];
+            const Bounds &bb = bounds[b];
+
+            // cells shared by both, empty for a hash collision
+            ivec3 lo(max(ba.minCell.x, bb.minCell.x),
+                     max(ba.minCell.y, bb.minCell.y),
+                     max(ba.minCell.z, bb.minCell.z));
+            if (lo.x > min(ba.maxCell.x, bb.maxCell.x) ||
+                lo.y > min(ba.maxCell.y, bb.maxCell.y) ||
+                lo.z > min(ba.maxCell.z, bb.maxCell.z))
+              continue;
+            // only the first shared cell tests the pair
+            if (cellHash(lo.x, lo.y, lo.z) != hash)
+              continue;
+
+            tested[task]++;
+            narrow(a, b, out);
+          }
+        }
+      }
+    }
+  });
+
+  // large bodies against everything, each pair of large bodies once
+  if (!large.empty()) {
+    vector<char> isLarge(n, 0);
+    for (int l : large)
+      isLarge[l] = 1;
+
+    pool.parallelFor(n, 1, [&](int task, int begin, int end) {
+      vector<ApproachEvent> &out = found[task];
+      for (int l : large) {
+        for (int j = begin; j < end; ++j) {
+          if (j == l || (isLarge[j] && j < l))
+            continue;
+          tested[task]++;
+          narrow(l, j, out);
+        }
+      }
+    });
+  }
+
+  candidatePairs = 0;
+  for (size_t count : tested)
+    candidatePairs += count;
+
+  // publish the pairs that weren't approaching last step
+  vector<ApproachEvent> events;
+  for (const auto &list : found)
+    events.insert(events.end(), list.begin(), list.end());
+  sort(events.begin(), events.end(),
+       [](const ApproachEvent &x, const ApproachEvent &y) {
+         return pairKey(x.a, x.b) < pairKey(y.a, y.b);
+       });
+
+  current.clear();
+  vector<ApproachEvent> started;
+  for (const ApproachEvent &event : events) {
+    uint64_t key = pairKey(event.a, event.b);
+    current.push_back(key);
+    if (!binary_search(active.begin(), active.end(), key))
+      started.push_back(event);
+  }
+  active.swap(current);
+  approachCount = active.size();
+
+  lastTime = now() - start;
+
+  // the scratch only grows, so this settles after the first steps
+  MemoryTracker::trackCpu(
+      this, MEMORY_CPU_SCENE,
+      bounds.capacity() * sizeof(Bounds) + large.capacity() * sizeof(int) +
+          (entries.capacity() + cellBodies.capacity() + active.capacity() +
+           current.capacity()) *
+              sizeof(uint64_t) +
+          bucketStart.capacity() * sizeof(uint32_t));
+
+  if (!started.empty()) {
+    if (callback) {
+      for (const ApproachEvent &event : started)
+        callback(event);
+    }
+    lock_guard<mutex> lock(queueMutex);
+    queue.insert(queue.end(), started.begin(), started.end());
+  }
+
+  return (int)approachCount;
+}
+
+void ApproachDetector::takeEvents(vector<ApproachEvent> &events) {
+  lock_guard<mutex> lock(queueMutex);
+  events.insert(events.end(), queue.begin(), queue.end());
+  queue.clear();
+}
@@ -0,0 +1,89 @@
+#include "arena.h"
+#include "memory.h"
+#include <algorithm>
+
+using namespace std;
+
+Arena::Arena(size_t blockBytes)
+    : cleanups(nullptr), blockSize(blockBytes), usedBytes(0), peakBytes(0),
+      allocations(0) {}
+
+Arena::~Arena() {
+  reset();
+  for (Block &block : blocks)
+    delete[] block.data;
+  MemoryTracker::releaseCpu(this);
+}
+
+void Arena::addBlock(size_t minimum) {
+  Block block;
+  block.size = max(blockSize, minimum);
+  block.data = new char[block.size];
+  block.used = 0;
+  blocks.push_back(block);
+  trackMemory();
+}
+
+void Arena::trackMemory() const {
+  MemoryTracker::trackCpu(this, MEMORY_CPU_SCENE, getReservedBytes());
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  if (align == 0)
+    align = alignof(max_align_t);
+
+  // only the newest block is filled. a fresh one starts at offset 0, which
+  // new char[] aligns for any scalar type
+  size_t offset = 0;
+  if (!blocks.empty()) {
+    Block &last = blocks.back();
+    offset = (last.used + align - 1) / align * align;
+  }
+  if (blocks.empty() || offset + size > blocks.back().size) {
+    addBlock(size);
+    offset = 0;
+  }
+
+  Block &block = blocks.back();
+  usedBytes += offset + size - block.used;
+  block.used = offset + size;
+  peakBytes = max(peakBytes, usedBytes);
+  ++allocations;
+  return block.data + offset;
+}
+
+size_t *Arena::onReset(void (*destroy)(void *, size_t), void *objects) {
+  Cleanup *cleanup = new (allocate(sizeof(Cleanup), alignof(Cleanup)))
+      Cleanup();
+  cleanup->destroy = destroy;
+  cleanup->objects = objects;
+  cleanup->count = 0;
+  cleanup->next = cleanups;
+  cleanups = cleanup;
+  // bookkeeping, not an allocation of the caller
+  --allocations;
+  return &cleanup->count;
+}
+
+void Arena::reset() {
+  for (Cleanup *cleanup = cleanups; cleanup; cleanup = cleanup->next)
+    cleanup->destroy(cleanup->objects, cleanup->count);
+  cleanups = nullptr;
+
+  if (!blocks.empty()) {
+    for (size_t i = 1; i < blocks.size(); ++i)
+      delete[] blocks[i].data;
+    blocks.resize(1);
+    blocks[0].used = 0;
+    trackMemory();
+  }
+  usedBytes = 0;
+  allocations = 0;
+}
+
+size_t Arena::getReservedBytes() const {
+  size_t total = 0;
+  for (const Block &block : blocks)
+    total += block.size;
+  return total;
+}
@@ -0,0 +1,157 @@
+#include "belt.h"
+#include "body.h"
+#include "gl_state.h"
+#include "memory.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+#define PI 3.14159265358979323846
+
+using namespace std;
+using namespace glm;
+
+AsteroidBelt::AsteroidBelt(int count, float innerAu, float outerAu,
+                           float thicknessAu, float minSize, float maxSize,
+                           float unitsPerAu, float degreesPerSecond)
+    : asteroidCount(count), mesh(Mesh::acquireSphere(0)), current(0),
+      drawnCount(0) {
+  createInstances(innerAu, outerAu, thicknessAu, minSize, maxSize, unitsPerAu,
+                  degreesPerSecond);
+
+  // survivors are at most every asteroid, 16 bytes each
+  glGenBuffers(BUFFERS, feedbackBuffers);
+  glGenVertexArrays(BUFFERS, drawVAOs);
+  glGenQueries(BUFFERS, queries);
+
+  for (int i = 0; i < BUFFERS; ++i) {
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackBuffers[i]);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, asteroidCount * sizeof(vec4),
+                 NULL, GL_DYNAMIC_COPY);
+    MemoryTracker::trackBuffer(feedbackBuffers[i], MEMORY_INSTANCES,
+                               asteroidCount * sizeof(vec4));
+
+    GLState::bindVertexArray(drawVAOs[i]);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->IBO);
+
+    // vertex position and normal
+    Mesh::setupAttributes(*mesh->format);
+
+    // per instance: world position + radius written by the cull pass
+    glBindBuffer(GL_ARRAY_BUFFER, feedbackBuffers[i]);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vec4), (void *)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    GLState::bindVertexArray(0);
+
+    queryPending[i] = false;
+    visible[i] = 0;
+  }
+
+  glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+AsteroidBelt::~AsteroidBelt() {
+  glDeleteQueries(BUFFERS, queries);
+  GLState::deleteVertexArrays(BUFFERS, drawVAOs);
+  glDeleteBuffers(BUFFERS, feedbackBuffers);
+  GLState::deleteVertexArrays(1, &cullVAO);
+  glDeleteBuffers(1, &instanceVBO);
+  for (int i = 0; i < BUFFERS; ++i)
+    MemoryTracker::releaseBuffer(feedbackBuffers[i]);
+  MemoryTracker::releaseBuffer(instanceVBO);
+  Mesh::release(mesh);
+}
+
+void AsteroidBelt::createInstances(float innerAu, float outerAu,
+                                   float thicknessAu, float minSize,
+                                   float maxSize, float unitsPerAu,
+                                   float degreesPerSecond) {
+  struct Instance {
+    vec4 orbit; // radius, phase, angular speed (rad/s), height
+    float size;
+  };
+
+  mt19937 rng(1801); // fixed seed, the belt looks the same every run
+  uniform_real_distribution<float> unit(0.0f, 1.0f);
+  normal_distribution<float> height(0.0f, thicknessAu * 0.5f);
+
+  vector<Instance> instances(asteroidCount);
+  for (auto &instance : instances) {
+    float au = innerAu + (outerAu - innerAu) * unit(rng);
+    // kepler's third law: angular speed falls off with a^1.5
+    float speed = degreesPerSecond / pow(au, 1.5f) * (float)PI / 180.0f;
+    instance.orbit = vec4(au * unitsPerAu, unit(rng) * 2.0f * (float)PI,
+                          speed, height(rng) * unitsPerAu);
+    // many small rocks, few large ones
+    float t = unit(rng);
+    instance.size = minSize + (maxSize - minSize) * t * t * t;
+  }
+
+  glGenVertexArrays(1, &cullVAO);
+  glGenBuffers(1, &instanceVBO);
+
+  GLState::bindVertexArray(cullVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance),
+               instances.data(), GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(instanceVBO, MEMORY_INSTANCES,
+                             instances.size() * sizeof(Instance));
+
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)sizeof(vec4));
+  glEnableVertexAttribArray(1);
+
+  GLState::bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void AsteroidBelt::render(Shader &cullShader, Shader &drawShader, float time,
+                          float viewportHeight, float minPixelSize,
+                          float frustumMargin) {
+  int previous = (current + BUFFERS - 1) % BUFFERS;
+
+  // the previous pass ran a frame ago, so this rarely has to wait
+  if (queryPending[previous]) {
+    glGetQueryObjectuiv(queries[previous], GL_QUERY_RESULT, &visible[previous]);
+    queryPending[previous] = false;
+  }
+
+  // cull pass: one point per asteroid in, survivors out, nothing rasterized
+  cullShader.use();
+  cullShader.setFloat("time", time);
+  cullShader.setFloat("viewportHeight", viewportHeight);
+  cullShader.setFloat("minPixelSize", minPixelSize);
+  cullShader.setFloat("frustumMargin", frustumMargin);
+
+  GLState::setCapability(GL_RASTERIZER_DISCARD, true);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackBuffers[current]);
+  glBeginQuery(GL_PRIMITIVES_GENERATED, queries[current]);
+  glBeginTransformFeedback(GL_POINTS);
+
+  GLState::bindVertexArray(cullVAO);
+  glDrawArrays(GL_POINTS, 0, asteroidCount);
+
+  glEndTransformFeedback();
+  glEndQuery(GL_PRIMITIVES_GENERATED);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  GLState::setCapability(GL_RASTERIZER_DISCARD, false);
+  queryPending[current] = true;
+
+  // draw pass over last frame's survivors
+  drawnCount = visible[previous];
+  if (drawnCount > 0) {
+    drawShader.use();
+    GLState::bindVertexArray(drawVAOs[previous]);
+    glDrawElementsInstanced(GL_TRIANGLES, mesh->indexCount, Mesh::INDEX_TYPE,
+                            0, drawnCount);
+  }
+
+  current = (current + 1) % BUFFERS;
+}
@@ -3,8 +3,6 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define PI 3.14159265358979323846
-
 using namespace std;
 using namespace glm;
 
@@ -12,26 +10,34 @@ CelestialBody::CelestialBody(float rad, const char *texturePath)
     : position(0.0f), radius(rad), rotationAngle(0.0f), rotationSpeed(0.0f),
       orbitRadius(0.0f), orbitSpeed(0.0f), orbitAngle(0.0f), parent(nullptr),
       materialKa(0.3f, 0.3f, 0.3f), materialKd(0.8f, 0.8f, 0.8f),
-      materialKs(0.5f, 0.5f, 0.5f), materialShininess(32.0f) {
+      materialKs(0.5f, 0.5f, 0.5f), materialShininess(32.0f),
+      mesh(Mesh::acquireSphere(MESH_LOD)), ownsTexture(true) {
 
   texture = new Texture(texturePath);
+}
 
-  int vertexCount;
-  Vertex *vertices =
-      createSphereVertices(vec3(0.0f), radius, STACKS, SECTORS, vertexCount);
-  unsigned int *indices = createSphereIndices(STACKS, SECTORS, indexCount);
-
-  setupMesh(vertices, vertexCount, indices, indexCount);
+// the texture is owned by whoever loaded it, e.g. the texture streamer
+CelestialBody::CelestialBody(float rad, Texture *sharedTexture)
+    : position(0.0f), radius(rad), rotationAngle(0.0f), rotationSpeed(0.0f),
+      orbitRadius(0.0f), orbitSpeed(0.0f), orbitAngle(0.0f), parent(nullptr),
+      materialKa(0.3f, 0.3f, 0.3f), materialKd(0.8f, 0.8f, 0.8f),
+      materialKs(0.5f, 0.5f, 0.5f), materialShininess(32.0f),
+      mesh(Mesh::acquireSphere(MESH_LOD)), texture(sharedTexture),
+      ownsTexture(false) {}
 
-  delete[] vertices;
-  delete[] indices;
-}
+// simulation only: no GL objects are created, so this works without a
+// context (benchmarks, tools)
+CelestialBody::CelestialBody(float rad)
+    : position(0.0f), radius(rad), rotationAngle(0.0f), rotationSpeed(0.0f),
+      orbitRadius(0.0f), orbitSpeed(0.0f), orbitAngle(0.0f), parent(nullptr),
+      materialKa(0.3f, 0.3f, 0.3f), materialKd(0.8f, 0.8f, 0.8f),
+      materialKs(0.5f, 0.5f, 0.5f), materialShininess(32.0f), mesh(nullptr),
+      texture(nullptr), ownsTexture(false) {}
 
 CelestialBody::~CelestialBody() {
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &IBO);
-  delete texture;
+  Mesh::release(mesh);
+  if (ownsTexture)
+    delete texture;
 }
 
 void CelestialBody::setOrbit(float orbRadius, float orbSpeed) {
@@ -63,37 +69,62 @@ void CelestialBody::update(float deltaTime) {
     orbitAngle += orbitSpeed * deltaTime;
     if (orbitAngle > 360.0f)
       orbitAngle -= 360.0f;
+    placeOnOrbit();
+  }
+}
 
-    vec3 orbitOffset;
-    orbitOffset.x = orbitRadius * cos(radians(orbitAngle));
-    orbitOffset.y = 0.0f;
-    orbitOffset.z = orbitRadius * sin(radians(orbitAngle));
+// the angles update() reaches from zero after `time` seconds, taken modulo a
+// turn in double so long times do not lose the fraction of the angle
+void CelestialBody::evaluate(double time) {
+  rotationAngle = (float)fmod(rotationSpeed * time, 360.0);
+  if (orbitRadius > 0.0f) {
+    orbitAngle = (float)fmod(orbitSpeed * time, 360.0);
+    placeOnOrbit();
+  }
+}
 
-    if (parent) {
-      position = parent->getPosition() + orbitOffset;
-    } else {
-      position = orbitOffset;
-    }
+void CelestialBody::placeOnOrbit() {
+  vec3 orbitOffset;
+  orbitOffset.x = orbitRadius * cos(radians(orbitAngle));
+  orbitOffset.y = 0.0f;
+  orbitOffset.z = orbitRadius * sin(radians(orbitAngle));
+
+  if (parent) {
+    position = parent->getPosition() + orbitOffset;
+  } else {
+    position = orbitOffset;
   }
 }
 
-void CelestialBody::render(Shader &shader, const mat4 &view,
-                           const mat4 &projection) {
+float CelestialBody::getScreenSize(const vec3 &eye, float fovY,
+                                  float viewportHeight) const {
+  float dist = length(position - eye);
+  if (dist <= radius)
+    return viewportHeight; // camera inside the body, it fills the view
 
-  shader.use();
+  // angular radius of the sphere projected onto the viewport
+  float angularRadius = asin(radius / dist);
+  return tan(angularRadius) / tan(fovY * 0.5f) * viewportHeight;
+}
 
+mat4 CelestialBody::getModelMatrix() const {
   // model matrix: transforms from object space to world space
   // this positions and rotates each planet/moon in the solar system
   mat4 model = mat4(1.0f);
   model = translate(model, position); // move to position in the world
   model = rotate(model, radians(rotationAngle),
                  vec3(0.0f, 1.0f, 0.0f)); // spin the planet
+  model = scale(model, vec3(radius)); // the shared mesh is a unit sphere
+  return model;
+}
+
+void CelestialBody::render(Shader &shader) {
 
-  // send all transformation matrices to the shader
+  shader.use();
+
+  // view and projection are already in the FrameData block
   // vertices will go: object space -> world space -> camera space -> clip space
-  shader.setMat4("model", model);
-  shader.setMat4("view", view);
-  shader.setMat4("projection", projection);
+  shader.setMat4("model", getModelMatrix());
 
   shader.setVec3("material_Ka", materialKa);
   shader.setVec3("material_Kd", materialKd);
@@ -103,105 +134,5 @@ void CelestialBody::render(Shader &shader, const mat4 &view,
   texture->bind(0);
   shader.setInt("texture1", 0);
 
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
-}
-
-void CelestialBody::setupMesh(const Vertex *vertices, int vertexCount,
-                              const unsigned int *indices, int idxCount) {
-
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &IBO);
-
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices,
-               GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxCount * sizeof(unsigned int),
-               indices, GL_STATIC_DRAW);
-
-  // vertex position
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-  glEnableVertexAttribArray(0);
-
-  // vertex normal
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  glBindVertexArray(0);
-}
-
-Vertex *CelestialBody::createSphereVertices(vec3 center, float radius,
-                                            int stackCount, int sectorCount,
-                                            int &vertexCount) {
-  // creates sphere vertices in object space (centered at origin)
-  // these will later be transformed to world space using the model matrix
-  vertexCount = (stackCount + 1) * (sectorCount + 1);
-  Vertex *vertices = new Vertex[vertexCount];
-
-  float sectorStep = 2.0f * PI / sectorCount;
-  float stackStep = PI / stackCount;
-
-  int index = 0;
-
-  for (int i = 0; i <= stackCount; ++i) {
-    float stackAngle = PI / 2.0f - i * stackStep;
-    float xy = radius * cosf(stackAngle);
-    float z = radius * sinf(stackAngle);
-
-    for (int j = 0; j <= sectorCount; ++j) {
-      float sectorAngle = j * sectorStep;
-      float x = xy * cosf(sectorAngle);
-      float y = xy * sinf(sectorAngle);
-
-      float px = center.x + x;
-      float py = center.y + y;
-      float pz = center.z + z;
-
-      float nx = x / radius;
-      float ny = y / radius;
-      float nz = z / radius;
-
-      vertices[index++] = {px, py, pz, nx, ny, nz};
-    }
-  }
-
-  return vertices;
-}
-
-unsigned int *CelestialBody::createSphereIndices(int stackCount,
-                                                 int sectorCount,
-                                                 int &indexCount) {
-  indexCount = stackCount * sectorCount * 6;
-  unsigned int *indices = new unsigned int[indexCount];
-
-  int index = 0;
-
-  for (int i = 0; i < stackCount; ++i) {
-    int k1 = i * (sectorCount + 1);
-    int k2 = k1 + sectorCount + 1;
-
-    for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
-      if (i != 0) {
-        indices[index++] = k1;
-        indices[index++] = k2;
-        indices[index++] = k1 + 1;
-      }
-
-      if (i != (stackCount - 1)) {
-        indices[index++] = k1 + 1;
-        indices[index++] = k2;
-        indices[index++] = k2 + 1;
-      }
-    }
-  }
-
-  indexCount = index;
-  return indices;
+  mesh->draw();
 }
@@ -0,0 +1,42 @@
+#include "catalog.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+vector<PlanetData> loadPlanetsFromCSV(const string &filepath) {
+  vector<PlanetData> planets;
+  ifstream file(filepath);
+
+  if (!file.is_open()) {
+    cerr << "Failed to open " << filepath << endl;
+    return planets;
+  }
+
+  string line;
+  getline(file, line); // skip header
+
+  while (getline(file, line)) {
+    stringstream ss(line);
+    PlanetData planet;
+    string token;
+
+    getline(ss, planet.name, ',');
+    getline(ss, token, ',');
+    planet.orbitSpeed = stof(token);
+    getline(ss, token, ',');
+    planet.orbitRadius = stof(token);
+    getline(ss, token, ',');
+    planet.size = stof(token);
+    getline(ss, planet.texture, ',');
+    getline(ss, token, ',');
+    planet.rotationSpeed = stof(token);
+    getline(ss, planet.type, ',');
+
+    planets.push_back(planet);
+  }
+
+  file.close();
+  return planets;
+}
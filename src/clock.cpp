@@ -0,0 +1,10 @@
+#include "clock.h"
+#include <chrono>
+
+using namespace std;
+
+double now() {
+  return chrono::duration<double>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
@@ -0,0 +1,304 @@
+#include "cubemap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <future>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+static const float PI = 3.14159265358979f;
+
+int CubemapImage::levelSize(int level) const {
+  return max(1, faceSize >> level);
+}
+
+size_t CubemapImage::faceBytes(int level) const {
+  size_t size = levelSize(level);
+  return size * size * channels;
+}
+
+const unsigned char *CubemapImage::face(int level, int face) const {
+  return levels[level].data() + face * faceBytes(level);
+}
+
+size_t CubemapImage::getBytes() const {
+  size_t bytes = 0;
+  for (const vector<unsigned char> &level : levels)
+    bytes += level.size();
+  return bytes;
+}
+
+int cubemapFaceSize(int equirectWidth) { return max(1, equirectWidth / 4); }
+
+double cubemapCentreResolution(int faceSize, int equirectWidth) {
+  // a face centre texel spans 2 / faceSize radians, an equator texel
+  // 2pi / width
+  return PI * (double)faceSize / max(1, equirectWidth);
+}
+
+size_t equirectBytes(int width, int height, int channels) {
+  size_t bytes = 0;
+  while (true) {
+    bytes += (size_t)width * height * channels;
+    if (width == 1 && height == 1)
+      return bytes;
+    width = max(1, width / 2);
+    height = max(1, height / 2);
+  }
+}
+
+struct Equirect {
+  const unsigned char *pixels;
+  int width, height, channels;
+};
+
+// direction through the centre of face texel (a, b), both in [-1, 1] with b
+// growing downwards, see the face table in the gl spec
+static void faceDirection(int face, float a, float b, float &x, float &y,
+                          float &z) {
+  switch (face) {
+  case 0: x = 1.0f; y = -b; z = -a; break;
+  case 1: x = -1.0f; y = -b; z = a; break;
+  case 2: x = a; y = 1.0f; z = b; break;
+  case 3: x = a; y = -1.0f; z = -b; break;
+  case 4: x = a; y = -b; z = 1.0f; break;
+  default: x = -a; y = -b; z = -1.0f; break;
+  }
+}
+
+// bilinear tap at pixel coordinates (texel centres at +0.5), wrapping in
+// longitude and clamping at the poles
+static void sample(const Equirect &src, float fx, float fy,
+                   unsigned char *out) {
+  float x0f = floor(fx), y0f = floor(fy);
+  float wx = fx - x0f, wy = fy - y0f;
+  int x0 = (int)x0f % src.width;
+  if (x0 < 0)
+    x0 += src.width;
+  int x1 = x0 + 1 == src.width ? 0 : x0 + 1;
+  int y0 = min(max((int)y0f, 0), src.height - 1);
+  int y1 = min(max((int)y0f + 1, 0), src.height - 1);
+
+  size_t row0 = (size_t)y0 * src.width, row1 = (size_t)y1 * src.width;
+  const unsigned char *p00 = src.pixels + (row0 + x0) * src.channels;
+  const unsigned char *p01 = src.pixels + (row0 + x1) * src.channels;
+  const unsigned char *p10 = src.pixels + (row1 + x0) * src.channels;
+  const unsigned char *p11 = src.pixels + (row1 + x1) * src.channels;
+  for (int c = 0; c < src.channels; ++c) {
+    float top = p00[c] + (p01[c] - p00[c]) * wx;
+    float bottom = p10[c] + (p11[c] - p10[c]) * wx;
+    out[c] = (unsigned char)(top + (bottom - top) * wy + 0.5f);
+  }
+}
+
+// texels first to size - 1 of a face row, out is the start of the row
+static void convertRowScalar(const Equirect &src, int face, int row,
+                             int size, int first, unsigned char *out) {
+  float b = 2.0f * (row + 0.5f) / size - 1.0f;
+  for (int i = first; i < size; ++i) {
+    float a = 2.0f * (i + 0.5f) / size - 1.0f;
+    float x, y, z;
+    faceDirection(face, a, b, x, y, z);
+    float u = 0.5f + atan2(z, x) / (2.0f * PI);
+    float v = 0.5f - atan2(y, sqrt(x * x + z * z)) / PI;
+    sample(src, u * src.width - 0.5f, v * src.height - 0.5f,
+           out + (size_t)i * src.channels);
+  }
+}
+
+#ifdef __SSE2__
+static __m128 choose(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// four atan2 at once, a minimax polynomial for atan on [0, 1] folded into
+// the octants. at most 3.5e-6 rad off, half a percent of a texel of an 8k map
+static __m128 atan2x4(__m128 y, __m128 x) {
+  const __m128 signBit = _mm_set1_ps(-0.0f);
+  __m128 ax = _mm_andnot_ps(signBit, x);
+  __m128 ay = _mm_andnot_ps(signBit, y);
+  __m128 high = _mm_max_ps(ax, ay);
+  __m128 low = _mm_min_ps(ax, ay);
+  __m128 t = _mm_div_ps(low, _mm_max_ps(high, _mm_set1_ps(1e-30f)));
+  __m128 s = _mm_mul_ps(t, t);
+
+  const float terms[] = {0.057477314f, -0.121239071f, 0.195635925f,
+                         -0.332994597f, 0.999995630f};
+  __m128 r = _mm_set1_ps(-0.013480470f);
+  for (float term : terms)
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(term));
+  r = _mm_mul_ps(r, t);
+
+  r = choose(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(0.5f * PI), r), r);
+  r = choose(_mm_cmplt_ps(x, _mm_setzero_ps()),
+             _mm_sub_ps(_mm_set1_ps(PI), r), r);
+  return _mm_or_ps(r, _mm_and_ps(y, signBit));
+}
+
+// the direction to pixel mapping four texels at a time, the taps stay scalar
+static void convertRowSimd(const Equirect &src, int face, int row, int size,
+                           unsigned char *out) {
+  float b = 2.0f * (row + 0.5f) / size - 1.0f;
+  const __m128 scale = _mm_set1_ps(2.0f / size);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 uScale = _mm_set1_ps(src.width / (2.0f * PI));
+  const __m128 vScale = _mm_set1_ps(-src.height / PI);
+  const __m128 uOffset = _mm_set1_ps(0.5f * src.width - 0.5f);
+  const __m128 vOffset = _mm_set1_ps(0.5f * src.height - 0.5f);
+
+  int i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m128 a = _mm_sub_ps(
+        _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)i), lanes), scale), one);
+    __m128 negA = _mm_sub_ps(_mm_setzero_ps(), a);
+    __m128 x, y, z;
+    switch (face) {
+    case 0: x = one; y = _mm_set1_ps(-b); z = negA; break;
+    case 1: x = _mm_set1_ps(-1.0f); y = _mm_set1_ps(-b); z = a; break;
+    case 2: x = a; y = one; z = _mm_set1_ps(b); break;
+    case 3: x = a; y = _mm_set1_ps(-1.0f); z = _mm_set1_ps(-b); break;
+    case 4: x = a; y = _mm_set1_ps(-b); z = one; break;
+    default: x = negA; y = _mm_set1_ps(-b); z = _mm_set1_ps(-1.0f); break;
+    }
+
+    __m128 horizontal =
+        _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)));
+    __m128 fx = _mm_add_ps(_mm_mul_ps(atan2x4(z, x), uScale), uOffset);
+    __m128 fy =
+        _mm_add_ps(_mm_mul_ps(atan2x4(y, horizontal), vScale), vOffset);
+
+    float xs[4], ys[4];
+    _mm_storeu_ps(xs, fx);
+    _mm_storeu_ps(ys, fy);
+    for (int k = 0; k < 4; ++k)
+      sample(src, xs[k], ys[k], out + (size_t)(i + k) * src.channels);
+  }
+
+  // the tail of rows that aren't a multiple of four
+  convertRowScalar(src, face, row, size, i, out);
+}
+#endif
+
+// one face level from the one above with a 2x2 box filter
+static void downsample(const unsigned char *src, int srcSize,
+                       unsigned char *dst, int dstSize, int channels) {
+  for (int y = 0; y < dstSize; ++y) {
+    int y0 = min(y * 2, srcSize - 1), y1 = min(y * 2 + 1, srcSize - 1);
+    for (int x = 0; x < dstSize; ++x) {
+      int x0 = min(x * 2, srcSize - 1), x1 = min(x * 2 + 1, srcSize - 1);
+      for (int c = 0; c < channels; ++c) {
+        int sum = src[((size_t)y0 * srcSize + x0) * channels + c] +
+                  src[((size_t)y0 * srcSize + x1) * channels + c] +
+                  src[((size_t)y1 * srcSize + x0) * channels + c] +
+                  src[((size_t)y1 * srcSize + x1) * channels + c];
+        dst[((size_t)y * dstSize + x) * channels + c] =
+            (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// on the pool if there is one, inline otherwise
+static void parallelFor(ThreadPool *pool, int count,
+                        const function<void(int, int, int)> &task) {
+  if (pool)
+    pool->parallelFor(count, 1, task);
+  else
+    task(0, 0, count);
+}
+
+void convertEquirect(const unsigned char *pixels, int width, int height,
+                     int channels, int faceSize, ThreadPool *pool,
+                     CubemapImage &out, bool simd) {
+  Equirect src = {pixels, width, height, channels};
+  out.faceSize = faceSize;
+  out.channels = channels;
+  out.levels.clear();
+
+  int levelCount = 1;
+  while (out.levelSize(levelCount - 1) > 1)
+    ++levelCount;
+  out.levels.resize(levelCount);
+  for (int level = 0; level < levelCount; ++level)
+    out.levels[level].resize(6 * out.faceBytes(level));
+
+  // level 0, all six faces as one run of rows
+  size_t rowBytes = (size_t)faceSize * channels;
+  unsigned char *base = out.levels[0].data();
+  parallelFor(pool, 6 * faceSize, [&](int, int first, int last) {
+    for (int r = first; r < last; ++r) {
+      int face = r / faceSize, row = r % faceSize;
+      unsigned char *dst = base + (size_t)r * rowBytes;
+#ifdef __SSE2__
+      if (simd) {
+        convertRowSimd(src, face, row, faceSize, dst);
+        continue;
+      }
+#endif
+      convertRowScalar(src, face, row, faceSize, 0, dst);
+    }
+  });
+
+  // faces are filtered on their own, seamless filtering on the gpu hides
+  // the edges
+  for (int level = 1; level < levelCount; ++level) {
+    int srcSize = out.levelSize(level - 1), dstSize = out.levelSize(level);
+    parallelFor(pool, 6, [&](int, int first, int last) {
+      for (int face = first; face < last; ++face) {
+        downsample(out.face(level - 1, face), srcSize,
+                   out.levels[level].data() + face * out.faceBytes(level),
+                   dstSize, channels);
+      }
+    });
+  }
+}
+
+bool writeCubemap(const char *path, const CubemapImage &image) {
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  CubemapHeader header;
+  memcpy(header.magic, CUBEMAP_MAGIC, 4);
+  header.version = CUBEMAP_VERSION;
+  header.faceSize = (uint32_t)image.faceSize;
+  header.channels = (uint32_t)image.channels;
+  header.levelCount = (uint32_t)image.levels.size();
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const vector<unsigned char> &level : image.levels) {
+    ok = ok && fwrite(level.data(), 1, level.size(), file) == level.size();
+  }
+  return fclose(file) == 0 && ok;
+}
+
+bool readCubemap(const char *path, CubemapImage &image) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  CubemapHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, CUBEMAP_MAGIC, 4) == 0 &&
+            header.version == CUBEMAP_VERSION && header.faceSize > 0 &&
+            header.channels >= 1 && header.channels <= 4 &&
+            header.levelCount > 0 && header.levelCount <= 32;
+  if (ok) {
+    image.faceSize = (int)header.faceSize;
+    image.channels = (int)header.channels;
+    image.levels.resize(header.levelCount);
+    for (int level = 0; ok && level < (int)header.levelCount; ++level) {
+      image.levels[level].resize(6 * image.faceBytes(level));
+      ok = fread(image.levels[level].data(), 1, image.levels[level].size(),
+                 file) == image.levels[level].size();
+    }
+  }
+  fclose(file);
+  return ok;
+}
@@ -0,0 +1,416 @@
+#include "ephemeris.h"
+#include "body.h"
+#include "clock.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+
+using namespace std;
+
+// fseek takes a long, which is 32 bits on windows
+static bool seekTo(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void putVarint(vector<unsigned char> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((unsigned char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((unsigned char)value);
+}
+
+// false past the end or on an overlong varint
+static bool getVarint(const unsigned char *&data, const unsigned char *end,
+                      uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (data == end)
+      return false;
+    unsigned char byte = *data++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+// first value, first delta, then deltas of deltas. orbits are smooth, so the
+// last are a few units and a straight line (or a body at rest) is all zeros
+static void encodeColumn(const vector<int64_t> &values,
+                         vector<unsigned char> &out) {
+  vector<uint64_t> codes(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    int64_t code = values[i];
+    if (i >= 1)
+      code -= values[i - 1];
+    if (i >= 2)
+      code -= values[i - 1] - values[i - 2];
+    codes[i] = zigzag(code);
+  }
+
+  for (size_t i = 0; i < codes.size();) {
+    putVarint(out, codes[i]);
+    if (codes[i] != 0) {
+      ++i;
+      continue;
+    }
+    size_t run = 1;
+    while (i + run < codes.size() && codes[i + run] == 0)
+      ++run;
+    putVarint(out, run - 1);
+    i += run;
+  }
+}
+
+static bool decodeColumn(const unsigned char *data, size_t size,
+                         uint32_t count, vector<int64_t> &values) {
+  const unsigned char *end = data + size;
+  values.resize(count);
+  int64_t delta = 0;
+  for (uint32_t i = 0; i < count;) {
+    uint64_t code, run = 0;
+    if (!getVarint(data, end, code))
+      return false;
+    if (code == 0 && !getVarint(data, end, run))
+      return false;
+    if (run >= count - i)
+      return false;
+
+    for (uint64_t r = 0; r <= run; ++r, ++i) {
+      int64_t value = unzigzag(code);
+      if (i == 0) {
+        values[i] = value;
+        continue;
+      }
+      delta = i == 1 ? value : delta + value;
+      values[i] = values[i - 1] + delta;
+    }
+  }
+  return data == end;
+}
+
+// every sample of the block on its own copies of the bodies, so blocks run
+// in parallel and in any order. the parents come first in the list
+static void encodeBlock(const vector<EphemerisBody> &defs, double startTime,
+                        double step, uint64_t first, uint32_t count,
+                        double quantum, vector<unsigned char> &out) {
+  vector<CelestialBody> bodies;
+  bodies.reserve(defs.size());
+  for (const EphemerisBody &def : defs) {
+    bodies.emplace_back(0.0f);
+    CelestialBody &body = bodies.back();
+    body.setOrbit(def.orbitRadius, def.orbitSpeed);
+    body.setRotationSpeed(def.rotationSpeed);
+    if (def.parent >= 0)
+      body.setParent(&bodies[def.parent]);
+  }
+
+  size_t columnCount = defs.size() * 3;
+  vector<vector<int64_t>> columns(columnCount, vector<int64_t>(count));
+  for (uint32_t s = 0; s < count; ++s) {
+    double time = startTime + (double)(first + s) * step;
+    for (size_t b = 0; b < bodies.size(); ++b) {
+      bodies[b].evaluate(time);
+      vec3 position = bodies[b].getPosition();
+      for (int c = 0; c < 3; ++c)
+        columns[b * 3 + c][s] = llround(position[c] / quantum);
+    }
+  }
+
+  // the table of column sizes, filled in once they are known
+  out.assign(columnCount * sizeof(uint32_t), 0);
+  for (size_t c = 0; c < columnCount; ++c) {
+    size_t before = out.size();
+    encodeColumn(columns[c], out);
+    uint32_t bytes = (uint32_t)(out.size() - before);
+    memcpy(out.data() + c * sizeof(uint32_t), &bytes, sizeof(bytes));
+  }
+}
+
+// samples stored in a block: its own and the first of the next one
+static uint32_t storedSamples(uint64_t block, uint32_t blockSamples,
+                              uint64_t sampleCount) {
+  uint64_t first = block * blockSamples;
+  return (uint32_t)min<uint64_t>(blockSamples + 1, sampleCount - first);
+}
+
+bool writeEphemeris(const char *path, const vector<EphemerisBody> &bodies,
+                    double startTime, double step, uint64_t sampleCount,
+                    uint32_t blockSamples, double quantum, ThreadPool &pool,
+                    EphemerisStats &stats) {
+  double start = now();
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  EphemerisHeader header;
+  memcpy(header.magic, EPHEMERIS_MAGIC, 4);
+  header.version = EPHEMERIS_VERSION;
+  header.bodyCount = (uint32_t)bodies.size();
+  header.blockSamples = blockSamples;
+  header.sampleCount = sampleCount;
+  header.startTime = startTime;
+  header.step = step;
+  header.quantum = quantum;
+  header.indexOffset = 0;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  uint64_t offset = sizeof(header);
+  for (const EphemerisBody &body : bodies) {
+    uint32_t length = (uint32_t)body.name.size();
+    ok = ok && fwrite(&length, sizeof(length), 1, file) == 1 &&
+         fwrite(body.name.data(), 1, length, file) == length;
+    offset += sizeof(length) + length;
+  }
+
+  // blocks are written in order as the oldest one finishes, the pool works
+  // on the ones after it meanwhile
+  struct PendingBlock {
+    vector<unsigned char> bytes;
+    future<void> done;
+  };
+  deque<PendingBlock> pending;
+  size_t inFlight = 2 * max(1u, pool.size());
+  uint64_t blockCount = (sampleCount + blockSamples - 1) / blockSamples;
+  uint64_t submitted = 0;
+  vector<EphemerisIndexEntry> index;
+
+  while (ok && (submitted < blockCount || !pending.empty())) {
+    if (submitted < blockCount && pending.size() < inFlight) {
+      pending.push_back(PendingBlock());
+      vector<unsigned char> *bytes = &pending.back().bytes;
+      uint64_t first = submitted * blockSamples;
+      uint32_t count = storedSamples(submitted, blockSamples, sampleCount);
+      pending.back().done =
+          pool.submit([&bodies, startTime, step, first, count, quantum,
+                       bytes]() {
+            encodeBlock(bodies, startTime, step, first, count, quantum,
+                        *bytes);
+          });
+      ++submitted;
+      continue;
+    }
+
+    PendingBlock &oldest = pending.front();
+    oldest.done.get();
+    EphemerisIndexEntry entry;
+    entry.time = startTime + (double)index.size() * blockSamples * step;
+    entry.offset = offset;
+    entry.bytes = oldest.bytes.size();
+    ok = fwrite(oldest.bytes.data(), 1, oldest.bytes.size(), file) ==
+         oldest.bytes.size();
+    offset += entry.bytes;
+    index.push_back(entry);
+    pending.pop_front();
+  }
+  // the tasks write into the pending blocks
+  for (PendingBlock &block : pending)
+    block.done.wait();
+
+  header.indexOffset = offset;
+  ok = ok &&
+       fwrite(index.data(), sizeof(EphemerisIndexEntry), index.size(),
+              file) == index.size() &&
+       fseek(file, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+
+  stats.seconds = now() - start;
+  stats.rawBytes = sampleCount * bodies.size() * 3 * sizeof(float);
+  stats.fileBytes = offset + index.size() * sizeof(EphemerisIndexEntry);
+  return ok;
+}
+
+EphemerisReader::EphemerisReader() : file(nullptr), cachedBlock(-1) {
+  memset(&header, 0, sizeof(header));
+}
+
+EphemerisReader::~EphemerisReader() { close(); }
+
+bool EphemerisReader::open(const char *path) {
+  close();
+  file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, EPHEMERIS_MAGIC, 4) == 0 &&
+            header.version == EPHEMERIS_VERSION && header.bodyCount > 0 &&
+            header.blockSamples > 0 && header.sampleCount > 0 &&
+            header.step > 0.0 && header.quantum > 0.0;
+  for (uint32_t i = 0; ok && i < header.bodyCount; ++i) {
+    uint32_t length = 0;
+    ok = fread(&length, sizeof(length), 1, file) == 1 && length <= 256;
+    string name(length, ' ');
+    ok = ok && fread(&name[0], 1, length, file) == length;
+    names.push_back(name);
+  }
+
+  uint64_t blockCount =
+      (header.sampleCount + header.blockSamples - 1) / header.blockSamples;
+  index.resize(ok ? blockCount : 0);
+  ok = ok && seekTo(file, header.indexOffset) &&
+       fread(index.data(), sizeof(EphemerisIndexEntry), index.size(),
+             file) == index.size();
+  if (!ok)
+    close();
+  return ok;
+}
+
+void EphemerisReader::close() {
+  if (file)
+    fclose(file);
+  file = nullptr;
+  names.clear();
+  index.clear();
+  cachedBlock = -1;
+  cached.clear();
+}
+
+int EphemerisReader::findBody(const string &name) const {
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (names[i] == name)
+      return (int)i;
+  }
+  return -1;
+}
+
+double EphemerisReader::getEndTime() const {
+  return header.startTime + (double)(header.sampleCount - 1) * header.step;
+}
+
+uint32_t EphemerisReader::blockSize(uint64_t block) const {
+  return storedSamples(block, header.blockSamples, header.sampleCount);
+}
+
+bool EphemerisReader::readBlock(uint64_t block, vector<unsigned char> &bytes) {
+  const EphemerisIndexEntry &entry = index[block];
+  size_t tableBytes = header.bodyCount * 3 * sizeof(uint32_t);
+  if (entry.bytes < tableBytes)
+    return false;
+  bytes.resize(entry.bytes);
+  return seekTo(file, entry.offset) &&
+         fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
+
+bool EphemerisReader::loadBlock(uint64_t block) {
+  if (cachedBlock == (long long)block)
+    return true;
+
+  vector<unsigned char> bytes;
+  if (!readBlock(block, bytes))
+    return false;
+
+  uint32_t count = blockSize(block);
+  uint32_t bodyCount = header.bodyCount;
+  cached.assign((size_t)count * bodyCount, vec3(0.0f));
+  const unsigned char *column =
+      bytes.data() + bodyCount * 3 * sizeof(uint32_t);
+  const unsigned char *end = bytes.data() + bytes.size();
+  vector<int64_t> values;
+  for (uint32_t c = 0; c < bodyCount * 3; ++c) {
+    uint32_t size;
+    memcpy(&size, bytes.data() + c * sizeof(uint32_t), sizeof(size));
+    if (size > (size_t)(end - column) ||
+        !decodeColumn(column, size, count, values)) {
+      cachedBlock = -1;
+      return false;
+    }
+    for (uint32_t s = 0; s < count; ++s)
+      cached[(size_t)s * bodyCount + c / 3][c % 3] =
+          (float)(values[s] * header.quantum);
+    column += size;
+  }
+  cachedBlock = (long long)block;
+  return true;
+}
+
+uint64_t EphemerisReader::locate(double time, float &weight) const {
+  double sample = (time - header.startTime) / header.step;
+  double last = (double)(header.sampleCount - 1);
+  sample = std::max(0.0, std::min(sample, last));
+  double whole = floor(sample);
+  weight = (float)(sample - whole);
+  return (uint64_t)whole;
+}
+
+bool EphemerisReader::positionsAt(double time, vector<vec3> &positions) {
+  float weight;
+  uint64_t sample = locate(time, weight);
+  uint64_t block = sample / header.blockSamples;
+  if (!file || !loadBlock(block))
+    return false;
+
+  uint32_t bodyCount = header.bodyCount;
+  size_t row = (size_t)(sample - block * header.blockSamples) * bodyCount;
+  positions.resize(bodyCount);
+  for (uint32_t b = 0; b < bodyCount; ++b) {
+    positions[b] = cached[row + b];
+    // the next sample is in this block unless this is the very last one
+    if (weight > 0.0f)
+      positions[b] = mix(positions[b], cached[row + bodyCount + b], weight);
+  }
+  return true;
+}
+
+bool EphemerisReader::positionAt(int body, double time, vec3 &position) {
+  if (!file || body < 0 || body >= (int)header.bodyCount)
+    return false;
+  float weight;
+  uint64_t sample = locate(time, weight);
+  uint64_t block = sample / header.blockSamples;
+  uint32_t local = (uint32_t)(sample - block * header.blockSamples);
+
+  if (cachedBlock == (long long)block) {
+    size_t row = (size_t)local * header.bodyCount + body;
+    position = cached[row];
+    if (weight > 0.0f)
+      position = mix(position, cached[row + header.bodyCount], weight);
+    return true;
+  }
+
+  vector<unsigned char> bytes;
+  if (!readBlock(block, bytes))
+    return false;
+
+  // skip the columns of the bodies before it
+  vector<uint32_t> sizes(header.bodyCount * 3);
+  memcpy(sizes.data(), bytes.data(), sizes.size() * sizeof(uint32_t));
+  size_t skip = sizes.size() * sizeof(uint32_t);
+  for (int c = 0; c < body * 3; ++c)
+    skip += sizes[c];
+  if (skip > bytes.size())
+    return false;
+  const unsigned char *column = bytes.data() + skip;
+  const unsigned char *end = bytes.data() + bytes.size();
+
+  uint32_t count = blockSize(block);
+  vector<int64_t> values;
+  vec3 samples[2];
+  for (int c = 0; c < 3; ++c) {
+    uint32_t size = sizes[body * 3 + c];
+    if (size > (size_t)(end - column) ||
+        !decodeColumn(column, size, count, values))
+      return false;
+    samples[0][c] = (float)(values[local] * header.quantum);
+    if (weight > 0.0f)
+      samples[1][c] = (float)(values[local + 1] * header.quantum);
+    column += size;
+  }
+  position = weight > 0.0f ? mix(samples[0], samples[1], weight) : samples[0];
+  return true;
+}
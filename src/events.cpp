@@ -0,0 +1,466 @@
+#include "events.h"
+#include "clock.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static const double TWO_PI = 6.283185307179586;
+
+// samples per turn of the fastest orbit a query depends on. a dip of the
+// function lasts about half a synodic period, so this leaves it dozens of
+// samples
+static const double STEPS_PER_TURN = 64.0;
+
+// samples evaluated together, positions for all bodies of a batch are a few
+// hundred kilobytes at most
+static const int BATCH_SAMPLES = 1024;
+
+// robust near 0 and pi, unlike acos of the dot product
+static double angleBetween(const dvec3 &u, const dvec3 &v) {
+  return atan2(length(cross(u, v)), dot(u, v));
+}
+
+// angular radius of a sphere seen from a distance
+static double angularRadius(double radius, double distance) {
+  return distance > radius ? asin(radius / distance) : TWO_PI / 4.0;
+}
+
+EventSearch::EventSearch(const vector<CelestialBody *> &bodies,
+                         unsigned int threads)
+    : pool(threads), tolerance(1e-4), sampleCount(0), refineCount(0),
+      lastTime(0.0) {
+  for (const CelestialBody *body : bodies) {
+    Orbit orbit;
+    orbit.radius = body->getOrbitRadius();
+    orbit.speed = radians((double)body->getOrbitSpeed());
+    orbit.size = body->getRadius();
+    orbit.parent = -1;
+    for (size_t i = 0; i < orbits.size(); ++i) {
+      if (bodies[i] == body->getParent())
+        orbit.parent = (int)i;
+    }
+    orbits.push_back(orbit);
+  }
+}
+
+int EventSearch::addConjunction(int observer, int a, int b,
+                                double maxSeparation) {
+  Query query;
+  query.kind = EVENT_CONJUNCTION;
+  query.observer = observer;
+  query.a = a;
+  query.b = b;
+  query.threshold = maxSeparation;
+  queries.push_back(query);
+  return (int)queries.size() - 1;
+}
+
+int EventSearch::addOccultation(int observer, int source, int occluder) {
+  Query query;
+  query.kind = EVENT_OCCULTATION;
+  query.observer = observer;
+  query.a = source;
+  query.b = occluder;
+  query.threshold = 0.0;
+  queries.push_back(query);
+  return (int)queries.size() - 1;
+}
+
+int EventSearch::addFrustumEntry(int body, const mat4 &viewProjection) {
+  Query query;
+  query.kind = EVENT_FRUSTUM;
+  query.observer = -1;
+  query.a = body;
+  query.b = -1;
+  query.threshold = 0.0;
+
+  // from the rows of the matrix as in FrameBuilder::build
+  const mat4 &clip = viewProjection;
+  for (int i = 0; i < 3; ++i) {
+    vec4 row(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    vec4 w(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+    query.planes[i * 2] = w + row;
+    query.planes[i * 2 + 1] = w - row;
+  }
+  for (vec4 &plane : query.planes)
+    plane = plane * (1.0f / length(vec3(plane)));
+
+  queries.push_back(query);
+  return (int)queries.size() - 1;
+}
+
+double EventSearch::suggestStep() const {
+  double fastest = 0.0;
+  for (const Query &query : queries) {
+    int involved[3] = {query.observer, query.a, query.b};
+    for (int body : involved) {
+      for (; body >= 0; body = orbits[body].parent)
+        fastest = max(fastest, fabs(orbits[body].speed));
+    }
+  }
+  return fastest > 0.0 ? TWO_PI / fastest / STEPS_PER_TURN : 1.0;
+}
+
+dvec3 EventSearch::positionAt(int body, double time) const {
+  dvec3 position(0.0);
+  for (; body >= 0; body = orbits[body].parent) {
+    const Orbit &orbit = orbits[body];
+    if (orbit.radius <= 0.0)
+      continue;
+    double angle = fmod(orbit.speed * time, TWO_PI);
+    position +=
+        dvec3(orbit.radius * cos(angle), 0.0, orbit.radius * sin(angle));
+  }
+  return position;
+}
+
+// the angle advances by the same amount every sample, so each body's
+// position is rotated by one fixed rotation per step. the loops over the
+// samples of a body are independent of the other bodies
+void EventSearch::sampleBatch(double start, double step, int count,
+                              Batch &batch) const {
+  size_t total = orbits.size() * count;
+  batch.count = count;
+  batch.x.assign(total, 0.0);
+  batch.y.assign(total, 0.0);
+  batch.z.assign(total, 0.0);
+
+  for (size_t b = 0; b < orbits.size(); ++b) {
+    const Orbit &orbit = orbits[b];
+    if (orbit.radius <= 0.0)
+      continue;
+    double *x = &batch.x[b * count];
+    double *y = &batch.y[b * count];
+    double *z = &batch.z[b * count];
+
+    double angle = fmod(orbit.speed * start, TWO_PI);
+    double c = cos(angle), s = sin(angle);
+    double stepCos = cos(orbit.speed * step), stepSin = sin(orbit.speed * step);
+    for (int k = 0; k < count; ++k) {
+      x[k] = orbit.radius * c;
+      z[k] = orbit.radius * s;
+      double next = c * stepCos - s * stepSin;
+      s = s * stepCos + c * stepSin;
+      c = next;
+    }
+
+    if (orbit.parent >= 0) {
+      const double *px = &batch.x[orbit.parent * count];
+      const double *py = &batch.y[orbit.parent * count];
+      const double *pz = &batch.z[orbit.parent * count];
+      for (int k = 0; k < count; ++k) {
+        x[k] += px[k];
+        y[k] += py[k];
+        z[k] += pz[k];
+      }
+    }
+  }
+}
+
+double EventSearch::evaluate(const Query &query,
+                             const dvec3 *positions) const {
+  switch (query.kind) {
+  case EVENT_CONJUNCTION: {
+    dvec3 eye = positions[query.observer];
+    return angleBetween(positions[query.a] - eye, positions[query.b] - eye) -
+           query.threshold;
+  }
+  case EVENT_OCCULTATION: {
+    dvec3 eye = positions[query.observer];
+    dvec3 source = positions[query.a] - eye;
+    dvec3 occluder = positions[query.b] - eye;
+    double sourceDistance = length(source);
+    double occluderDistance = length(occluder);
+    double overlap = angularRadius(orbits[query.a].size, sourceDistance) +
+                     angularRadius(orbits[query.b].size, occluderDistance);
+    double separation = angleBetween(source, occluder);
+    // behind the source it hides nothing
+    if (occluderDistance >= sourceDistance)
+      return separation + overlap;
+    return separation - overlap;
+  }
+  case EVENT_FRUSTUM: {
+    dvec3 center = positions[query.a];
+    double outside = -1e300;
+    for (const vec4 &plane : query.planes)
+      outside = max(outside, -(dot(dvec3(vec3(plane)), center) + plane.w));
+    return outside - orbits[query.a].size;
+  }
+  }
+  return 0.0;
+}
+
+// only the bodies the query looks at
+double EventSearch::evaluateAt(const Query &query, double time,
+                               vector<dvec3> &scratch) const {
+  scratch.resize(orbits.size());
+  int involved[3] = {query.observer, query.a, query.b};
+  for (int body : involved) {
+    if (body >= 0)
+      scratch[body] = positionAt(body, time);
+  }
+  return evaluate(query, scratch.data());
+}
+
+// bisection between a sample outside (above zero) and one inside
+double EventSearch::findRoot(const Query &query, double lo, double hi,
+                             bool entering, vector<dvec3> &scratch,
+                             size_t &evaluations) const {
+  while (hi - lo > tolerance) {
+    double mid = 0.5 * (lo + hi);
+    bool inside = evaluateAt(query, mid, scratch) < 0.0;
+    ++evaluations;
+    if (inside == entering)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  return 0.5 * (lo + hi);
+}
+
+// golden section search, the function is taken to have one minimum in range
+double EventSearch::findMinimum(const Query &query, double lo, double hi,
+                                double &value, vector<dvec3> &scratch,
+                                size_t &evaluations) const {
+  const double ratio = 0.6180339887498949;
+  double a = hi - ratio * (hi - lo), b = lo + ratio * (hi - lo);
+  double fa = evaluateAt(query, a, scratch);
+  double fb = evaluateAt(query, b, scratch);
+  evaluations += 2;
+  while (hi - lo > tolerance) {
+    if (fa < fb) {
+      hi = b;
+      b = a;
+      fb = fa;
+      a = hi - ratio * (hi - lo);
+      fa = evaluateAt(query, a, scratch);
+    } else {
+      lo = a;
+      a = b;
+      fa = fb;
+      b = lo + ratio * (hi - lo);
+      fb = evaluateAt(query, b, scratch);
+    }
+    ++evaluations;
+  }
+  value = min(fa, fb);
+  return fa < fb ? a : b;
+}
+
+// samples [first, last) of the window, plus one on each side for the
+// minima at the edges. a chunk owns the intervals starting at its samples,
+// so every crossing is found by exactly one chunk
+void EventSearch::scanChunk(double start, double step, size_t first,
+                            size_t last, size_t total,
+                            vector<vector<Crossing>> &crossings,
+                            vector<char> &insideAtStart,
+                            size_t &evaluations) const {
+  vector<dvec3> scratch;
+  vector<dvec3> positions(orbits.size());
+  Batch batch;
+
+  size_t from = first > 0 ? first - 1 : 0;
+  size_t to = min(total, last + 1);
+  size_t queryCount = queries.size();
+  // function values of [from, to), sample-major
+  vector<double> values((to - from) * queryCount);
+
+  for (size_t batchFirst = from; batchFirst < to;
+       batchFirst += BATCH_SAMPLES) {
+    int count = (int)min<size_t>(BATCH_SAMPLES, to - batchFirst);
+    sampleBatch(start + batchFirst * step, step, count, batch);
+    for (int k = 0; k < count; ++k) {
+      for (size_t b = 0; b < orbits.size(); ++b) {
+        size_t i = b * count + k;
+        positions[b] = dvec3(batch.x[i], batch.y[i], batch.z[i]);
+      }
+      double *row = &values[(batchFirst + k - from) * queryCount];
+      for (size_t q = 0; q < queryCount; ++q)
+        row[q] = evaluate(queries[q], positions.data());
+    }
+  }
+
+  if (first == 0) {
+    for (size_t q = 0; q < queryCount; ++q)
+      insideAtStart[q] = values[q] < 0.0;
+  }
+
+  for (size_t q = 0; q < queryCount; ++q) {
+    const Query &query = queries[q];
+    for (size_t k = first; k < last; ++k) {
+      double f = values[(k - from) * queryCount + q];
+      double t = start + k * step;
+
+      if (k + 1 < total) {
+        double next = values[(k + 1 - from) * queryCount + q];
+        if ((f < 0.0) != (next < 0.0)) {
+          bool entering = next < 0.0;
+          Crossing crossing = {findRoot(query, t, t + step, entering, scratch,
+                                        evaluations),
+                               entering};
+          crossings[q].push_back(crossing);
+        }
+      }
+
+      // a dip that stays above zero at the samples may still cross it
+      // between them
+      if (k == 0 || k + 1 >= total || f < 0.0)
+        continue;
+      double previous = values[(k - 1 - from) * queryCount + q];
+      double next = values[(k + 1 - from) * queryCount + q];
+      if (previous < 0.0 || next < 0.0 || !(previous > f && f <= next))
+        continue;
+      double lowest;
+      double low = findMinimum(query, t - step, t + step, lowest, scratch,
+                               evaluations);
+      if (lowest >= 0.0)
+        continue;
+      Crossing in = {findRoot(query, t - step, low, true, scratch,
+                              evaluations),
+                     true};
+      Crossing out = {findRoot(query, low, t + step, false, scratch,
+                               evaluations),
+                      false};
+      crossings[q].push_back(in);
+      crossings[q].push_back(out);
+    }
+  }
+}
+
+void EventSearch::pairCrossings(int query, const vector<Crossing> &crossings,
+                                bool inside, double start, double end,
+                                vector<SearchEvent> &events,
+                                size_t &evaluations) const {
+  vector<dvec3> scratch;
+  SearchEvent event;
+  event.query = query;
+  event.kind = queries[query].kind;
+  event.start = start;
+  event.clipped = inside;
+
+  for (const Crossing &crossing : crossings) {
+    if (crossing.entering) {
+      event.start = crossing.time;
+      event.clipped = false;
+      inside = true;
+      continue;
+    }
+    if (!inside)
+      continue;
+    event.end = crossing.time;
+    event.peak = findMinimum(queries[query], event.start, event.end,
+                             event.value, scratch, evaluations);
+    events.push_back(event);
+    inside = false;
+  }
+
+  if (inside) {
+    event.end = end;
+    event.clipped = true;
+    event.peak = findMinimum(queries[query], event.start, event.end,
+                             event.value, scratch, evaluations);
+    events.push_back(event);
+  }
+}
+
+void EventSearch::search(double start, double end, double step,
+                         vector<SearchEvent> &events) {
+  double began = now();
+  events.clear();
+  if (step <= 0.0)
+    step = suggestStep();
+  size_t total = end > start ? (size_t)ceil((end - start) / step) + 1 : 1;
+  size_t queryCount = queries.size();
+
+  // several time chunks per thread to even out the refinement work, each
+  // at least a batch long
+  size_t chunkCount = (size_t)pool.maxTasks();
+  vector<vector<vector<Crossing>>> found(
+      chunkCount, vector<vector<Crossing>>(queryCount));
+  vector<char> insideAtStart(queryCount, 0);
+  vector<size_t> evaluations(chunkCount, 0);
+  pool.parallelFor((int)total, BATCH_SAMPLES,
+                   [&](int task, int first, int last) {
+                     scanChunk(start, step, first, last, total, found[task],
+                               insideAtStart, evaluations[task]);
+                   });
+
+  refineCount = 0;
+  for (size_t count : evaluations)
+    refineCount += count;
+
+  // the chunks are in time order and so are the crossings within each
+  double last = start + (total - 1) * step;
+  for (size_t q = 0; q < queryCount; ++q) {
+    vector<Crossing> crossings;
+    for (size_t c = 0; c < chunkCount; ++c)
+      crossings.insert(crossings.end(), found[c][q].begin(),
+                       found[c][q].end());
+    pairCrossings((int)q, crossings, insideAtStart[q] != 0, start, last,
+                  events, refineCount);
+  }
+
+  sort(events.begin(), events.end(),
+       [](const SearchEvent &a, const SearchEvent &b) {
+         return a.start < b.start;
+       });
+  sampleCount = total;
+  lastTime = now() - began;
+}
+
+void EventSearch::searchBruteForce(const vector<CelestialBody *> &bodies,
+                                   double start, double end, double step,
+                                   vector<SearchEvent> &events) const {
+  events.clear();
+  size_t total = end > start ? (size_t)ceil((end - start) / step) + 1 : 1;
+  size_t queryCount = queries.size();
+  vector<dvec3> positions(bodies.size());
+  vector<double> previous(queryCount), current(queryCount);
+  vector<SearchEvent> open(queryCount);
+
+  for (size_t k = 0; k < total; ++k) {
+    double t = start + k * step;
+    for (size_t b = 0; b < bodies.size(); ++b) {
+      bodies[b]->evaluate(t);
+      positions[b] = dvec3(bodies[b]->getPosition());
+    }
+
+    for (size_t q = 0; q < queryCount; ++q) {
+      current[q] = evaluate(queries[q], positions.data());
+      SearchEvent &event = open[q];
+      bool inside = current[q] < 0.0;
+      bool wasInside = k > 0 && previous[q] < 0.0;
+
+      if (inside && !wasInside) {
+        event.query = (int)q;
+        event.kind = queries[q].kind;
+        event.clipped = k == 0;
+        event.start = k == 0 ? t
+                             : t - step * current[q] /
+                                       (current[q] - previous[q]);
+        event.peak = t;
+        event.value = current[q];
+      }
+      if (inside && current[q] < event.value) {
+        event.peak = t;
+        event.value = current[q];
+      }
+      if (!inside && wasInside) {
+        event.end = t - step * current[q] / (current[q] - previous[q]);
+        events.push_back(event);
+      }
+      if (inside && k + 1 == total) {
+        event.end = t;
+        event.clipped = true;
+        events.push_back(event);
+      }
+    }
+    swap(previous, current);
+  }
+
+  sort(events.begin(), events.end(),
+       [](const SearchEvent &a, const SearchEvent &b) {
+         return a.start < b.start;
+       });
+}
@@ -0,0 +1,370 @@
+#include "exporter.h"
+#include "memory.h"
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using namespace std;
+
+// largest payload of a stored (uncompressed) deflate block
+static const unsigned int DEFLATE_BLOCK_SIZE = 65535;
+
+static bool buildCrcTable(unsigned int *table) {
+  for (unsigned int n = 0; n < 256; ++n) {
+    unsigned int c = n;
+    for (int k = 0; k < 8; ++k)
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+  return true;
+}
+
+static unsigned int updateCrc(unsigned int crc, const unsigned char *data,
+                              size_t length) {
+  // function-local statics initialise once, even with several encoders
+  static unsigned int table[256];
+  static bool ready = buildCrcTable(table);
+  (void)ready;
+
+  for (size_t i = 0; i < length; ++i)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+static void putBigEndian(unsigned char *out, unsigned int value) {
+  out[0] = (value >> 24) & 0xFF;
+  out[1] = (value >> 16) & 0xFF;
+  out[2] = (value >> 8) & 0xFF;
+  out[3] = value & 0xFF;
+}
+
+// streams the IDAT payload: a zlib wrapper around stored deflate blocks,
+// keeping the chunk crc and zlib adler32 up to date as bytes go out
+struct IdatWriter {
+  FILE *file;
+  unsigned int crc;
+  unsigned int adlerA, adlerB;
+  unsigned int blockRemaining;
+  unsigned long long dataRemaining;
+
+  void raw(const unsigned char *data, size_t length) {
+    fwrite(data, 1, length, file);
+    crc = updateCrc(crc, data, length);
+  }
+
+  void write(const unsigned char *data, size_t length) {
+    while (length > 0) {
+      if (blockRemaining == 0) {
+        // start the next stored block
+        blockRemaining = dataRemaining > DEFLATE_BLOCK_SIZE
+                             ? DEFLATE_BLOCK_SIZE
+                             : (unsigned int)dataRemaining;
+        unsigned char header[5];
+        header[0] = dataRemaining == blockRemaining ? 1 : 0; // final block
+        header[1] = blockRemaining & 0xFF;
+        header[2] = (blockRemaining >> 8) & 0xFF;
+        header[3] = ~blockRemaining & 0xFF;
+        header[4] = (~blockRemaining >> 8) & 0xFF;
+        raw(header, 5);
+      }
+
+      size_t count = length < blockRemaining ? length : blockRemaining;
+      raw(data, count);
+
+      // 5552 bytes is the longest run that cannot overflow before the modulo
+      for (size_t done = 0; done < count;) {
+        size_t run = count - done < 5552 ? count - done : 5552;
+        for (size_t i = 0; i < run; ++i) {
+          adlerA += data[done + i];
+          adlerB += adlerA;
+        }
+        adlerA %= 65521;
+        adlerB %= 65521;
+        done += run;
+      }
+
+      data += count;
+      length -= count;
+      blockRemaining -= (unsigned int)count;
+      dataRemaining -= count;
+    }
+  }
+};
+
+static void writeChunk(FILE *file, const char *type, const unsigned char *data,
+                       unsigned int length) {
+  unsigned char header[8];
+  putBigEndian(header, length);
+  header[4] = type[0];
+  header[5] = type[1];
+  header[6] = type[2];
+  header[7] = type[3];
+  fwrite(header, 1, 8, file);
+  if (length > 0)
+    fwrite(data, 1, length, file);
+
+  unsigned int crc = updateCrc(0xFFFFFFFFu, header + 4, 4);
+  crc = updateCrc(crc, data, length) ^ 0xFFFFFFFFu;
+  unsigned char footer[4];
+  putBigEndian(footer, crc);
+  fwrite(footer, 1, 4, file);
+}
+
+FrameExporter::FrameExporter(int w, int h, const string &dir, ExportFormat fmt,
+                             int pboCount, unsigned int encoderThreads)
+    : width(w), height(h), outputDir(dir), format(fmt), nextSlot(0),
+      framesCaptured(0), readbackStalls(0), bytesWritten(0), framesFailed(0),
+      encoders(encoderThreads) {
+  slots.resize(pboCount);
+  for (auto &slot : slots) {
+    glGenBuffers(1, &slot.PBO);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL,
+                 GL_STREAM_READ);
+    MemoryTracker::trackBuffer(slot.PBO, MEMORY_TRANSFER,
+                               (size_t)width * height * 4);
+    slot.fence = 0;
+    slot.state = SLOT_FREE;
+    slot.frameIndex = -1;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameExporter::~FrameExporter() {
+  finish();
+  for (auto &slot : slots) {
+    glDeleteBuffers(1, &slot.PBO);
+    MemoryTracker::releaseBuffer(slot.PBO);
+  }
+}
+
+void FrameExporter::capture(const Framebuffer &source) {
+  poll();
+
+  Slot &slot = slots[nextSlot];
+  nextSlot = (nextSlot + 1) % (int)slots.size();
+
+  // the ring wrapped around before this slot drained: the only place we wait
+  if (slot.state != SLOT_FREE) {
+    readbackStalls++;
+    if (slot.state == SLOT_READING)
+      dispatch(slot);
+    // a failed map leaves the slot free with nothing to wait for or unmap
+    if (slot.state == SLOT_ENCODING)
+      release(slot);
+  }
+
+  // queue the copy into the PBO, glReadPixels returns immediately
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, source.ID);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.state = SLOT_READING;
+  slot.frameIndex = framesCaptured++;
+}
+
+void FrameExporter::poll() {
+  for (auto &slot : slots) {
+    if (slot.state == SLOT_ENCODING &&
+        slot.encoded.wait_for(chrono::seconds(0)) == future_status::ready) {
+      release(slot);
+    }
+
+    if (slot.state == SLOT_READING) {
+      GLenum status = glClientWaitSync(slot.fence, 0, 0);
+      if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        dispatch(slot);
+    }
+  }
+}
+
+void FrameExporter::finish() {
+  for (auto &slot : slots) {
+    if (slot.state == SLOT_READING)
+      dispatch(slot);
+  }
+  for (auto &slot : slots) {
+    if (slot.state == SLOT_ENCODING)
+      release(slot);
+  }
+}
+
+void FrameExporter::dispatch(Slot &slot) {
+  // blocks only if the gpu has not finished the copy yet
+  glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+
+  // the mapping stays valid while the worker encodes, the slot is not reused
+  // until release() unmaps it
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+  const unsigned char *pixels = (const unsigned char *)glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)width * height * 4,
+      GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (!pixels) {
+    cerr << "Failed to map readback buffer for frame " << slot.frameIndex
+         << endl;
+    framesFailed++;
+    slot.state = SLOT_FREE;
+    return;
+  }
+
+  int frameIndex = slot.frameIndex;
+  slot.encoded =
+      encoders.submit([this, pixels, frameIndex] { encode(pixels, frameIndex); });
+  slot.state = SLOT_ENCODING;
+}
+
+void FrameExporter::release(Slot &slot) {
+  slot.encoded.wait();
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.state = SLOT_FREE;
+}
+
+void FrameExporter::encode(const unsigned char *pixels, int frameIndex) {
+  char name[32];
+  snprintf(name, sizeof(name), "frame_%06d.%s", frameIndex,
+           format == EXPORT_PNG ? "png" : "raw");
+  string path = outputDir + "/" + name;
+
+  long long fileBytes = format == EXPORT_PNG
+                           ? writePNG(path, pixels, width, height)
+                           : writeRaw(path, pixels, width, height);
+  if (fileBytes < 0) {
+    cerr << "Failed to write " << path << endl;
+    framesFailed++;
+    return;
+  }
+
+  bytesWritten += fileBytes;
+}
+
+static bool makeDirectory(const string &path) {
+#ifdef _WIN32
+  int result = _mkdir(path.c_str());
+#else
+  int result = mkdir(path.c_str(), 0755);
+#endif
+  return result == 0 || errno == EEXIST;
+}
+
+bool FrameExporter::createDirectory(const string &dir) {
+  // parents first, a leading separator is the root and skipped
+  for (size_t i = 1; i < dir.size(); ++i) {
+    if ((dir[i] == '/' || dir[i] == '\\') && dir[i - 1] != ':' &&
+        !makeDirectory(dir.substr(0, i)))
+      return false;
+  }
+  if (!makeDirectory(dir))
+    return false;
+
+  // an existing file of the same name, or a directory we can't write to
+  string probe = dir + "/.export_probe";
+  FILE *file = fopen(probe.c_str(), "wb");
+  if (!file)
+    return false;
+  fclose(file);
+  remove(probe.c_str());
+  return true;
+}
+
+long long FrameExporter::writePNG(const string &path,
+                                  const unsigned char *rgba, int w, int h) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+    return -1;
+
+  static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1A, '\n'};
+  fwrite(signature, 1, 8, file);
+
+  unsigned char ihdr[13];
+  putBigEndian(ihdr, w);
+  putBigEndian(ihdr + 4, h);
+  ihdr[8] = 8;  // bit depth
+  ihdr[9] = 6;  // color type: rgba
+  ihdr[10] = 0; // deflate
+  ihdr[11] = 0; // adaptive filtering
+  ihdr[12] = 0; // no interlace
+  writeChunk(file, "IHDR", ihdr, 13);
+
+  // image rows each prefixed by filter type 0, stored without compression:
+  // encoding stays memory-bandwidth bound instead of cpu bound
+  unsigned long long rowBytes = (unsigned long long)w * 4;
+  unsigned long long dataLength = (rowBytes + 1) * h;
+  unsigned long long blockCount =
+      (dataLength + DEFLATE_BLOCK_SIZE - 1) / DEFLATE_BLOCK_SIZE;
+  unsigned long long idatLength = 2 + dataLength + blockCount * 5 + 4;
+
+  unsigned char header[8];
+  putBigEndian(header, (unsigned int)idatLength);
+  header[4] = 'I';
+  header[5] = 'D';
+  header[6] = 'A';
+  header[7] = 'T';
+  fwrite(header, 1, 8, file);
+
+  IdatWriter idat;
+  idat.file = file;
+  idat.crc = updateCrc(0xFFFFFFFFu, header + 4, 4);
+  idat.adlerA = 1;
+  idat.adlerB = 0;
+  idat.blockRemaining = 0;
+  idat.dataRemaining = dataLength;
+
+  static const unsigned char zlibHeader[2] = {0x78, 0x01};
+  idat.raw(zlibHeader, 2);
+
+  // opengl rows start at the bottom, png rows at the top
+  static const unsigned char filterNone = 0;
+  for (int y = h - 1; y >= 0; --y) {
+    idat.write(&filterNone, 1);
+    idat.write(rgba + (size_t)y * rowBytes, (size_t)rowBytes);
+  }
+
+  unsigned char adler[4];
+  putBigEndian(adler, (idat.adlerB << 16) | idat.adlerA);
+  idat.raw(adler, 4);
+
+  unsigned char crc[4];
+  putBigEndian(crc, idat.crc ^ 0xFFFFFFFFu);
+  fwrite(crc, 1, 4, file);
+
+  writeChunk(file, "IEND", NULL, 0);
+
+  long long bytes = ferror(file) == 0 ? (long long)ftell(file) : -1;
+  fclose(file);
+  return bytes;
+}
+
+long long FrameExporter::writeRaw(const string &path,
+                                  const unsigned char *rgba, int w, int h) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+    return -1;
+
+  // top-down rgba8 rows, no header
+  size_t rowBytes = (size_t)w * 4;
+  for (int y = h - 1; y >= 0; --y) {
+    fwrite(rgba + (size_t)y * rowBytes, 1, rowBytes, file);
+  }
+
+  long long bytes = ferror(file) == 0 ? (long long)ftell(file) : -1;
+  fclose(file);
+  return bytes;
+}
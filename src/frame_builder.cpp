@@ -0,0 +1,111 @@
+#include "frame_builder.h"
+#include "clock.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+FrameBuilder::FrameBuilder(unsigned int threads, int minBodies)
+    : pool(threads), minBodiesPerTask(max(minBodies, 1)), lastTime(0.0) {}
+
+BodyDraw FrameBuilder::makeDraw(const CelestialBody &body, const vec3 &eye) {
+  BodyDraw draw;
+  draw.model = body.getModelMatrix();
+  draw.center = body.getPosition();
+  draw.radius = body.getRadius();
+  draw.rotation = radians(body.getRotationAngle());
+  draw.mesh = body.getMesh();
+  draw.texture = body.getTexture();
+  draw.ka = body.getMaterialKa();
+  draw.kd = body.getMaterialKd();
+  draw.ks = body.getMaterialKs();
+  draw.shininess = body.getMaterialShininess();
+  draw.fade = 0.0f;
+  draw.depth = length(draw.center - eye);
+  draw.id = -1;
+  return draw;
+}
+
+void FrameBuilder::frustumPlanes(const mat4 &clip, vec4 planes[6]) {
+  // from the rows of the matrix, normalised so the plane distance of a
+  // center can be compared with the radius
+  for (int i = 0; i < 3; ++i) {
+    vec4 row(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    vec4 w(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+    planes[i * 2] = w + row;
+    planes[i * 2 + 1] = w - row;
+  }
+  for (int i = 0; i < 6; ++i)
+    planes[i] = planes[i] * (1.0f / length(vec3(planes[i])));
+}
+
+bool FrameBuilder::sphereInFrustum(const vec4 planes[6], const vec3 &center,
+                                   float radius, float distance,
+                                   float sideMargin) {
+  // the side planes pass through the eye, turning them out by the margin
+  // moves them away from a center by distance * sin(margin)
+  for (int p = 0; p < 6; ++p) {
+    float reach = radius + (p < 4 ? sideMargin * distance : 0.0f);
+    if (dot(vec3(planes[p]), center) + planes[p].w < -reach)
+      return false;
+  }
+  return true;
+}
+
+void FrameBuilder::build(const vector<CelestialBody *> &bodies,
+                         const FrameInput &input, vector<BodyDraw> &out,
+                         vector<TextureRequest> &requests) {
+  double start = now();
+  int n = (int)bodies.size();
+  draws.resize(n);
+  texels.resize(n);
+  visible.resize(n);
+
+  vec4 planes[6];
+  frustumPlanes(input.projection * input.view, planes);
+  float sideMargin = sin(input.cullMargin);
+
+  // a sphere of d pixels shows half its equator across d, so the full map
+  // width needs about pi * d texels
+  const float pi = 3.14159265f;
+  float fovY = input.fovY;
+  float height = (float)input.lodHeight;
+
+  pool.parallelFor(n, minBodiesPerTask, [&](int, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const CelestialBody &body = *bodies[i];
+      BodyDraw &draw = draws[i];
+      draw = makeDraw(body, input.eye);
+      draw.id = i;
+
+      visible[i] = sphereInFrustum(planes, draw.center, draw.radius,
+                                   draw.depth, sideMargin);
+
+      float size = body.getScreenSize(input.eye, fovY, height);
+      float fade =
+          1.0f - (size - input.impostorThreshold) / input.impostorFadeBand;
+      draw.fade = fade < 0.0f ? 0.0f : (fade > 1.0f ? 1.0f : fade);
+      texels[i] = pi * size;
+    }
+  });
+
+  size_t first = out.size();
+  for (int i = 0; i < n; ++i) {
+    if (!visible[i])
+      continue;
+    out.push_back(draws[i]);
+    if (draws[i].texture) {
+      TextureRequest request;
+      request.texture = draws[i].texture;
+      request.texels = texels[i];
+      requests.push_back(request);
+    }
+  }
+
+  // front to back, so the depth test rejects hidden fragments early
+  sort(out.begin() + first, out.end(),
+       [](const BodyDraw &a, const BodyDraw &b) { return a.depth < b.depth; });
+
+  lastTime = now() - start;
+}
@@ -0,0 +1,104 @@
+#include "frame_uniforms.h"
+#include "clock.h"
+#include "memory.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+FrameUniforms::FrameUniforms(int framesInFlight)
+    : UBO(0), current(0), latency(0.0), waitTime(0.0) {
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  alignment = max(alignment, 1);
+  slotStride = ((sizeof(Block) + alignment - 1) / alignment) * alignment;
+
+  Slot empty = {nullptr, 0.0};
+  slots.assign(max(framesInFlight, 1), empty);
+
+  glGenBuffers(1, &UBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+  glBufferData(GL_UNIFORM_BUFFER, slotStride * slots.size(), NULL,
+               GL_DYNAMIC_DRAW);
+  MemoryTracker::trackBuffer(UBO, MEMORY_TRANSFER, slotStride * slots.size());
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+FrameUniforms::~FrameUniforms() {
+  for (auto &slot : slots) {
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+  }
+  glDeleteBuffers(1, &UBO);
+  MemoryTracker::releaseBuffer(UBO);
+}
+
+void FrameUniforms::retire(Slot &slot, double time) {
+  latency = time - slot.sampleTime;
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+}
+
+// notices finished frames without blocking, so the latency is measured close
+// to when the gpu actually got there rather than when the slot is reused
+void FrameUniforms::poll() {
+  // the slot about to be written holds the oldest frame
+  for (size_t i = 0; i < slots.size(); ++i) {
+    Slot &slot = slots[(current + i) % slots.size()];
+    if (!slot.fence)
+      continue;
+
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      break; // later frames can't have finished either
+    retire(slot, now());
+  }
+}
+
+void FrameUniforms::acquire() {
+  poll();
+
+  Slot &slot = slots[current];
+  waitTime = 0.0;
+  if (!slot.fence)
+    return;
+
+  double start = now();
+  GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+  while (true) {
+    GLenum status = glClientWaitSync(slot.fence, flags, 1000000); // 1 ms
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+      break;
+    if (status == GL_WAIT_FAILED)
+      break; // lost context, don't spin forever
+    flags = 0;
+  }
+  double end = now();
+  waitTime = end - start;
+  retire(slot, end);
+}
+
+void FrameUniforms::latch(const mat4 &view, const mat4 &projection,
+                          const vec3 &viewPos, double sampleTime) {
+  Block block;
+  block.view = view;
+  block.projection = projection;
+  block.viewPos = vec4(viewPos, 1.0f);
+
+  GLintptr offset = slotStride * current;
+  glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(Block), &block);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, UBO, offset, sizeof(Block));
+
+  slots[current].sampleTime = sampleTime;
+}
+
+void FrameUniforms::submit() {
+  Slot &slot = slots[current];
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  current = (current + 1) % slots.size();
+
+  // the previous frame may well be done by now
+  poll();
+}
@@ -0,0 +1,73 @@
+#include "framebuffer.h"
+#include "gl_state.h"
+#include "memory.h"
+#include <iostream>
+
+using namespace std;
+
+Framebuffer::Framebuffer(int w, int h)
+    : width(w), height(h), ID(0), colorTexture(0), depthBuffer(0) {
+  create();
+}
+
+Framebuffer::~Framebuffer() { destroy(); }
+
+void Framebuffer::create() {
+  glGenFramebuffers(1, &ID);
+  glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+  // color attachment is a texture so it can be sampled or read back
+  glGenTextures(1, &colorTexture);
+  GLState::bindTexture(GL_TEXTURE_2D, colorTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  MemoryTracker::trackTexture(colorTexture, MEMORY_TARGETS,
+                              (size_t)width * height * 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         colorTexture, 0);
+
+  // depth is never sampled, a renderbuffer is enough
+  glGenRenderbuffers(1, &depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  MemoryTracker::trackRenderbuffer(depthBuffer, MEMORY_TARGETS,
+                                   (size_t)width * height * 4);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, depthBuffer);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    cerr << "Framebuffer is not complete (" << width << "x" << height << ")"
+         << endl;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::destroy() {
+  glDeleteFramebuffers(1, &ID);
+  GLState::deleteTextures(1, &colorTexture);
+  glDeleteRenderbuffers(1, &depthBuffer);
+  MemoryTracker::releaseTexture(colorTexture);
+  MemoryTracker::releaseRenderbuffer(depthBuffer);
+}
+
+void Framebuffer::resize(int w, int h) {
+  if (w == width && h == height)
+    return;
+
+  destroy();
+  width = w;
+  height = h;
+  create();
+}
+
+void Framebuffer::bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, ID);
+  glViewport(0, 0, width, height);
+}
+
+void Framebuffer::unbind() const { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
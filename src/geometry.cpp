@@ -0,0 +1,138 @@
+#include "body.h"
+#include "ring.h"
+#include <cmath>
+
+// cpu-side mesh generators. kept apart from the classes' gl code so that
+// tools/meshgen and the benchmarks can link them without a gl context
+
+#define PI 3.14159265358979323846
+
+using namespace std;
+using namespace glm;
+
+Vertex *CelestialBody::createSphereVertices(vec3 center, float radius,
+                                            int stackCount, int sectorCount,
+                                            int &vertexCount) {
+  // creates sphere vertices in object space (centered at origin)
+  // these will later be transformed to world space using the model matrix
+  vertexCount = (stackCount + 1) * (sectorCount + 1);
+  Vertex *vertices = new Vertex[vertexCount];
+
+  float sectorStep = 2.0f * PI / sectorCount;
+  float stackStep = PI / stackCount;
+
+  int index = 0;
+
+  for (int i = 0; i <= stackCount; ++i) {
+    float stackAngle = PI / 2.0f - i * stackStep;
+    float xy = radius * cosf(stackAngle);
+    float z = radius * sinf(stackAngle);
+
+    for (int j = 0; j <= sectorCount; ++j) {
+      float sectorAngle = j * sectorStep;
+      float x = xy * cosf(sectorAngle);
+      float y = xy * sinf(sectorAngle);
+
+      float px = center.x + x;
+      float py = center.y + y;
+      float pz = center.z + z;
+
+      float nx = x / radius;
+      float ny = y / radius;
+      float nz = z / radius;
+
+      vertices[index++] = {px, py, pz, nx, ny, nz};
+    }
+  }
+
+  return vertices;
+}
+
+unsigned int *CelestialBody::createSphereIndices(int stackCount,
+                                                 int sectorCount,
+                                                 int &indexCount) {
+  indexCount = stackCount * sectorCount * 6;
+  unsigned int *indices = new unsigned int[indexCount];
+
+  int index = 0;
+
+  for (int i = 0; i < stackCount; ++i) {
+    int k1 = i * (sectorCount + 1);
+    int k2 = k1 + sectorCount + 1;
+
+    for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
+      if (i != 0) {
+        indices[index++] = k1;
+        indices[index++] = k2;
+        indices[index++] = k1 + 1;
+      }
+
+      if (i != (stackCount - 1)) {
+        indices[index++] = k1 + 1;
+        indices[index++] = k2;
+        indices[index++] = k2 + 1;
+      }
+    }
+  }
+
+  indexCount = index;
+  return indices;
+}
+
+void Ring::createRingGeometry(float innerRad, float outerRad, int segments,
+                              float *&vertices, int &vertexCount,
+                              unsigned int *&indices, int &idxCount) {
+  // Each vertex has: position (3) + normal (3) + texCoords (2) = 8 floats
+  // We create 2 rings of vertices (inner and outer)
+  vertexCount = (segments + 1) * 2;
+  vertices = new float[vertexCount * 8];
+
+  float angleStep = 2.0f * PI / segments;
+  int vIndex = 0;
+
+  for (int i = 0; i <= segments; ++i) {
+    float angle = i * angleStep;
+    float cosA = cosf(angle);
+    float sinA = sinf(angle);
+
+    // Inner vertex
+    vertices[vIndex++] = innerRad * cosA;     // x
+    vertices[vIndex++] = 0.0f;                // y
+    vertices[vIndex++] = innerRad * sinA;     // z
+    vertices[vIndex++] = 0.0f;                // nx
+    vertices[vIndex++] = 1.0f;                // ny
+    vertices[vIndex++] = 0.0f;                // nz
+    vertices[vIndex++] = 0.0f;                // u (inner edge)
+    vertices[vIndex++] = (float)i / segments; // v
+
+    // Outer vertex
+    vertices[vIndex++] = outerRad * cosA;     // x
+    vertices[vIndex++] = 0.0f;                // y
+    vertices[vIndex++] = outerRad * sinA;     // z
+    vertices[vIndex++] = 0.0f;                // nx
+    vertices[vIndex++] = 1.0f;                // ny
+    vertices[vIndex++] = 0.0f;                // nz
+    vertices[vIndex++] = 1.0f;                // u (outer edge)
+    vertices[vIndex++] = (float)i / segments; // v
+  }
+
+  // Create indices for triangles
+  idxCount = segments * 6; // 2 triangles per segment
+  indices = new unsigned int[idxCount];
+  int idx = 0;
+
+  for (int i = 0; i < segments; ++i) {
+    int current = i * 2;
+    int next = (i + 1) * 2;
+
+    // First triangle (counter-clockwise from top)
+    indices[idx++] = current;
+    indices[idx++] = current + 1;
+    indices[idx++] = next;
+
+    // Second triangle
+    indices[idx++] = current + 1;
+    indices[idx++] = next + 1;
+    indices[idx++] = next;
+  }
+}
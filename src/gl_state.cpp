@@ -0,0 +1,193 @@
+#include "gl_state.h"
+
+// invalidated state never matches, so the next call of each kind is issued
+static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+
+// the defaults of a fresh context, all capabilities off and nothing bound
+bool GLState::caching = true;
+unsigned int GLState::program = 0;
+unsigned int GLState::vertexArray = 0;
+unsigned int GLState::activeUnit = 0;
+unsigned int GLState::textures[TEXTURE_UNITS][TARGET_COUNT];
+int GLState::capabilities[CAP_COUNT];
+GLenum GLState::blendSource = GL_ONE;
+GLenum GLState::blendDestination = GL_ZERO;
+int GLState::depthWrite = 1;
+GLenum GLState::depthCompare = GL_LESS;
+unsigned long GLState::issued = 0;
+unsigned long GLState::elided = 0;
+unsigned long GLState::lastIssued = 0;
+unsigned long GLState::lastElided = 0;
+
+bool GLState::changes(bool differs) {
+  if (differs || !caching) {
+    ++issued;
+    return true;
+  }
+  ++elided;
+  return false;
+}
+
+int GLState::textureTarget(GLenum target) {
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return TARGET_2D;
+  case GL_TEXTURE_CUBE_MAP:
+    return TARGET_CUBE_MAP;
+  case GL_TEXTURE_BUFFER:
+    return TARGET_BUFFER;
+  }
+  return -1;
+}
+
+int GLState::capabilityIndex(GLenum cap) {
+  switch (cap) {
+  case GL_BLEND:
+    return CAP_BLEND;
+  case GL_DEPTH_TEST:
+    return CAP_DEPTH_TEST;
+  case GL_CULL_FACE:
+    return CAP_CULL_FACE;
+  case GL_PROGRAM_POINT_SIZE:
+    return CAP_PROGRAM_POINT_SIZE;
+  case GL_RASTERIZER_DISCARD:
+    return CAP_RASTERIZER_DISCARD;
+  }
+  return -1;
+}
+
+void GLState::useProgram(unsigned int id) {
+  if (changes(id != program)) {
+    glUseProgram(id);
+    program = id;
+  }
+}
+
+void GLState::bindVertexArray(unsigned int id) {
+  if (changes(id != vertexArray)) {
+    glBindVertexArray(id);
+    vertexArray = id;
+  }
+}
+
+void GLState::activeTexture(unsigned int unit) {
+  if (changes(unit != activeUnit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    activeUnit = unit;
+  }
+}
+
+void GLState::bindTexture(GLenum target, unsigned int id) {
+  int index = textureTarget(target);
+  if (index < 0 || activeUnit >= (unsigned int)TEXTURE_UNITS) {
+    ++issued;
+    glBindTexture(target, id);
+    return;
+  }
+  unsigned int &bound = textures[activeUnit][index];
+  if (changes(id != bound)) {
+    glBindTexture(target, id);
+    bound = id;
+  }
+}
+
+void GLState::setCapability(GLenum cap, bool enabled) {
+  int index = capabilityIndex(cap);
+  if (index >= 0 && !changes(capabilities[index] != (int)enabled))
+    return;
+  if (index < 0)
+    ++issued;
+
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  if (index >= 0)
+    capabilities[index] = enabled;
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination) {
+  if (changes(source != blendSource || destination != blendDestination)) {
+    glBlendFunc(source, destination);
+    blendSource = source;
+    blendDestination = destination;
+  }
+}
+
+void GLState::depthMask(bool write) {
+  if (changes(depthWrite != (int)write)) {
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    depthWrite = write;
+  }
+}
+
+void GLState::depthFunc(GLenum compare) {
+  if (changes(compare != depthCompare)) {
+    glDepthFunc(compare);
+    depthCompare = compare;
+  }
+}
+
+void GLState::setOpaque() {
+  setCapability(GL_DEPTH_TEST, true);
+  depthFunc(GL_LESS);
+  depthMask(true);
+  setCapability(GL_BLEND, false);
+}
+
+void GLState::setBlended(GLenum source, GLenum destination,
+                         bool depthWrite) {
+  setCapability(GL_DEPTH_TEST, true);
+  depthFunc(GL_LESS);
+  depthMask(depthWrite);
+  setCapability(GL_BLEND, true);
+  blendFunc(source, destination);
+}
+
+void GLState::deleteVertexArrays(int count, const unsigned int *ids) {
+  for (int i = 0; i < count; ++i) {
+    if (ids[i] == vertexArray)
+      vertexArray = 0;
+  }
+  glDeleteVertexArrays(count, ids);
+}
+
+void GLState::deleteTextures(int count, const unsigned int *ids) {
+  for (int i = 0; i < count; ++i) {
+    for (int unit = 0; unit < TEXTURE_UNITS; ++unit) {
+      for (int target = 0; target < TARGET_COUNT; ++target) {
+        if (ids[i] == textures[unit][target])
+          textures[unit][target] = 0;
+      }
+    }
+  }
+  glDeleteTextures(count, ids);
+}
+
+void GLState::invalidate() {
+  program = UNKNOWN;
+  vertexArray = UNKNOWN;
+  activeUnit = UNKNOWN;
+  for (int unit = 0; unit < TEXTURE_UNITS; ++unit) {
+    for (int target = 0; target < TARGET_COUNT; ++target)
+      textures[unit][target] = UNKNOWN;
+  }
+  for (int i = 0; i < CAP_COUNT; ++i)
+    capabilities[i] = -1;
+  blendSource = UNKNOWN;
+  blendDestination = UNKNOWN;
+  depthWrite = -1;
+  depthCompare = UNKNOWN;
+}
+
+void GLState::setCaching(bool enabled) {
+  caching = enabled;
+  invalidate();
+}
+
+void GLState::endFrame() {
+  lastIssued = issued;
+  lastElided = elided;
+  issued = 0;
+  elided = 0;
+}
@@ -0,0 +1,56 @@
+#include "gpu_timer.h"
+#include <GL/glew.h>
+
+GpuTimer::GpuTimer() : queryIndex(0), timing(false), time(0.0) {
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    glGenQueries(2, queries[i]);
+    queryPending[i] = false;
+  }
+}
+
+GpuTimer::~GpuTimer() {
+  for (int i = 0; i < QUERY_COUNT; ++i)
+    glDeleteQueries(2, queries[i]);
+}
+
+void GpuTimer::collectQueries() {
+  // queries finish in submission order, starting with the oldest slot
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    int slot = (queryIndex + i) % QUERY_COUNT;
+    if (!queryPending[slot])
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available)
+      break;
+
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+    queryPending[slot] = false;
+
+    double elapsed = (end - start) * 1e-9;
+    if (time == 0.0)
+      time = elapsed;
+    else
+      time += (elapsed - time) * 0.2;
+  }
+}
+
+void GpuTimer::begin() {
+  collectQueries();
+  timing = !queryPending[queryIndex];
+  if (timing)
+    glQueryCounter(queries[queryIndex][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end() {
+  if (!timing)
+    return;
+  glQueryCounter(queries[queryIndex][1], GL_TIMESTAMP);
+  queryPending[queryIndex] = true;
+  queryIndex = (queryIndex + 1) % QUERY_COUNT;
+  timing = false;
+}
@@ -0,0 +1,121 @@
+#include "impostor.h"
+#include "gl_state.h"
+#include "memory.h"
+#include <algorithm>
+#include <cstddef>
+
+using namespace std;
+using namespace glm;
+
+ImpostorRenderer::ImpostorRenderer() : capacity(0), drawCalls(0) {
+  // one quad, expanded around each body in the vertex shader
+  const float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &quadVBO);
+  glGenBuffers(1, &instanceVBO);
+
+  GLState::bindVertexArray(VAO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(quadVBO, MEMORY_GEOMETRY, sizeof(corners));
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
+                        (void *)0);
+  glEnableVertexAttribArray(0);
+
+  // per instance: sphere, params and the three material colors
+  for (int i = 1; i <= 5; ++i) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+
+  GLState::bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ImpostorRenderer::~ImpostorRenderer() {
+  GLState::deleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &quadVBO);
+  glDeleteBuffers(1, &instanceVBO);
+  MemoryTracker::releaseBuffer(quadVBO);
+  MemoryTracker::releaseBuffer(instanceVBO);
+}
+
+void ImpostorRenderer::add(const BodyDraw &draw) {
+  Queued entry;
+  entry.texture = draw.texture;
+  entry.instance.sphere = vec4(draw.center, draw.radius);
+  entry.instance.params = vec4(draw.rotation, draw.fade, draw.shininess, 0.0f);
+  entry.instance.ka = draw.ka;
+  entry.instance.kd = draw.kd;
+  entry.instance.ks = draw.ks;
+  queued.push_back(entry);
+}
+
+// gl 3.3 has no base instance, so each texture's run is reached by moving
+// the instanced attributes to its first element
+void ImpostorRenderer::setInstanceOffset(size_t first) {
+  const GLsizei stride = sizeof(Instance);
+  const char *base = (const char *)(first * sizeof(Instance));
+
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                        base + offsetof(Instance, sphere));
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride,
+                        base + offsetof(Instance, params));
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride,
+                        base + offsetof(Instance, ka));
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride,
+                        base + offsetof(Instance, kd));
+  glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, stride,
+                        base + offsetof(Instance, ks));
+}
+
+void ImpostorRenderer::render(Shader &shader) {
+  drawCalls = 0;
+  if (queued.empty())
+    return;
+
+  // group by texture, one draw per group
+  stable_sort(queued.begin(), queued.end(),
+              [](const Queued &a, const Queued &b) {
+                return a.texture < b.texture;
+              });
+  instances.clear();
+  for (const Queued &entry : queued)
+    instances.push_back(entry.instance);
+
+  if (instances.size() > capacity) {
+    capacity = max(instances.size(), capacity * 2);
+    MemoryTracker::trackBuffer(instanceVBO, MEMORY_INSTANCES,
+                               capacity * sizeof(Instance));
+  }
+
+  // orphan the old contents, the previous frame may still read them
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Instance), NULL,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance),
+                  instances.data());
+
+  shader.use();
+  shader.setInt("texture1", 0);
+  GLState::bindVertexArray(VAO);
+
+  size_t first = 0;
+  while (first < queued.size()) {
+    size_t last = first + 1;
+    while (last < queued.size() && queued[last].texture == queued[first].texture)
+      ++last;
+
+    setInstanceOffset(first);
+    queued[first].texture->bind(0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)(last - first));
+    ++drawCalls;
+    first = last;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  queued.clear();
+}
@@ -1,31 +1,66 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <fstream>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 
+#include "approach.h"
+#include "arena.h"
+#include "belt.h"
 #include "body.h"
 #include "camera.h"
+#include "catalog.h"
+#include "clock.h"
+#include "ephemeris.h"
 #include "config.h"
+#include "exporter.h"
+#include "frame_builder.h"
+#include "frame_packet.h"
+#include "frame_uniforms.h"
+#include "framebuffer.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "impostor.h"
+#include "memory.h"
+#include "occlusion.h"
 #include "orbit.h"
+#include "picking.h"
+#include "profiler.h"
+#include "resolution.h"
 #include "ring.h"
+#include "ring_particles.h"
 #include "shader.h"
+#include "starfield.h"
+#include "streamer.h"
+#include "terrain.h"
 #include "texture.h"
+#include "thread_pool.h"
+#include "trail.h"
 
 using namespace std;
 using namespace glm;
 
 bool drawOrbits = false;
+bool drawTrails = true;
+float impostorThreshold = IMPOSTOR_THRESHOLD;
 
 Camera camera(CAMERA_START_POSITION);
 float lastX = INITIAL_WINDOW_WIDTH / 2.0f;
 float lastY = INITIAL_WINDOW_HEIGHT / 2.0f;
 bool firstMouse = true;
 bool hKeyPressed = false;
+bool rKeyPressed = false;
+bool tKeyPressed = false;
+bool bracketKeyPressed = false;
+bool toggleDynamicResolution = false;
+bool pickRequested = false;
 
 int currentWidth = INITIAL_WINDOW_WIDTH;
 int currentHeight = INITIAL_WINDOW_HEIGHT;
@@ -35,25 +70,169 @@ float lastFrame = 0.0f;
 
 vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-struct PlanetData {
-  string name;
-  float orbitSpeed;
-  float orbitRadius;
-  float size;
-  string texture;
-  float rotationSpeed;
-  string type;
+struct ExportOptions {
+  string outputDir;
+  int width;
+  int height;
+  int frames;
+  ExportFormat format;
+  string contextApi; // "egl", "osmesa" or empty for a hidden window
+};
+
+// the passes of renderScene in draw order, fragments are counted per pass
+enum RenderPass {
+  PASS_BODIES,  // sun, planets, moon and impostors, front to back
+  PASS_BELT,
+  PASS_SKY,     // background and stars, behind everything drawn so far
+  PASS_BLENDED, // orbits, trails and rings
+  PASS_COUNT
+};
+const char *PASS_NAMES[PASS_COUNT] = {"bodies", "belt", "sky", "blended"};
+
+struct EphemerisOptions {
+  string outputPath; // write an ephemeris here and exit
+  double years;
+  double stepHours;
+  unsigned int threads;
+  string playbackPath; // play the bodies back from this ephemeris
+};
+
+// everything drawn each frame, loaded once and shared by both run modes
+struct Scene {
+  TextureStreamer streamer;
+
+  Shader lightShader;
+  Shader colorShader;
+  Shader textureShader;
+  Shader orbitShader;
+  Shader ringShader;
+  Shader beltCullShader;
+  Shader beltShader;
+  Shader trailShader;
+  Shader ringParticleShader;
+  Shader impostorShader;
+  Shader starShader;
+  Shader skyShader; // the texture shader pinned to the far plane
+
+  // owns the planets, orbits, rings and renderers created at load time.
+  // declared before everything that may point into it, so it goes last
+  Arena arena;
+
+  // point stars over a low resolution glow when the catalog loads, the full
+  // star texture otherwise. the load cost of both is reported at startup
+  StarField *stars;
+  double skyLoadTime;  // seconds to load the background texture
+  size_t skyLoadBytes; // texture bytes tracked for it after loading
+  GpuTimer skyTimer;   // background and stars
+
+  // samples that passed the depth test in each pass, and the occlusion tests
+  // of the bodies pass
+  FragmentCounter passFragments[PASS_COUNT];
+  OcclusionCuller occlusion;
+
+  CelestialBody sun;
+  CelestialBody background;
+  CelestialBody moon;
+
+  Pool<CelestialBody> planets;
+  Pool<Orbit> orbits; // one per planet, same order
+  Orbit *moonOrbit;
+  Handle<CelestialBody> earth; // into planets
+  Handle<CelestialBody> saturn;
+  Ring *saturnRings;
+  RingParticles *saturnParticles; // close-up lod of saturnRings
+  AsteroidBelt belt;
+
+  // lit bodies are drawn as meshes, impostors or both while cross-fading,
+  // unlit ones (the sun) always as meshes
+  vector<CelestialBody *> litBodies;
+  vector<CelestialBody *> unlitBodies;
+  ImpostorRenderer impostors;
+  TerrainRenderer *terrain; // close-up lod of lit bodies, null if disabled
+  int meshDraws;     // bodies drawn with the mesh last frame
+  int impostorDraws; // bodies drawn as impostors last frame
+  int terrainDraws;  // bodies drawn as terrain chunks last frame
+
+  // trail ids match the index into trailBodies
+  TrailRenderer trails;
+  vector<CelestialBody *> trailBodies;
+  // simulation time, drives the belt orbits on the gpu and the ephemeris
+  // playback. double so a long run does not drift from accumulating dt
+  double elapsed;
+
+  // close approaches between pickBodies, event ids index pickNames
+  ApproachDetector approaches;
+  vector<vec3> approachPositions;
+  vector<float> approachRadii;
+
+  // bodies and rings under the cursor, ids index pickNames
+  BodyBVH picker;
+  // saturn's ring as built into the picker. the ring doesn't spin, so only
+  // its center moves after loading
+  BodyBVH::Primitive ringPick;
+  vector<CelestialBody *> pickBodies;
+  vector<string> pickNames;
+
+  // turns the bodies into the draws of a frame packet
+  FrameBuilder builder;
+
+  // when open, body positions come from the file instead of the orbits.
+  // playbackBodies maps pickBodies to file bodies, -1 for live ones
+  EphemerisReader playback;
+  vector<int> playbackBodies;
+  vector<vec3> playbackPositions;
+
+  Scene();
 };
 
-vector<PlanetData> loadPlanetsFromCSV(const string &filepath);
 GLFWwindow *initWindow(int width, int height, const char *title);
+GLFWwindow *initOffscreenContext(const string &contextApi);
 bool initGLEW();
+bool parseOptions(int argc, char **argv, ExportOptions &options,
+                  EphemerisOptions &ephemeris);
+int runInteractive(const string &playbackPath);
+int runExport(const ExportOptions &options, const string &playbackPath);
+int runEphemeris(const EphemerisOptions &options);
+FrameInput sampleInput(float dt, const DynamicResolution &resolution);
+FrameInput flythroughInput(int frame, float dt, const ExportOptions &options);
+bool turnedWithin(const mat4 &a, const mat4 &b, float angle);
+void prepareFrame(Scene &scene, const FrameInput &input, FramePacket &packet);
+void uploadFrame(Scene &scene, const FramePacket &packet, float viewportWidth,
+                 float viewportHeight, bool complete);
+void updateScene(Scene &scene, float dt);
+void reportApproaches(Scene &scene);
+void reportSky(const Scene &scene);
+void reportSceneLoad(const Scene &scene);
+void openPlayback(Scene &scene, const string &path);
+void setMemoryBudgets();
+void reportMemoryWarnings();
+void buildPicker(Scene &scene);
+void updatePicker(Scene &scene);
+void renderScene(Scene &scene, const FramePacket &packet, float viewportHeight);
 void framebufferSizeCallback(GLFWwindow *window, int width, int height);
 void mouseCallback(GLFWwindow *window, double xpos, double ypos);
 void scrollCallback(GLFWwindow *window, double xoffset, double yoffset);
+void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods);
 void processInput(GLFWwindow *window);
 
-int main() {
+int main(int argc, char **argv) {
+  setMemoryBudgets();
+
+  ExportOptions exportOptions;
+  EphemerisOptions ephemerisOptions;
+  bool exportRequested =
+      parseOptions(argc, argv, exportOptions, ephemerisOptions);
+  if (!ephemerisOptions.outputPath.empty()) {
+    return runEphemeris(ephemerisOptions);
+  }
+  if (exportRequested) {
+    return runExport(exportOptions, ephemerisOptions.playbackPath);
+  }
+
+  return runInteractive(ephemerisOptions.playbackPath);
+}
+
+int runInteractive(const string &playbackPath) {
 
   GLFWwindow *window =
       initWindow(INITIAL_WINDOW_WIDTH, INITIAL_WINDOW_HEIGHT, "Solar System");
@@ -66,29 +245,436 @@ int main() {
     return -1;
   }
 
-  glEnable(GL_DEPTH_TEST);
+  GLState::setCaching(GL_STATE_CACHE);
+  GLState::setCapability(GL_DEPTH_TEST, true);
+  // cubemaps filter across face edges instead of clamping at each one
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+  {
+    Scene scene;
+    reportSky(scene);
+    reportSceneLoad(scene);
+    openPlayback(scene, playbackPath);
+    Profiler profiler(PROFILER_REPORT_INTERVAL);
+    DynamicResolution resolution(
+        currentWidth, currentHeight, DYNAMIC_RESOLUTION_TARGET,
+        DYNAMIC_RESOLUTION_MIN_SCALE, DYNAMIC_RESOLUTION_STEP,
+        DYNAMIC_RESOLUTION_HYSTERESIS, DYNAMIC_RESOLUTION_SETTLE_FRAMES);
+    resolution.setEnabled(DYNAMIC_RESOLUTION);
+    FrameUniforms frameUniforms(MAX_FRAMES_IN_FLIGHT);
+
+    // with pipelining, frame n + 1 is prepared on the frame thread while this
+    // thread submits frame n. each packet is written by one side and only
+    // read by the other
+    ThreadPool frameThread(1);
+    FramePacket packets[2];
+    int current = 0;
+    if (RENDER_PIPELINING) {
+      prepareFrame(scene, sampleInput(0.0f, resolution), packets[current]);
+    }
+
+    while (!glfwWindowShouldClose(window)) {
+
+      float currentFrame = static_cast<float>(glfwGetTime());
+      deltaTime = currentFrame - lastFrame;
+      lastFrame = currentFrame;
+      profiler.beginFrame(currentFrame);
 
-  Shader lightShader("shaders/light_vs.glsl", "shaders/light_fs.glsl");
-  Shader colorShader("shaders/colors_vs.glsl", "shaders/colors_fs.glsl");
-  Shader textureShader("shaders/texture_vs.glsl", "shaders/texture_fs.glsl");
-  Shader orbitShader("shaders/orbit_vs.glsl", "shaders/orbit_fs.glsl");
-  Shader ringShader("shaders/ring_vs.glsl", "shaders/ring_fs.glsl");
+      if (toggleDynamicResolution) {
+        toggleDynamicResolution = false;
+        resolution.setEnabled(!resolution.isEnabled());
+        cout << "Dynamic resolution "
+             << (resolution.isEnabled() ? "on" : "off") << endl;
+      }
+
+      // late latch: wait until the driver has room for this frame, then
+      // sample input. without pipelining it goes into this frame, with
+      // pipelining the simulation and culling use it for the next one, but
+      // the camera of this frame is still latched from it below
+      frameUniforms.acquire();
+      glfwPollEvents();
+      processInput(window);
+      FrameInput input = sampleInput(deltaTime, resolution);
+
+      int next = 1 - current;
+      future<void> preparing;
+      if (RENDER_PIPELINING) {
+        preparing = frameThread.submit([&scene, &packets, next, input]() {
+          prepareFrame(scene, input, packets[next]);
+        });
+      } else {
+        prepareFrame(scene, input, packets[current]);
+      }
+
+      const FramePacket &packet = packets[current];
+      double submitStart = glfwGetTime();
+
+      // binds the scaled target, so the texture lod follows the render size
+      resolution.begin(packet.input.width, packet.input.height);
+      uploadFrame(scene, packet, (float)resolution.getRenderWidth(),
+                  (float)resolution.getRenderHeight(), false);
+      profiler.set("tex MB", scene.streamer.getResidentBytes() / 1048576.0);
+      profiler.set("tex queue", (double)scene.streamer.getQueueDepth());
+
+      // the clear obeys the depth mask, which the last pass may have left off
+      GLState::depthMask(true);
+      glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      // the camera sampled this iteration, so pipelining adds no latency to
+      // looking around. after a resize the projection has to match the
+      // viewport the packet was built for, and after a turn past the cull
+      // margin bodies at the edges would be missing, so those frames keep
+      // the packet's camera
+      const FrameInput &latest =
+          input.width == packet.input.width &&
+                  input.height == packet.input.height &&
+                  turnedWithin(packet.input.view, input.view,
+                               packet.input.cullMargin)
+              ? input
+              : packet.input;
+      frameUniforms.latch(latest.view, latest.projection, latest.eye,
+                          latest.sampleTime);
+
+      renderScene(scene, packet, (float)resolution.getRenderHeight());
+
+      resolution.end();
+      profiler.set("res %", resolution.getScale() * 100.0);
+      profiler.set("gpu ms", resolution.getGpuTime() * 1000.0);
+      string decision = resolution.takeDecision();
+      if (!decision.empty())
+        profiler.note(decision);
+      profiler.add("submit ms", (glfwGetTime() - submitStart) * 1000.0);
+
+      glfwSwapBuffers(window);
+      frameUniforms.submit();
+      GLState::endFrame();
+
+      if (packet.picked) {
+        cout << "Picked " << packet.pickedName << " at distance "
+             << packet.pickedDistance << endl;
+      }
+
+      // input sampled -> gpu done with the frame, the display adds up to one
+      // refresh on top of this
+      profiler.add("latency ms", frameUniforms.getLatency() * 1000.0);
+      profiler.add("prepare ms", packet.prepareTime * 1000.0);
+      profiler.add("build ms", packet.buildTime * 1000.0);
+      profiler.add("approach ms", packet.approachTime * 1000.0);
+      profiler.set("culled", packet.culledCount);
+      profiler.set("belt drawn", scene.belt.getDrawnCount());
+      profiler.set("belt culled", scene.belt.getCulledCount());
+      profiler.set("mesh bodies", scene.meshDraws);
+      profiler.set("impostors", scene.impostorDraws);
+      profiler.set("impostor calls", scene.impostors.getDrawCalls());
+      profiler.set("sky ms", scene.skyTimer.getTime() * 1000.0);
+      for (int pass = 0; pass < PASS_COUNT; ++pass) {
+        profiler.set(string(PASS_NAMES[pass]) + " kfrags",
+                     scene.passFragments[pass].getFragments() / 1000.0);
+      }
+      if (OCCLUSION_CULLING) {
+        profiler.set("occlusion tests", scene.occlusion.getTestedCount());
+        profiler.set("occluded", scene.occlusion.getHiddenCount());
+      }
+      if (scene.stars)
+        profiler.set("stars", scene.stars->getDrawnCount());
+      if (GL_STATE_STATS) {
+        profiler.set("gl calls", (double)GLState::getIssuedCalls());
+        profiler.set("gl elided", (double)GLState::getElidedCalls());
+      }
+      if (scene.terrain) {
+        profiler.set("terrain bodies", scene.terrainDraws);
+        profiler.set("terrain chunks", scene.terrain->getDrawnChunks());
+        profiler.set("terrain queue", scene.terrain->getPendingChunks());
+        profiler.set("terrain MB",
+                     scene.terrain->getResidentBytes() / 1048576.0);
+      }
+      if (scene.saturnParticles) {
+        profiler.set("ring particles", scene.saturnParticles->getDrawnCount());
+        profiler.set("ring Mpart/s",
+                     scene.saturnParticles->getThroughput() / 1e6);
+      }
+      profiler.add("sync wait ms", frameUniforms.getWaitTime() * 1000.0);
 
-  CelestialBody sun(SUN_SIZE * PLANET_SIZE_SCALE, SUN_TEXTURE);
-  sun.setRotationSpeed(10.0f);
+      if (preparing.valid()) {
+        preparing.get();
+        current = next;
+      }
 
-  CelestialBody background(BACKGROUND_SIZE, BACKGROUND_TEXTURE);
+      reportApproaches(scene);
+      reportMemoryWarnings();
+      if (profiler.report(glfwGetTime()))
+        cout << "[memory] " << MemoryTracker::summary() << endl;
+    }
+  }
+
+  glfwTerminate();
+  return 0;
+}
+
+int runExport(const ExportOptions &options, const string &playbackPath) {
+  // before any rendering, a render node must not see a run of lost frames
+  if (!FrameExporter::createDirectory(options.outputDir)) {
+    cerr << "Cannot write to the output directory " << options.outputDir
+         << endl;
+    return -1;
+  }
+
+  GLFWwindow *window = initOffscreenContext(options.contextApi);
+  if (!window) {
+    return -1;
+  }
+
+  if (!initGLEW()) {
+    glfwTerminate();
+    return -1;
+  }
+
+  GLState::setCaching(GL_STATE_CACHE);
+  GLState::setCapability(GL_DEPTH_TEST, true);
+  // cubemaps filter across face edges instead of clamping at each one
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+  int framesFailed = 0;
+  {
+    Scene scene;
+    reportSky(scene);
+    reportSceneLoad(scene);
+    openPlayback(scene, playbackPath);
+    Framebuffer target(options.width, options.height);
+    FrameExporter exporter(options.width, options.height, options.outputDir,
+                           options.format, EXPORT_PBO_COUNT,
+                           EXPORT_ENCODER_THREADS);
+    FrameUniforms frameUniforms(EXPORT_PBO_COUNT);
+
+    // fixed time step so the same flythrough always produces the same frames
+    float dt = 1.0f / EXPORT_FRAME_RATE;
+    double startTime = glfwGetTime();
+    double beltDrawn = 0.0;
+    double ringParticlesDrawn = 0.0;
+    double meshDraws = 0.0, impostorDraws = 0.0, terrainDraws = 0.0;
+    double glCalls = 0.0, glElided = 0.0;
+
+    // same pipelining as the interactive loop, the camera path is known ahead
+    ThreadPool frameThread(1);
+    FramePacket packets[2];
+    int current = 0;
+    if (RENDER_PIPELINING && options.frames > 0) {
+      prepareFrame(scene, flythroughInput(0, dt, options), packets[current]);
+    }
+
+    for (int frame = 0; frame < options.frames; ++frame) {
+      int next = 1 - current;
+      future<void> preparing;
+      if (!RENDER_PIPELINING) {
+        prepareFrame(scene, flythroughInput(frame, dt, options),
+                     packets[current]);
+      } else if (frame + 1 < options.frames) {
+        FrameInput input = flythroughInput(frame + 1, dt, options);
+        preparing = frameThread.submit([&scene, &packets, next, input]() {
+          prepareFrame(scene, input, packets[next]);
+        });
+      }
+
+      // frames must come out complete, so wait for every requested tile
+      const FramePacket &packet = packets[current];
+      uploadFrame(scene, packet, (float)options.width, (float)options.height,
+                  true);
+
+      target.bind();
+      // the clear obeys the depth mask, which the last pass may have left off
+      GLState::depthMask(true);
+      glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      frameUniforms.acquire();
+      frameUniforms.latch(packet.input.view, packet.input.projection,
+                          packet.input.eye, packet.input.sampleTime);
+      renderScene(scene, packet, (float)options.height);
+      target.unbind();
+      beltDrawn += scene.belt.getDrawnCount();
+      if (scene.saturnParticles)
+        ringParticlesDrawn += scene.saturnParticles->getDrawnCount();
+      meshDraws += scene.meshDraws;
+      impostorDraws += scene.impostorDraws;
+      terrainDraws += scene.terrainDraws;
+
+      exporter.capture(target);
+      frameUniforms.submit();
+      GLState::endFrame();
+      glCalls += GLState::getIssuedCalls();
+      glElided += GLState::getElidedCalls();
+
+      if (preparing.valid()) {
+        preparing.get();
+        current = next;
+      }
+      reportApproaches(scene);
+      reportMemoryWarnings();
+    }
+
+    double submitTime = glfwGetTime() - startTime;
+    exporter.finish();
+    double totalTime = glfwGetTime() - startTime;
+
+    double megabytes = exporter.getBytesWritten() / (1024.0 * 1024.0);
+    cout << "Exported " << exporter.getFramesCaptured() << " frames at "
+         << options.width << "x" << options.height << " to "
+         << options.outputDir << endl;
+    cout << "  throughput: " << exporter.getFramesCaptured() / totalTime
+         << " frames/s (" << megabytes / totalTime << " MB/s), render loop "
+         << exporter.getFramesCaptured() / submitTime << " frames/s" << endl;
+    cout << "  readback stalls: " << exporter.getReadbackStalls() << endl;
+    if (exporter.getFramesFailed() > 0) {
+      cout << "  failed: " << exporter.getFramesFailed() << " of "
+           << exporter.getFramesCaptured() << " frames were not written"
+           << endl;
+    }
+    cout << "  peak memory: " << MemoryTracker::summary(true) << endl;
+    cout << "  sky: " << scene.skyTimer.getTime() * 1000.0
+         << " ms of gpu time" << endl;
+    cout << "  fragments per frame:";
+    for (int pass = 0; pass < PASS_COUNT; ++pass) {
+      cout << (pass ? ", " : " ") << PASS_NAMES[pass] << " "
+           << scene.passFragments[pass].getFragments() / 1000.0 << " k";
+    }
+    cout << endl;
+    if (OCCLUSION_CULLING) {
+      cout << "  occlusion: " << scene.occlusion.getHiddenCount() << " of "
+           << scene.occlusion.getTestedCount()
+           << " tested bodies hidden in the last frame" << endl;
+    }
+    if (options.frames > 0) {
+      double drawn = beltDrawn / options.frames;
+      cout << "  asteroid belt: " << drawn << " drawn, "
+           << scene.belt.getAsteroidCount() - drawn
+           << " culled per frame on average" << endl;
+      cout << "  bodies: " << meshDraws / options.frames << " meshes, "
+           << impostorDraws / options.frames << " impostors, "
+           << terrainDraws / options.frames
+           << " terrain per frame on average" << endl;
+      if (GL_STATE_STATS) {
+        cout << "  gl state: " << glCalls / options.frames << " calls issued, "
+             << glElided / options.frames
+             << " redundant ones elided per frame on average" << endl;
+      }
+      if (scene.saturnParticles) {
+        cout << "  ring particles: " << ringParticlesDrawn / options.frames
+             << " drawn per frame on average, "
+             << scene.saturnParticles->getThroughput() / 1e6
+             << " M particles/s of gpu time" << endl;
+      }
+    }
+    framesFailed = exporter.getFramesFailed();
+  }
+
+  glfwTerminate();
+  return framesFailed > 0 ? -1 : 0;
+}
+
+// null when the star field is off or the catalog cannot be read. a field
+// that failed to load holds no buffers and stays in the arena until reset
+static StarField *loadStars(Arena &arena) {
+  if (!STAR_FIELD)
+    return nullptr;
+
+  StarField *stars = arena.create<StarField>(
+      STAR_MAGNITUDE_LIMIT, radians(STAR_REFERENCE_FOV), STAR_MIN_SIZE,
+      STAR_MAX_SIZE, STAR_LIMIT_BRIGHTNESS);
+  if (!stars->load(STAR_CATALOG)) {
+    cerr << "Drawing the stars from " << BACKGROUND_TEXTURE
+         << " instead, run make to generate the catalog" << endl;
+    return nullptr;
+  }
+  return stars;
+}
+
+// shaders sampling the body and sky maps switch to direction lookups
+static string surfaceVariant() {
+  return CUBEMAP_TEXTURES ? "#define CUBEMAP\n" : "";
+}
+
+// the equirectangular maps of the bodies and the sky, streamed or as
+// cubemaps
+static Texture *loadSurface(TextureStreamer &streamer, const char *path) {
+  if (CUBEMAP_TEXTURES)
+    return streamer.loadCubemap(path, CUBEMAP_DIR, CUBEMAP_THREADS);
+  return streamer.load(path);
+}
+
+static Texture *loadSkyTexture(TextureStreamer &streamer, const char *path,
+                               double &seconds, size_t &bytes) {
+  size_t before = MemoryTracker::getBytes(MEMORY_TEXTURES) +
+                  MemoryTracker::getBytes(MEMORY_CPU_TEXTURES);
+  double start = glfwGetTime();
+  Texture *texture = loadSurface(streamer, path);
+  seconds = glfwGetTime() - start;
+  bytes = MemoryTracker::getBytes(MEMORY_TEXTURES) +
+          MemoryTracker::getBytes(MEMORY_CPU_TEXTURES) - before;
+  return texture;
+}
+
+// with streaming off every level is a fallback level: uploaded once, kept
+Scene::Scene()
+    : streamer(TEXTURE_STREAMING ? TEXTURE_BUDGET_BYTES : SIZE_MAX,
+               TEXTURE_TILE_SIZE,
+               TEXTURE_STREAMING ? TEXTURE_FALLBACK_SIZE : INT_MAX,
+               TEXTURE_TILES_PER_FRAME),
+      lightShader("shaders/light_vs.glsl", "shaders/light_fs.glsl",
+                  surfaceVariant()),
+      colorShader("shaders/colors_vs.glsl", "shaders/colors_fs.glsl"),
+      textureShader("shaders/texture_vs.glsl", "shaders/texture_fs.glsl",
+                    surfaceVariant()),
+      orbitShader("shaders/orbit_vs.glsl", "shaders/orbit_fs.glsl"),
+      ringShader("shaders/ring_vs.glsl", "shaders/ring_fs.glsl"),
+      beltCullShader("shaders/belt_cull_vs.glsl", "shaders/belt_cull_gs.glsl",
+                     vector<string>(1, "outInstance")),
+      beltShader("shaders/belt_vs.glsl", "shaders/belt_fs.glsl"),
+      trailShader("shaders/trail_vs.glsl", "shaders/trail_fs.glsl"),
+      ringParticleShader("shaders/ring_particles_vs.glsl",
+                         "shaders/ring_particles_fs.glsl"),
+      impostorShader("shaders/impostor_vs.glsl", "shaders/impostor_fs.glsl",
+                     surfaceVariant()),
+      starShader("shaders/stars_vs.glsl", "shaders/stars_fs.glsl"),
+      skyShader("shaders/texture_vs.glsl", "shaders/texture_fs.glsl",
+                surfaceVariant() + "#define SKY\n"),
+      arena(SCENE_ARENA_BLOCK), stars(loadStars(arena)), skyLoadTime(0.0),
+      skyLoadBytes(0),
+      sun(SUN_SIZE * PLANET_SIZE_SCALE, loadSurface(streamer, SUN_TEXTURE)),
+      background(BACKGROUND_SIZE,
+                 loadSkyTexture(streamer,
+                                stars ? STAR_GLOW_TEXTURE : BACKGROUND_TEXTURE,
+                                skyLoadTime, skyLoadBytes)),
+      moon(MOON_SIZE, loadSurface(streamer, MOON_TEXTURE)),
+      moonOrbit(nullptr), saturnRings(nullptr), saturnParticles(nullptr),
+      belt(BELT_ASTEROIDS, BELT_INNER_RADIUS, BELT_OUTER_RADIUS,
+           BELT_THICKNESS, BELT_MIN_SIZE, BELT_MAX_SIZE,
+           DISTANCE_SCALE * 100.0f, SPEED_SCALE),
+      terrain(nullptr), meshDraws(0), impostorDraws(0), terrainDraws(0),
+      trails(TRAIL_CAPACITY, TRAIL_LENGTH, TRAIL_SAMPLE_INTERVAL),
+      elapsed(0.0),
+      approaches(APPROACH_THREADS, APPROACH_MARGIN, APPROACH_BUDGET),
+      builder(FRAME_BUILD_THREADS, FRAME_BUILD_MIN_BODIES) {
+
+  Shader *shaders[] = {&lightShader, &colorShader, &textureShader,
+                       &orbitShader, &ringShader, &beltCullShader,
+                       &beltShader, &trailShader, &ringParticleShader,
+                       &impostorShader, &starShader, &skyShader};
+  for (Shader *shader : shaders) {
+    shader->bindUniformBlock("FrameData", FrameUniforms::BINDING);
+  }
+
+  sun.setRotationSpeed(SUN_ROTATION_SPEED);
 
   vector<PlanetData> planetsData =
       loadPlanetsFromCSV("assets/data/planets.csv");
-  vector<CelestialBody *> planets;
-  vector<Orbit *> orbits;
-  CelestialBody *earthPtr = nullptr;
-  CelestialBody *saturnPtr = nullptr;
 
+  planets.reserve(arena, planetsData.size());
+  orbits.reserve(arena, planetsData.size());
   for (const auto &planetData : planetsData) {
-    CelestialBody *planet = new CelestialBody(
-        planetData.size * PLANET_SIZE_SCALE, planetData.texture.c_str());
+    Handle<CelestialBody> handle =
+        planets.add(planetData.size * PLANET_SIZE_SCALE,
+                    loadSurface(streamer, planetData.texture.c_str()));
+    CelestialBody *planet = &planets[handle];
 
     planet->setOrbit(planetData.orbitRadius * DISTANCE_SCALE,
                      planetData.orbitSpeed * SPEED_SCALE);
@@ -101,128 +687,692 @@ int main() {
       planet->setMaterial(ROCKY_KA, ROCKY_KD, ROCKY_KS, ROCKY_SHININESS);
     }
 
-    planets.push_back(planet);
+    if (trails.addTrail(planetData.type == "gas" ? TRAIL_GAS_COLOR
+                                                 : TRAIL_ROCKY_COLOR) >= 0) {
+      trailBodies.push_back(planet);
+    }
 
-    Orbit *orbit =
-        new Orbit(planetData.orbitRadius * DISTANCE_SCALE * 100, ORBIT_COLOR);
-    orbits.push_back(orbit);
+    orbits.add(planetData.orbitRadius * DISTANCE_SCALE * 100, ORBIT_COLOR);
 
     if (planetData.name == "Earth") {
-      earthPtr = planet;
+      earth = handle;
     }
     if (planetData.name == "Saturn") {
-      saturnPtr = planet;
+      saturn = handle;
     }
   }
 
-  CelestialBody moon(MOON_SIZE, MOON_TEXTURE);
   moon.setOrbit(MOON_ORBIT_RADIUS, MOON_ORBIT_SPEED);
-  moon.setRotationSpeed(50.0f);
+  moon.setRotationSpeed(MOON_ROTATION_SPEED);
   moon.setMaterial(ROCKY_KA, ROCKY_KD, ROCKY_KS, ROCKY_SHININESS);
 
-  Orbit *moonOrbit = new Orbit(MOON_ORBIT_RADIUS * 100, ORBIT_COLOR);
+  moonOrbit = arena.create<Orbit>(MOON_ORBIT_RADIUS * 100, ORBIT_COLOR);
 
-  if (earthPtr) {
-    moon.setParent(earthPtr);
+  if (earth.valid()) {
+    moon.setParent(&planets[earth]);
+  }
+
+  if (trails.addTrail(TRAIL_MOON_COLOR) >= 0) {
+    trailBodies.push_back(&moon);
   }
 
   // Create Saturn's rings
-  Ring *saturnRings = nullptr;
-  if (saturnPtr) {
+  if (saturn.valid()) {
     // Saturn's rings: inner radius ~1.2x planet radius, outer radius ~2.3x
     // planet radius
     float saturnRadius = 9.45f * PLANET_SIZE_SCALE;
-    saturnRings = new Ring(saturnRadius * 1.2f, saturnRadius * 2.3f,
+    saturnRings =
+        arena.create<Ring>(saturnRadius * 1.2f, saturnRadius * 2.3f,
                            "assets/textures/2k_saturn_ring_alpha.png");
     saturnRings->setTilt(26.7f); // Saturn's axial tilt
+
+    saturnParticles = arena.create<RingParticles>(
+        RING_PARTICLES, saturnRings->getInnerRadius(),
+        saturnRings->getOuterRadius(), RING_PARTICLE_THICKNESS,
+        RING_PARTICLE_MIN_SIZE, RING_PARTICLE_MAX_SIZE, RING_PARTICLE_SPEED,
+        RING_PARTICLE_DISTANCE, RING_PARTICLE_BUDGET);
   }
 
-  while (!glfwWindowShouldClose(window)) {
+  for (CelestialBody &planet : planets) {
+    litBodies.push_back(&planet);
+  }
+  litBodies.push_back(&moon);
+  if (TERRAIN) {
+    terrain = arena.create<TerrainRenderer>(
+        TERRAIN_CHUNK_RESOLUTION, TERRAIN_BUDGET_BYTES,
+        TERRAIN_MAX_PIXEL_ERROR, TERRAIN_MIN_PIXELS, TERRAIN_MAX_LEVEL,
+        TERRAIN_THREADS, TERRAIN_UPLOADS_PER_FRAME, TERRAIN_MAX_PENDING);
+  }
+  unlitBodies.push_back(&sun);
 
-    float currentFrame = static_cast<float>(glfwGetTime());
-    deltaTime = currentFrame - lastFrame;
-    lastFrame = currentFrame;
+  vector<string> planetNames;
+  for (const auto &planetData : planetsData) {
+    planetNames.push_back(planetData.name);
+  }
 
-    processInput(window);
+  pickBodies.push_back(&sun);
+  pickNames.push_back("Sun");
+  for (size_t i = 0; i < planets.size(); ++i) {
+    pickBodies.push_back(&planets[i]);
+    pickNames.push_back(planetNames[i]);
+  }
+  pickBodies.push_back(&moon);
+  pickNames.push_back("Moon");
+  if (saturnRings) {
+    pickNames.push_back("Saturn's rings");
+  }
 
-    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  buildPicker(*this);
+}
 
-    // view matrix: transforms world space to camera space
-    // moves the whole solar system as if the camera is moving around
-    mat4 view = camera.GetViewMatrix();
+void updateScene(Scene &scene, float dt) {
+  scene.sun.update(dt);
 
-    // projection matrix: transforms camera space to clip space
-    // adds perspective so far away planets look smaller
-    mat4 projection =
-        perspective(radians(camera.Zoom),                       // field of view
-                    (float)currentWidth / (float)currentHeight, // aspect ratio
-                    NEAR_PLANE, FAR_PLANE);
-    // render background
-    glDepthMask(GL_FALSE);
-    background.render(textureShader, view, projection);
-    glDepthMask(GL_TRUE);
+  for (CelestialBody &planet : scene.planets) {
+    planet.update(dt);
+  }
 
-    // render sun
-    sun.update(deltaTime);
-    sun.render(textureShader, view, projection);
+  // the moon follows the earth, so it updates after the planets
+  scene.moon.update(dt);
 
-    // render orbit paths
-    if (drawOrbits) {
-      for (auto *orbit : orbits) {
-        orbit->render(orbitShader, view, projection);
-      }
+  scene.elapsed += dt;
 
-      if (earthPtr) {
-        mat4 moonOrbitModel = mat4(1.0f);
-        moonOrbitModel = translate(moonOrbitModel, earthPtr->getPosition());
-        moonOrbit->render(orbitShader, view, projection, moonOrbitModel);
-      }
+  // the spin stays live, only the positions are replaced
+  if (scene.playback.isOpen() &&
+      scene.playback.positionsAt(scene.elapsed, scene.playbackPositions)) {
+    for (size_t i = 0; i < scene.pickBodies.size(); ++i) {
+      int body = scene.playbackBodies[i];
+      if (body >= 0)
+        scene.pickBodies[i]->setPosition(scene.playbackPositions[body]);
     }
+  }
 
-    // setup lighting from sun
-    lightShader.use();
-    lightShader.setVec3("sunPos", sun.getPosition());
-    lightShader.setVec3("viewPos", camera.Position);
+  updatePicker(scene);
 
-    // set light properties (from the sun)
-    lightShader.setVec3("light_La", LIGHT_AMBIENT);
-    lightShader.setVec3("light_Ld", LIGHT_DIFFUSE);
-    lightShader.setVec3("light_Le", LIGHT_SPECULAR);
+  // new close approaches go to the detector's queue, drained by the caller
+  scene.approachPositions.clear();
+  scene.approachRadii.clear();
+  for (auto *body : scene.pickBodies) {
+    scene.approachPositions.push_back(body->getPosition());
+    scene.approachRadii.push_back(body->getRadius());
+  }
+  scene.approaches.detect(scene.approachPositions, scene.approachRadii);
+}
 
-    // render planets
-    for (auto *planet : planets) {
-      planet->update(deltaTime);
-      planet->render(lightShader, view, projection);
+void reportApproaches(Scene &scene) {
+  vector<ApproachEvent> events;
+  scene.approaches.takeEvents(events);
+  for (const ApproachEvent &event : events) {
+    cout << (event.collision ? "Collision: " : "Close approach: ")
+         << scene.pickNames[event.a] << " - " << scene.pickNames[event.b]
+         << ", " << event.distance << " apart" << endl;
+  }
+}
+
+// what the sky costs to load, compare with STAR_FIELD on. the texture's
+// fine levels are streamed in later, so its resident size still grows
+void reportSky(const Scene &scene) {
+  const double megabyte = 1024.0 * 1024.0;
+  cout << "Sky: " << (scene.stars ? STAR_GLOW_TEXTURE : BACKGROUND_TEXTURE)
+       << " loaded in " << scene.skyLoadTime * 1000.0 << " ms ("
+       << scene.skyLoadBytes / megabyte << " MB)";
+  if (scene.stars) {
+    cout << ", " << scene.stars->getStarCount() << " stars in "
+         << scene.stars->getLoadTime() * 1000.0 << " ms ("
+         << scene.stars->getBytes() / megabyte << " MB)";
+  }
+  cout << endl;
+}
+
+// what the scene's objects took from the arena while loading, and how many
+// texture loads were answered with a texture another body already uses
+void reportSceneLoad(const Scene &scene) {
+  cout << "Scene: " << scene.arena.getAllocations() << " allocations in "
+       << scene.arena.getBlockCount() << " arena blocks, "
+       << scene.arena.getPeakBytes() / 1024.0 << " KB peak of "
+       << scene.arena.getReservedBytes() / 1024.0 << " KB, "
+       << scene.streamer.getTextureCount() << " textures ("
+       << scene.streamer.getSharedLoads() << " shared loads)" << endl;
+}
+
+// bodies are matched by name, those missing from the file keep orbiting.
+// past the end of the file they stop at their last position
+void openPlayback(Scene &scene, const string &path) {
+  if (path.empty())
+    return;
+  if (!scene.playback.open(path.c_str())) {
+    cerr << "Failed to open ephemeris " << path << endl;
+    return;
+  }
+
+  int matched = 0;
+  scene.playbackBodies.clear();
+  for (size_t i = 0; i < scene.pickBodies.size(); ++i) {
+    scene.playbackBodies.push_back(
+        scene.playback.findBody(scene.pickNames[i]));
+    matched += scene.playbackBodies.back() >= 0;
+  }
+  cout << "Playback: " << matched << " bodies from " << path << ", "
+       << scene.playback.getStartTime() / EPHEMERIS_YEAR << " to "
+       << scene.playback.getEndTime() / EPHEMERIS_YEAR << " years" << endl;
+}
+
+// the scene's bodies in pick order (sun, planets, moon) with the orbits
+// Scene() gives them
+static vector<EphemerisBody>
+ephemerisBodies(const vector<PlanetData> &planetsData) {
+  vector<EphemerisBody> bodies;
+  EphemerisBody sun = {"Sun", 0.0f, 0.0f, SUN_ROTATION_SPEED, -1};
+  bodies.push_back(sun);
+
+  int earth = -1;
+  for (const PlanetData &planetData : planetsData) {
+    EphemerisBody planet = {planetData.name,
+                            planetData.orbitRadius * DISTANCE_SCALE,
+                            planetData.orbitSpeed * SPEED_SCALE,
+                            planetData.rotationSpeed, -1};
+    if (planetData.name == "Earth")
+      earth = (int)bodies.size();
+    bodies.push_back(planet);
+  }
+
+  EphemerisBody moon = {"Moon", MOON_ORBIT_RADIUS, MOON_ORBIT_SPEED,
+                        MOON_ROTATION_SPEED, earth};
+  bodies.push_back(moon);
+  return bodies;
+}
+
+// no window or gl context, the bodies are simulation only
+int runEphemeris(const EphemerisOptions &options) {
+  vector<EphemerisBody> bodies =
+      ephemerisBodies(loadPlanetsFromCSV("assets/data/planets.csv"));
+  double step = EPHEMERIS_YEAR / (365.25 * 24.0) * options.stepHours;
+  if (step <= 0.0 || options.years <= 0.0) {
+    cerr << "--years and --step-hours must be positive" << endl;
+    return 1;
+  }
+  uint64_t samples = (uint64_t)(options.years * EPHEMERIS_YEAR / step) + 1;
+
+  ThreadPool pool(options.threads);
+  EphemerisStats stats;
+  if (!writeEphemeris(options.outputPath.c_str(), bodies, 0.0, step, samples,
+                      EPHEMERIS_BLOCK_SAMPLES, EPHEMERIS_QUANTUM, pool,
+                      stats)) {
+    cerr << "Failed to write " << options.outputPath << endl;
+    return 1;
+  }
+
+  const double megabyte = 1024.0 * 1024.0;
+  double positions = (double)samples * bodies.size();
+  cout << "Ephemeris: " << bodies.size() << " bodies x " << samples
+       << " samples to " << options.outputPath << " in "
+       << stats.seconds * 1000.0 << " ms (" << positions / stats.seconds / 1e6
+       << " M positions/s on " << pool.size() << " threads), "
+       << stats.rawBytes / megabyte << " MB as floats, "
+       << stats.fileBytes / megabyte << " MB written" << endl;
+  return 0;
+}
+
+void setMemoryBudgets() {
+  MemoryTracker::setGpuBudget(MEMORY_BUDGET_GPU);
+  MemoryTracker::setCpuBudget(MEMORY_BUDGET_CPU);
+  MemoryTracker::setBudget(MEMORY_TEXTURES, MEMORY_BUDGET_TEXTURES);
+  MemoryTracker::setBudget(MEMORY_CPU_TEXTURES, MEMORY_BUDGET_CPU_TEXTURES);
+}
+
+void reportMemoryWarnings() {
+  vector<string> warnings = MemoryTracker::takeWarnings();
+  for (const string &warning : warnings) {
+    cout << "Warning: " << warning << endl;
+  }
+}
+
+void buildPicker(Scene &scene) {
+  vector<BodyBVH::Primitive> primitives;
+
+  for (size_t i = 0; i < scene.pickBodies.size(); ++i) {
+    BodyBVH::Primitive prim;
+    prim.type = BodyBVH::PRIMITIVE_SPHERE;
+    prim.center = scene.pickBodies[i]->getPosition();
+    prim.radius = scene.pickBodies[i]->getRadius();
+    prim.innerRadius = 0.0f;
+    prim.normal = vec3(0.0f, 1.0f, 0.0f);
+    prim.id = (int)i;
+    primitives.push_back(prim);
+  }
+
+  if (scene.saturnRings) {
+    BodyBVH::Primitive prim;
+    prim.type = BodyBVH::PRIMITIVE_ANNULUS;
+    prim.center = scene.saturnRings->getPosition();
+    prim.radius = scene.saturnRings->getOuterRadius();
+    prim.innerRadius = scene.saturnRings->getInnerRadius();
+    prim.normal = scene.saturnRings->getNormal();
+    prim.id = (int)scene.pickBodies.size();
+    primitives.push_back(prim);
+    scene.ringPick = prim;
+  }
+
+  scene.picker.build(primitives);
+}
+
+void updatePicker(Scene &scene) {
+  // the tree keeps its topology, only the bounds follow the bodies
+  for (size_t i = 0; i < scene.pickBodies.size(); ++i) {
+    scene.picker.setSphere((int)i, scene.pickBodies[i]->getPosition(),
+                           scene.pickBodies[i]->getRadius());
+  }
+
+  // the ring itself is moved on the submission side while this runs on the
+  // frame thread, so it is not read here: it sits on saturn with the normal
+  // and radii it was loaded with
+  CelestialBody *saturn = scene.planets.get(scene.saturn);
+  if (scene.saturnRings && saturn) {
+    const BodyBVH::Primitive &ring = scene.ringPick;
+    scene.picker.setAnnulus(ring.id, saturn->getPosition(), ring.normal,
+                            ring.innerRadius, ring.radius);
+  }
+
+  scene.picker.refit();
+}
+
+// whether the camera of view b points within angle radians of view a in every
+// direction: the angle of the rotation between them, from its trace
+bool turnedWithin(const mat4 &a, const mat4 &b, float angle) {
+  mat3 turn = mat3(b) * transpose(mat3(a));
+  float cosine = (turn[0][0] + turn[1][1] + turn[2][2] - 1.0f) * 0.5f;
+  return cosine >= cos(angle);
+}
+
+// camera and toggles for the next frame to prepare, and consumes the pick
+// request. the lod size is the render size of the last frame, close enough
+FrameInput sampleInput(float dt, const DynamicResolution &resolution) {
+  FrameInput input;
+  input.dt = dt;
+  input.sampleTime = now();
+  input.width = currentWidth;
+  input.height = currentHeight;
+  input.lodWidth = resolution.getRenderWidth();
+  input.lodHeight = resolution.getRenderHeight();
+  input.eye = camera.Position;
+  input.fovY = radians(camera.Zoom);
+  // pipelined, the packet is culled with this camera but drawn with the
+  // next one
+  input.cullMargin = RENDER_PIPELINING ? radians(BODY_FRUSTUM_MARGIN) : 0.0f;
+
+  // view matrix: transforms world space to camera space
+  // moves the whole solar system as if the camera is moving around
+  input.view = camera.GetViewMatrix();
+
+  // projection matrix: transforms camera space to clip space
+  // adds perspective so far away planets look smaller
+  input.projection = perspective(input.fovY, // field of view
+                                 (float)input.width / (float)input.height,
+                                 NEAR_PLANE, FAR_PLANE);
+
+  input.impostorThreshold = impostorThreshold;
+  input.impostorFadeBand = IMPOSTOR_FADE_BAND;
+  input.drawOrbits = drawOrbits;
+  input.drawTrails = drawTrails;
+  input.pick = pickRequested;
+  pickRequested = false;
+  return input;
+}
+
+// scripted camera of the export mode
+FrameInput flythroughInput(int frame, float dt, const ExportOptions &options) {
+  float t = frame * dt;
+  float angle = radians(FLYTHROUGH_SPEED * t);
+
+  FrameInput input;
+  input.dt = dt;
+  input.sampleTime = now();
+  input.width = input.lodWidth = options.width;
+  input.height = input.lodHeight = options.height;
+  input.eye = vec3(FLYTHROUGH_RADIUS * cos(angle),
+                   FLYTHROUGH_HEIGHT * cos(angle * 0.5f),
+                   FLYTHROUGH_RADIUS * sin(angle));
+  input.fovY = radians(ZOOM);
+  // the export draws every packet with its own camera
+  input.cullMargin = 0.0f;
+  input.view = lookAt(input.eye, vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+  input.projection =
+      perspective(input.fovY, (float)options.width / options.height,
+                  NEAR_PLANE, FAR_PLANE);
+  input.impostorThreshold = impostorThreshold;
+  input.impostorFadeBand = IMPOSTOR_FADE_BAND;
+  input.drawOrbits = drawOrbits;
+  input.drawTrails = drawTrails;
+  input.pick = false;
+  return input;
+}
+
+// cpu half of a frame, runs on the frame thread: steps the simulation, then
+// copies out everything the draws need. touches no GL state and nothing the
+// submission side owns (streamer, trails, rings, gl objects)
+void prepareFrame(Scene &scene, const FrameInput &input, FramePacket &packet) {
+  double start = glfwGetTime();
+
+  updateScene(scene, input.dt);
+
+  packet.input = input;
+  packet.elapsed = scene.elapsed;
+  packet.sunPosition = scene.sun.getPosition();
+  packet.approachTime = scene.approaches.getLastTime();
+
+  // the sky is never culled. seen from inside, it spans 360 degrees at the
+  // viewport's pixel density
+  const float pi = 3.14159265f;
+  packet.background = FrameBuilder::makeDraw(scene.background, input.eye);
+  packet.textureRequests.clear();
+  TextureRequest sky;
+  sky.texture = scene.background.getTexture();
+  sky.texels = 2.0f * pi * input.lodHeight * 0.5f / tan(input.fovY * 0.5f);
+  packet.textureRequests.push_back(sky);
+
+  packet.unlit.clear();
+  packet.bodies.clear();
+  scene.builder.build(scene.unlitBodies, input, packet.unlit,
+                      packet.textureRequests);
+  double buildTime = scene.builder.getLastTime();
+  scene.builder.build(scene.litBodies, input, packet.bodies,
+                      packet.textureRequests);
+  packet.buildTime = buildTime + scene.builder.getLastTime();
+  packet.culledCount =
+      (int)(scene.unlitBodies.size() + scene.litBodies.size() -
+            packet.unlit.size() - packet.bodies.size());
+
+  packet.trailPositions.resize(scene.trailBodies.size());
+  for (size_t i = 0; i < scene.trailBodies.size(); ++i) {
+    packet.trailPositions[i] = scene.trailBodies[i]->getPosition();
+  }
+
+  const CelestialBody *earth = scene.planets.get(scene.earth);
+  packet.hasMoonOrbit = earth != nullptr;
+  if (earth) {
+    packet.moonOrbitModel = translate(mat4(1.0f), earth->getPosition());
+  }
+  const CelestialBody *saturn = scene.planets.get(scene.saturn);
+  packet.hasRing = scene.saturnRings && saturn;
+  if (packet.hasRing) {
+    packet.ringPosition = saturn->getPosition();
+  }
+
+  // the cursor is captured, so picking aims through the screen center
+  packet.picked = false;
+  if (input.pick) {
+    RayHit hit;
+    if (scene.picker.pick(input.width * 0.5f, input.height * 0.5f,
+                          input.width, input.height, input.view,
+                          input.projection, hit)) {
+      packet.picked = true;
+      packet.pickedName = scene.pickNames[hit.id];
+      packet.pickedDistance = hit.distance;
     }
+  }
 
-    // render moon
-    moon.update(deltaTime);
-    moon.render(lightShader, view, projection);
+  packet.prepareTime = glfwGetTime() - start;
+}
+
+// gl side state that follows the packet: texture levels, terrain chunks,
+// trails, the ring and its particle lod. complete waits for every requested
+// texture tile and terrain chunk
+void uploadFrame(Scene &scene, const FramePacket &packet, float viewportWidth,
+                 float viewportHeight, bool complete) {
+  for (const TextureRequest &request : packet.textureRequests) {
+    scene.streamer.request(request.texture, request.texels);
+  }
+  if (complete)
+    scene.streamer.flush();
+  else
+    scene.streamer.update();
+
+  if (scene.terrain) {
+    scene.terrain->update(packet.bodies, packet.input, viewportHeight,
+                          complete);
+  }
+
+  for (size_t i = 0; i < packet.trailPositions.size(); ++i) {
+    scene.trails.setPosition((int)i, packet.trailPositions[i]);
+  }
+  scene.trails.update(packet.input.dt);
+
+  if (packet.hasRing) {
+    scene.saturnRings->update(packet.ringPosition, 0.0f);
+    // picks the particles or the annulus
+    if (scene.saturnParticles) {
+      scene.saturnParticles->update(*scene.saturnRings, packet.input.eye,
+                                    packet.input.fovY, viewportWidth,
+                                    viewportHeight);
+    }
+  }
+}
+
+static void drawBody(Shader &shader, const BodyDraw &draw) {
+  shader.setMat4("model", draw.model);
+  shader.setVec3("material_Ka", draw.ka);
+  shader.setVec3("material_Kd", draw.kd);
+  shader.setVec3("material_Ks", draw.ks);
+  shader.setFloat("material_shininess", draw.shininess);
+  draw.texture->bind(0);
+  shader.setInt("texture1", 0);
+  draw.mesh->draw();
+}
+
+// a mesh body of the bodies pass, drawn only if its box shows past what is
+// already in the depth buffer. untested while nothing could hide it
+static void drawOccluded(Scene &scene, Shader &shader, const BodyDraw &draw,
+                         const FramePacket &packet, bool tested) {
+  int query = -1;
+  if (tested && OCCLUSION_CULLING) {
+    query = scene.occlusion.test(scene.orbitShader, draw.center, draw.radius,
+                                 packet.input.eye, NEAR_PLANE,
+                                 &scene.passFragments[PASS_BODIES]);
+  }
+  shader.use();
+  scene.occlusion.beginDraw(query);
+  drawBody(shader, draw);
+  scene.occlusion.endDraw();
+}
 
-    // render Saturn's rings
-    if (saturnRings && saturnPtr) {
-      saturnRings->update(saturnPtr->getPosition(), 0.0f);
-      saturnRings->render(ringShader, view, projection);
+// view, projection and camera position come from the latched FrameData
+// block, everything else from the packet. opaque passes go first, front to
+// back so early depth testing rejects hidden fragments before they are
+// shaded, then the sky fills what is left, then the blended passes
+void renderScene(Scene &scene, const FramePacket &packet,
+                 float viewportHeight) {
+  // each pass declares the state it needs and the cache drops what is
+  // already set
+  GLState::setOpaque();
+  scene.passFragments[PASS_BODIES].begin();
+  scene.occlusion.begin();
+
+  // setup lighting from sun
+  Shader &lightShader = scene.lightShader;
+  lightShader.use();
+  lightShader.setVec3("sunPos", packet.sunPosition);
+
+  // set light properties (from the sun)
+  lightShader.setVec3("light_La", LIGHT_AMBIENT);
+  lightShader.setVec3("light_Ld", LIGHT_DIFFUSE);
+  lightShader.setVec3("light_Le", LIGHT_SPECULAR);
+
+  // render the sun and the lit bodies front to back, both lists are sorted:
+  // close ones as terrain, big ones as meshes, small ones queued as
+  // impostors, both while crossing the threshold
+  scene.meshDraws = 0;
+  scene.impostorDraws = 0;
+  scene.terrainDraws = 0;
+  size_t nextUnlit = 0;
+  bool drawnAny = false;
+  for (size_t i = 0; i <= packet.bodies.size(); ++i) {
+    while (nextUnlit < packet.unlit.size() &&
+           (i == packet.bodies.size() ||
+            packet.unlit[nextUnlit].depth <= packet.bodies[i].depth)) {
+      drawOccluded(scene, scene.textureShader, packet.unlit[nextUnlit++],
+                   packet, drawnAny);
+      drawnAny = true;
+    }
+    if (i == packet.bodies.size())
+      break;
+
+    const BodyDraw &draw = packet.bodies[i];
+    if (draw.fade < 1.0f) {
+      lightShader.use();
+      lightShader.setFloat("ditherOut", draw.fade);
+      if (scene.terrain && scene.terrain->isActive(draw.id)) {
+        scene.terrain->render(lightShader, draw);
+        scene.terrainDraws++;
+      } else {
+        drawOccluded(scene, lightShader, draw, packet, drawnAny);
+        scene.meshDraws++;
+      }
+      drawnAny = true;
+    }
+    if (draw.fade > 0.0f) {
+      scene.impostors.add(draw);
+      scene.impostorDraws++;
+    }
+  }
+  scene.occlusion.end();
+
+  Shader &impostorShader = scene.impostorShader;
+  impostorShader.use();
+  impostorShader.setVec3("sunPos", packet.sunPosition);
+  impostorShader.setVec3("light_La", LIGHT_AMBIENT);
+  impostorShader.setVec3("light_Ld", LIGHT_DIFFUSE);
+  impostorShader.setVec3("light_Le", LIGHT_SPECULAR);
+  scene.impostors.render(impostorShader);
+  scene.passFragments[PASS_BODIES].end();
+
+  // render the asteroid belt, culled on the gpu
+  scene.passFragments[PASS_BELT].begin();
+  Shader &beltShader = scene.beltShader;
+  beltShader.use();
+  beltShader.setVec3("sunPos", packet.sunPosition);
+  beltShader.setVec3("rockColor", BELT_COLOR);
+  beltShader.setVec3("light_La", LIGHT_AMBIENT);
+  beltShader.setVec3("light_Ld", LIGHT_DIFFUSE);
+  scene.belt.render(scene.beltCullShader, beltShader, (float)packet.elapsed,
+                    viewportHeight, BELT_MIN_PIXELS, BELT_FRUSTUM_MARGIN);
+  scene.passFragments[PASS_BELT].end();
+
+  // render background on the far plane where nothing covers it, then the
+  // stars over it
+  scene.skyTimer.begin();
+  scene.passFragments[PASS_SKY].begin();
+  Shader &skyShader = scene.skyShader;
+  skyShader.use();
+  GLState::setCapability(GL_DEPTH_TEST, true);
+  GLState::depthFunc(GL_LEQUAL);
+  GLState::depthMask(false);
+  GLState::setCapability(GL_BLEND, false);
+  drawBody(skyShader, packet.background);
+  if (scene.stars)
+    scene.stars->render(scene.starShader, packet.input.fovY);
+  scene.passFragments[PASS_SKY].end();
+  scene.skyTimer.end();
+
+  scene.passFragments[PASS_BLENDED].begin();
+
+  // render orbit paths
+  if (packet.input.drawOrbits) {
+    GLState::setOpaque();
+    for (Orbit &orbit : scene.orbits) {
+      orbit.render(scene.orbitShader);
     }
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    if (packet.hasMoonOrbit) {
+      scene.moonOrbit->render(scene.orbitShader, packet.moonOrbitModel);
+    }
   }
 
-  for (auto *planet : planets) {
-    delete planet;
+  // render trails behind the moving bodies
+  if (packet.input.drawTrails) {
+    scene.trails.render(scene.trailShader);
   }
 
-  for (auto *orbit : orbits) {
-    delete orbit;
+  // render Saturn's rings, as particles when the camera is close
+  if (scene.saturnParticles && packet.hasRing) {
+    Shader &particleShader = scene.ringParticleShader;
+    particleShader.use();
+    particleShader.setVec3("sunPos", packet.sunPosition);
+    particleShader.setVec3("light_La", LIGHT_AMBIENT);
+    particleShader.setVec3("light_Ld", LIGHT_DIFFUSE);
+    particleShader.setFloat("minPixelSize", RING_PARTICLE_MIN_PIXELS);
+    scene.saturnParticles->render(*scene.saturnRings, particleShader,
+                                  scene.ringShader, (float)packet.elapsed,
+                                  viewportHeight);
   }
+  scene.passFragments[PASS_BLENDED].end();
+}
 
-  delete moonOrbit;
-  delete saturnRings;
+bool parseOptions(int argc, char **argv, ExportOptions &options,
+                  EphemerisOptions &ephemeris) {
+  options.width = EXPORT_DEFAULT_WIDTH;
+  options.height = EXPORT_DEFAULT_HEIGHT;
+  options.frames = EXPORT_DEFAULT_FRAMES;
+  options.format = EXPORT_PNG;
+  ephemeris.years = EPHEMERIS_DEFAULT_YEARS;
+  ephemeris.stepHours = EPHEMERIS_DEFAULT_STEP_HOURS;
+  ephemeris.threads = EPHEMERIS_THREADS;
+
+  bool exportRequested = false;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (arg == "--export" && hasValue) {
+      options.outputDir = argv[++i];
+      exportRequested = true;
+    } else if (arg == "--size" && hasValue) {
+      string size = argv[++i];
+      if (size == "1080p") {
+        options.width = 1920;
+        options.height = 1080;
+      } else if (size == "4k") {
+        options.width = 3840;
+        options.height = 2160;
+      } else {
+        // kept at the default unless both sides parse and are positive
+        int width = 0, height = 0;
+        if (sscanf(size.c_str(), "%dx%d", &width, &height) == 2 &&
+            width > 0 && height > 0) {
+          options.width = width;
+          options.height = height;
+        } else {
+          cerr << "Invalid --size " << size
+               << ", expected WxH with positive sides, 1080p or 4k" << endl;
+        }
+      }
+    } else if (arg == "--frames" && hasValue) {
+      int frames = atoi(argv[++i]);
+      if (frames > 0)
+        options.frames = frames;
+      else
+        cerr << "Invalid --frames " << argv[i] << ", expected a positive count"
+             << endl;
+    } else if (arg == "--format" && hasValue) {
+      options.format = strcmp(argv[++i], "raw") == 0 ? EXPORT_RAW : EXPORT_PNG;
+    } else if (arg == "--headless" && hasValue) {
+      options.contextApi = argv[++i];
+    } else if (arg == "--ephemeris" && hasValue) {
+      ephemeris.outputPath = argv[++i];
+    } else if (arg == "--years" && hasValue) {
+      ephemeris.years = atof(argv[++i]);
+    } else if (arg == "--step-hours" && hasValue) {
+      ephemeris.stepHours = atof(argv[++i]);
+    } else if (arg == "--threads" && hasValue) {
+      ephemeris.threads = (unsigned int)atoi(argv[++i]);
+    } else if (arg == "--playback" && hasValue) {
+      ephemeris.playbackPath = argv[++i];
+    } else {
+      cerr << "Unknown argument: " << arg << endl;
+    }
+  }
 
-  glfwTerminate();
-  return 0;
+  return exportRequested;
 }
 
 GLFWwindow *initWindow(int width, int height, const char *title) {
@@ -249,12 +1399,56 @@ GLFWwindow *initWindow(int width, int height, const char *title) {
   glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
   glfwSetCursorPosCallback(window, mouseCallback);
   glfwSetScrollCallback(window, scrollCallback);
+  glfwSetMouseButtonCallback(window, mouseButtonCallback);
   glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
   glViewport(0, 0, width, height);
   return window;
 }
 
+GLFWwindow *initOffscreenContext(const string &contextApi) {
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+  // the null platform needs no display server: the context comes straight
+  // from egl (surfaceless) or osmesa, which is what headless nodes have
+  if (!contextApi.empty()) {
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+  }
+#endif
+
+  if (!glfwInit()) {
+    cerr << "Failed to initialize GLFW" << endl;
+    return nullptr;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+  if (contextApi == "egl") {
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+  } else if (contextApi == "osmesa") {
+#ifdef GLFW_OSMESA_CONTEXT_API
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#else
+    cerr << "This GLFW build has no OSMesa support" << endl;
+#endif
+  }
+
+  // the window is never shown, all rendering goes into a framebuffer object
+  GLFWwindow *window = glfwCreateWindow(1, 1, "Solar System", nullptr, nullptr);
+
+  if (!window) {
+    cerr << "Failed to create offscreen GL context" << endl;
+    glfwTerminate();
+    return nullptr;
+  }
+
+  glfwMakeContextCurrent(window);
+  return window;
+}
+
 bool initGLEW() {
   glewExperimental = GL_TRUE;
   GLenum glewError = glewInit();
@@ -305,6 +1499,40 @@ void processInput(GLFWwindow *window) {
     hKeyPressed = false;
   }
 
+  // toggle body trails with t
+  if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+    if (!tKeyPressed) {
+      drawTrails = !drawTrails;
+      tKeyPressed = true;
+    }
+  } else {
+    tKeyPressed = false;
+  }
+
+  // impostor threshold with [ and ]
+  bool smaller = glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+  bool larger = glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+  if (smaller || larger) {
+    if (!bracketKeyPressed) {
+      impostorThreshold *= larger ? IMPOSTOR_THRESHOLD_STEP
+                                  : 1.0f / IMPOSTOR_THRESHOLD_STEP;
+      cout << "Impostor threshold " << impostorThreshold << " px" << endl;
+      bracketKeyPressed = true;
+    }
+  } else {
+    bracketKeyPressed = false;
+  }
+
+  // toggle dynamic resolution with r
+  if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+    if (!rKeyPressed) {
+      toggleDynamicResolution = true;
+      rKeyPressed = true;
+    }
+  } else {
+    rKeyPressed = false;
+  }
+
   // camera movement
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -316,8 +1544,10 @@ void processInput(GLFWwindow *window) {
     camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
+// only records the size. the viewport is DynamicResolution::begin's, set
+// from the size sampled with the frame's input, so a resize polled while
+// another frame is in flight can't change that frame's viewport
 void framebufferSizeCallback(GLFWwindow * /* window */, int width, int height) {
-  glViewport(0, 0, width, height);
   currentWidth = width;
   currentHeight = height;
 }
@@ -346,38 +1576,8 @@ void scrollCallback(GLFWwindow * /* window */, double /* xoffset */,
   camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-vector<PlanetData> loadPlanetsFromCSV(const string &filepath) {
-  vector<PlanetData> planets;
-  ifstream file(filepath);
-
-  if (!file.is_open()) {
-    cerr << "Failed to open " << filepath << endl;
-    return planets;
-  }
-
-  string line;
-  getline(file, line); // skip header
-
-  while (getline(file, line)) {
-    stringstream ss(line);
-    PlanetData planet;
-    string token;
-
-    getline(ss, planet.name, ',');
-    getline(ss, token, ',');
-    planet.orbitSpeed = stof(token);
-    getline(ss, token, ',');
-    planet.orbitRadius = stof(token);
-    getline(ss, token, ',');
-    planet.size = stof(token);
-    getline(ss, planet.texture, ',');
-    getline(ss, token, ',');
-    planet.rotationSpeed = stof(token);
-    getline(ss, planet.type, ',');
-
-    planets.push_back(planet);
-  }
-
-  file.close();
-  return planets;
+void mouseButtonCallback(GLFWwindow * /* window */, int button, int action,
+                         int /* mods */) {
+  if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    pickRequested = true;
 }
@@ -0,0 +1,230 @@
+#include "memory.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+mutex MemoryTracker::lock;
+map<pair<int, size_t>, MemoryTracker::Entry> MemoryTracker::entries;
+size_t MemoryTracker::bytes[MEMORY_CATEGORY_COUNT];
+size_t MemoryTracker::peakBytes[MEMORY_CATEGORY_COUNT];
+size_t MemoryTracker::budgets[MEMORY_CATEGORY_COUNT];
+bool MemoryTracker::overBudget[MEMORY_CATEGORY_COUNT];
+size_t MemoryTracker::gpuBudget = 0;
+size_t MemoryTracker::cpuBudget = 0;
+size_t MemoryTracker::peakGpu = 0;
+size_t MemoryTracker::peakCpu = 0;
+bool MemoryTracker::gpuOver = false;
+bool MemoryTracker::cpuOver = false;
+vector<string> MemoryTracker::warnings;
+
+static const char *CATEGORY_NAMES[MEMORY_CATEGORY_COUNT] = {
+    "textures", "geometry", "instances", "targets",
+    "transfer", "cpu textures", "cpu scene"};
+
+static double toMegabytes(size_t size) { return size / (1024.0 * 1024.0); }
+
+void MemoryTracker::track(ObjectKind kind, size_t key, MemoryCategory category,
+                          size_t size) {
+  lock_guard<mutex> guard(lock);
+  pair<int, size_t> id((int)kind, key);
+
+  auto it = entries.find(id);
+  if (it != entries.end()) {
+    change(it->second.category, -(long long)it->second.bytes);
+    it->second.category = category;
+    it->second.bytes = size;
+  } else {
+    Entry entry;
+    entry.category = category;
+    entry.bytes = size;
+    entries[id] = entry;
+  }
+  change(category, (long long)size);
+}
+
+void MemoryTracker::untrack(ObjectKind kind, size_t key) {
+  lock_guard<mutex> guard(lock);
+  auto it = entries.find(pair<int, size_t>((int)kind, key));
+  if (it == entries.end())
+    return;
+
+  change(it->second.category, -(long long)it->second.bytes);
+  entries.erase(it);
+}
+
+void MemoryTracker::change(MemoryCategory category, long long delta) {
+  bytes[category] += delta;
+  peakBytes[category] = max(peakBytes[category], bytes[category]);
+
+  size_t gpu = sum(0, MEMORY_CPU_TEXTURES);
+  size_t cpu = sum(MEMORY_CPU_TEXTURES, MEMORY_CATEGORY_COUNT);
+  peakGpu = max(peakGpu, gpu);
+  peakCpu = max(peakCpu, cpu);
+
+  checkBudget(CATEGORY_NAMES[category], bytes[category], budgets[category],
+              overBudget[category]);
+  if (category < MEMORY_CPU_TEXTURES)
+    checkBudget("gpu total", gpu, gpuBudget, gpuOver);
+  else
+    checkBudget("cpu total", cpu, cpuBudget, cpuOver);
+}
+
+void MemoryTracker::checkBudget(const char *name, size_t used, size_t budget,
+                                bool &over) {
+  if (budget == 0 || used <= budget) {
+    over = false;
+    return;
+  }
+  if (over)
+    return;
+
+  over = true;
+  char text[128];
+  snprintf(text, sizeof(text),
+           "memory: %s at %.1f MB, over the %.1f MB budget", name,
+           toMegabytes(used), toMegabytes(budget));
+  warnings.push_back(text);
+}
+
+size_t MemoryTracker::sum(int first, int last) {
+  size_t total = 0;
+  for (int i = first; i < last; ++i)
+    total += bytes[i];
+  return total;
+}
+
+void MemoryTracker::trackBuffer(unsigned int id, MemoryCategory category,
+                                size_t size) {
+  track(BUFFER, id, category, size);
+}
+
+void MemoryTracker::trackTexture(unsigned int id, MemoryCategory category,
+                                 size_t size) {
+  track(TEXTURE, id, category, size);
+}
+
+void MemoryTracker::trackRenderbuffer(unsigned int id, MemoryCategory category,
+                                      size_t size) {
+  track(RENDERBUFFER, id, category, size);
+}
+
+void MemoryTracker::trackCpu(const void *owner, MemoryCategory category,
+                             size_t size) {
+  track(CPU, (size_t)owner, category, size);
+}
+
+void MemoryTracker::releaseBuffer(unsigned int id) { untrack(BUFFER, id); }
+
+void MemoryTracker::releaseTexture(unsigned int id) { untrack(TEXTURE, id); }
+
+void MemoryTracker::releaseRenderbuffer(unsigned int id) {
+  untrack(RENDERBUFFER, id);
+}
+
+void MemoryTracker::releaseCpu(const void *owner) {
+  untrack(CPU, (size_t)owner);
+}
+
+size_t MemoryTracker::textureBytes(int width, int height, int bytesPerTexel,
+                                   bool mipmapped) {
+  size_t total = 0;
+  for (;;) {
+    total += (size_t)width * height * bytesPerTexel;
+    if (!mipmapped || (width == 1 && height == 1))
+      return total;
+    width = max(1, width / 2);
+    height = max(1, height / 2);
+  }
+}
+
+size_t MemoryTracker::getBytes(MemoryCategory category) {
+  lock_guard<mutex> guard(lock);
+  return bytes[category];
+}
+
+size_t MemoryTracker::getPeakBytes(MemoryCategory category) {
+  lock_guard<mutex> guard(lock);
+  return peakBytes[category];
+}
+
+size_t MemoryTracker::getGpuBytes() {
+  lock_guard<mutex> guard(lock);
+  return sum(0, MEMORY_CPU_TEXTURES);
+}
+
+size_t MemoryTracker::getCpuBytes() {
+  lock_guard<mutex> guard(lock);
+  return sum(MEMORY_CPU_TEXTURES, MEMORY_CATEGORY_COUNT);
+}
+
+size_t MemoryTracker::getPeakGpuBytes() {
+  lock_guard<mutex> guard(lock);
+  return peakGpu;
+}
+
+size_t MemoryTracker::getPeakCpuBytes() {
+  lock_guard<mutex> guard(lock);
+  return peakCpu;
+}
+
+const char *MemoryTracker::getCategoryName(MemoryCategory category) {
+  return CATEGORY_NAMES[category];
+}
+
+void MemoryTracker::setBudget(MemoryCategory category, size_t size) {
+  lock_guard<mutex> guard(lock);
+  budgets[category] = size;
+  checkBudget(CATEGORY_NAMES[category], bytes[category], size,
+              overBudget[category]);
+}
+
+void MemoryTracker::setGpuBudget(size_t size) {
+  lock_guard<mutex> guard(lock);
+  gpuBudget = size;
+  checkBudget("gpu total", sum(0, MEMORY_CPU_TEXTURES), size, gpuOver);
+}
+
+void MemoryTracker::setCpuBudget(size_t size) {
+  lock_guard<mutex> guard(lock);
+  cpuBudget = size;
+  checkBudget("cpu total", sum(MEMORY_CPU_TEXTURES, MEMORY_CATEGORY_COUNT),
+              size, cpuOver);
+}
+
+vector<string> MemoryTracker::takeWarnings() {
+  lock_guard<mutex> guard(lock);
+  vector<string> taken;
+  taken.swap(warnings);
+  return taken;
+}
+
+string MemoryTracker::summary(bool peak) {
+  lock_guard<mutex> guard(lock);
+  const size_t *values = peak ? peakBytes : bytes;
+
+  // per-category peaks need not coincide, the totals are tracked separately
+  string line;
+  char text[64];
+  for (int group = 0; group < 2; ++group) {
+    int first = group == 0 ? 0 : MEMORY_CPU_TEXTURES;
+    int last = group == 0 ? MEMORY_CPU_TEXTURES : MEMORY_CATEGORY_COUNT;
+    size_t total = peak ? (group == 0 ? peakGpu : peakCpu) : sum(first, last);
+
+    snprintf(text, sizeof(text), "%s%s %.1f MB", group == 0 ? "" : ", ",
+             group == 0 ? "gpu" : "cpu", toMegabytes(total));
+    line += text;
+
+    string parts;
+    for (int i = first; i < last; ++i) {
+      if (values[i] == 0)
+        continue;
+      snprintf(text, sizeof(text), "%s%s %.1f", parts.empty() ? "" : ", ",
+               CATEGORY_NAMES[i], toMegabytes(values[i]));
+      parts += text;
+    }
+    if (!parts.empty())
+      line += " (" + parts + ")";
+  }
+  return line;
+}
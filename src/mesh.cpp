@@ -0,0 +1,98 @@
+#include "mesh.h"
+#include "gl_state.h"
+#include "memory.h"
+#include "mesh_data.h"
+#include <algorithm>
+
+using namespace std;
+
+// loaded meshes, null until first acquired
+static Mesh *sphereMeshes[SPHERE_LOD_COUNT];
+static Mesh *ringMesh;
+
+Mesh::Mesh(const MeshData &data)
+    : refCount(0), indexCount(data.indexCount), format(data.format) {
+  size_t vertexBytes = (size_t)data.vertexCount * format->stride;
+  size_t indexBytes = (size_t)data.indexCount * sizeof(unsigned short);
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &IBO);
+
+  GLState::bindVertexArray(VAO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertexBytes, data.vertices, GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(VBO, MEMORY_GEOMETRY, vertexBytes);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, data.indices,
+               GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(IBO, MEMORY_GEOMETRY, indexBytes);
+
+  setupAttributes(*format);
+
+  GLState::bindVertexArray(0);
+}
+
+void Mesh::setupAttributes(const VertexFormat &format) {
+  for (int i = 0; i < format.attributeCount; ++i) {
+    const VertexAttribute &attribute = format.attributes[i];
+    GLenum type = GL_FLOAT;
+    if (attribute.type == VERTEX_SNORM16)
+      type = GL_SHORT;
+    else if (attribute.type == VERTEX_UNORM16)
+      type = GL_UNSIGNED_SHORT;
+
+    // integer types are normalised, octahedral vectors are decoded in the
+    // shader
+    glVertexAttribPointer(attribute.location, attribute.components, type,
+                          type == GL_FLOAT ? GL_FALSE : GL_TRUE, format.stride,
+                          (void *)(size_t)attribute.offset);
+    glEnableVertexAttribArray(attribute.location);
+  }
+}
+
+Mesh::~Mesh() {
+  GLState::deleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &IBO);
+  MemoryTracker::releaseBuffer(VBO);
+  MemoryTracker::releaseBuffer(IBO);
+}
+
+Mesh *Mesh::acquire(Mesh *&slot, const MeshData &data) {
+  if (!slot)
+    slot = new Mesh(data);
+  slot->refCount++;
+  return slot;
+}
+
+Mesh *Mesh::acquireSphere(int lod) {
+  lod = max(0, min(lod, SPHERE_LOD_COUNT - 1));
+  return acquire(sphereMeshes[lod], SPHERE_LODS[lod]);
+}
+
+int Mesh::getSphereLodCount() { return SPHERE_LOD_COUNT; }
+
+Mesh *Mesh::acquireRing() { return acquire(ringMesh, RING_MESH); }
+
+void Mesh::release(Mesh *mesh) {
+  if (!mesh || --mesh->refCount > 0)
+    return;
+
+  // clear the slot so a later acquire uploads it again
+  for (int i = 0; i < SPHERE_LOD_COUNT; ++i) {
+    if (sphereMeshes[i] == mesh)
+      sphereMeshes[i] = nullptr;
+  }
+  if (ringMesh == mesh)
+    ringMesh = nullptr;
+
+  delete mesh;
+}
+
+void Mesh::draw() const {
+  GLState::bindVertexArray(VAO);
+  glDrawElements(GL_TRIANGLES, indexCount, INDEX_TYPE, 0);
+}
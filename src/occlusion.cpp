@@ -0,0 +1,238 @@
+#include "occlusion.h"
+#include "gl_state.h"
+#include "memory.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+using namespace glm;
+
+FragmentCounter::FragmentCounter()
+    : queryIndex(0), counting(false), active(false), fragments(0.0) {
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    segments[i] = 0;
+    queryPending[i] = false;
+  }
+}
+
+FragmentCounter::~FragmentCounter() {
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    if (!queries[i].empty())
+      glDeleteQueries((GLsizei)queries[i].size(), queries[i].data());
+  }
+}
+
+void FragmentCounter::collectQueries() {
+  // queries finish in submission order, starting with the oldest slot
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    int slot = (queryIndex + i) % QUERY_COUNT;
+    if (!queryPending[slot])
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot][segments[slot] - 1],
+                       GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+
+    GLuint64 total = 0;
+    for (int s = 0; s < segments[slot]; ++s) {
+      GLuint64 passed = 0;
+      glGetQueryObjectui64v(queries[slot][s], GL_QUERY_RESULT, &passed);
+      total += passed;
+    }
+    queryPending[slot] = false;
+
+    if (fragments == 0.0)
+      fragments = (double)total;
+    else
+      fragments += (total - fragments) * 0.2;
+  }
+}
+
+void FragmentCounter::beginSegment() {
+  vector<unsigned int> &slot = queries[queryIndex];
+  if (segments[queryIndex] == (int)slot.size()) {
+    unsigned int query = 0;
+    glGenQueries(1, &query);
+    slot.push_back(query);
+  }
+  glBeginQuery(GL_SAMPLES_PASSED, slot[segments[queryIndex]++]);
+  active = true;
+}
+
+void FragmentCounter::begin() {
+  collectQueries();
+  counting = !queryPending[queryIndex];
+  if (counting) {
+    segments[queryIndex] = 0;
+    beginSegment();
+  }
+}
+
+void FragmentCounter::pause() {
+  if (!active)
+    return;
+  glEndQuery(GL_SAMPLES_PASSED);
+  active = false;
+}
+
+void FragmentCounter::resume() {
+  if (counting && !active)
+    beginSegment();
+}
+
+void FragmentCounter::end() {
+  if (!counting)
+    return;
+  pause();
+  queryPending[queryIndex] = true;
+  queryIndex = (queryIndex + 1) % QUERY_COUNT;
+  counting = false;
+}
+
+OcclusionCuller::OcclusionCuller()
+    : queryIndex(0), conditional(false), hiddenCount(0), lastTested(0) {
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    tests[i] = 0;
+    queryPending[i] = false;
+  }
+  setupProxy();
+}
+
+OcclusionCuller::~OcclusionCuller() {
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    if (!queries[i].empty())
+      glDeleteQueries((GLsizei)queries[i].size(), queries[i].data());
+  }
+  GLState::deleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  MemoryTracker::releaseBuffer(VBO);
+  MemoryTracker::releaseBuffer(EBO);
+}
+
+// the unit cube around a sphere of radius 1
+void OcclusionCuller::setupProxy() {
+  float vertices[8 * 3];
+  for (int i = 0; i < 8; ++i) {
+    vertices[i * 3 + 0] = (i & 1) ? 1.0f : -1.0f;
+    vertices[i * 3 + 1] = (i & 2) ? 1.0f : -1.0f;
+    vertices[i * 3 + 2] = (i & 4) ? 1.0f : -1.0f;
+  }
+  // two triangles per face, winding doesn't matter with culling off
+  const unsigned char indices[36] = {0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5,
+                                     0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6,
+                                     0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+
+  GLState::bindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(VBO, MEMORY_GEOMETRY, sizeof(vertices));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+               GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(EBO, MEMORY_GEOMETRY, sizeof(indices));
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+
+  GLState::bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void OcclusionCuller::collectQueries() {
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    int slot = (queryIndex + i) % QUERY_COUNT;
+    if (!queryPending[slot])
+      continue;
+
+    GLint available = tests[slot] == 0;
+    if (!available)
+      glGetQueryObjectiv(queries[slot][tests[slot] - 1],
+                         GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+
+    int hidden = 0;
+    for (int t = 0; t < tests[slot]; ++t) {
+      GLuint visible = 0;
+      glGetQueryObjectuiv(queries[slot][t], GL_QUERY_RESULT, &visible);
+      if (!visible)
+        ++hidden;
+    }
+    queryPending[slot] = false;
+    hiddenCount = hidden;
+    lastTested = tests[slot];
+  }
+}
+
+void OcclusionCuller::begin() {
+  collectQueries();
+  // a slot still in flight this late is reused and its counts dropped, the
+  // culling itself never depends on reading results back
+  queryPending[queryIndex] = false;
+  tests[queryIndex] = 0;
+}
+
+int OcclusionCuller::test(Shader &shader, const vec3 &center, float radius,
+                          const vec3 &eye, float nearPlane,
+                          FragmentCounter *counter) {
+  // the box reaches sqrt(3) radii out at the corners
+  if (length(center - eye) - radius * 1.7321f <= nearPlane)
+    return -1;
+
+  vector<unsigned int> &slot = queries[queryIndex];
+  if (tests[queryIndex] == (int)slot.size()) {
+    unsigned int query = 0;
+    glGenQueries(1, &query);
+    slot.push_back(query);
+  }
+  int index = tests[queryIndex]++;
+
+  if (counter)
+    counter->pause();
+
+  shader.use();
+  shader.setMat4("model", scale(translate(mat4(1.0f), center), vec3(radius)));
+  GLState::setCapability(GL_DEPTH_TEST, true);
+  GLState::depthMask(false);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+  GLState::bindVertexArray(VAO);
+  glBeginQuery(GL_ANY_SAMPLES_PASSED, slot[index]);
+  glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+  glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+  // back to the opaque state the bodies are drawn in
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  GLState::depthMask(true);
+
+  if (counter)
+    counter->resume();
+  return index;
+}
+
+void OcclusionCuller::beginDraw(int query) {
+  if (query < 0)
+    return;
+  // the wait is on the gpu: the proxy went in just before, so the result is
+  // there as soon as it has been rasterized
+  glBeginConditionalRender(queries[queryIndex][query], GL_QUERY_WAIT);
+  conditional = true;
+}
+
+void OcclusionCuller::endDraw() {
+  if (!conditional)
+    return;
+  glEndConditionalRender();
+  conditional = false;
+}
+
+void OcclusionCuller::end() {
+  queryPending[queryIndex] = true;
+  queryIndex = (queryIndex + 1) % QUERY_COUNT;
+}
@@ -1,4 +1,6 @@
 #include "orbit.h"
+#include "gl_state.h"
+#include "memory.h"
 #include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -14,8 +16,9 @@ Orbit::Orbit(float orbitRadius, const vec3 &orbitColor)
 }
 
 Orbit::~Orbit() {
-  glDeleteVertexArrays(1, &VAO);
+  GLState::deleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
+  MemoryTracker::releaseBuffer(VBO);
 }
 
 void Orbit::setupOrbit() {
@@ -32,32 +35,29 @@ void Orbit::setupOrbit() {
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
 
-  glBindVertexArray(VAO);
+  GLState::bindVertexArray(VAO);
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, SEGMENTS * 3 * sizeof(float), vertices,
                GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(VBO, MEMORY_GEOMETRY,
+                             SEGMENTS * 3 * sizeof(float));
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
 
-  glBindVertexArray(0);
+  GLState::bindVertexArray(0);
 
   delete[] vertices;
 }
 
-void Orbit::render(Shader &shader, const mat4 &view, const mat4 &projection,
-                   const mat4 &model) {
+void Orbit::render(Shader &shader, const mat4 &model) {
   shader.use();
 
-  // send transformation matrices to shader
   // model places the orbit in world space
-  // view and projection transform to camera and clip space
+  // view and projection (FrameData block) transform to camera and clip space
   shader.setMat4("model", model);
-  shader.setMat4("view", view);
-  shader.setMat4("projection", projection);
   shader.setVec3("color", color);
 
-  glBindVertexArray(VAO);
+  GLState::bindVertexArray(VAO);
   glDrawArrays(GL_LINE_LOOP, 0, vertexCount);
-  glBindVertexArray(0);
 }
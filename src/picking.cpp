@@ -0,0 +1,485 @@
+#include "picking.h"
+#include "memory.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace glm;
+
+BodyBVH::~BodyBVH() { MemoryTracker::releaseCpu(this); }
+
+void BodyBVH::build(const vector<Primitive> &prims) {
+  nodes.clear();
+  primitives.clear();
+  slotOf.assign(prims.size(), 0);
+
+  if (prims.empty())
+    return;
+
+  // sort indices instead of primitives while splitting, then lay the
+  // primitives out in leaf order so each leaf reads a contiguous range
+  vector<int> order(prims.size());
+  vector<vec3> boxMin(prims.size());
+  vector<vec3> boxMax(prims.size());
+  for (size_t i = 0; i < prims.size(); ++i) {
+    order[i] = (int)i;
+    primitiveBounds(prims[i], boxMin[i], boxMax[i]);
+  }
+
+  vector<Node> tree;
+  tree.reserve(prims.size() * 2 / LEAF_SIZE + 1);
+
+  Node root;
+  root.leftFirst = 0;
+  root.count = (int)prims.size();
+  tree.push_back(root);
+
+  subdivide(tree, 0, order, boxMin, boxMax, 0);
+
+  primitives.resize(prims.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    primitives[i] = prims[order[i]];
+    slotOf[order[i]] = (int)i;
+  }
+
+  // binary bounds, only to decide which nodes to open when collapsing.
+  // children always sit after their parent, so walking backwards visits
+  // every child before the node that encloses it
+  for (int i = (int)tree.size() - 1; i >= 0; --i) {
+    Node &node = tree[i];
+    if (node.count > 0) {
+      rangeBounds(node.leftFirst, node.count, node.boundsMin, node.boundsMax);
+    } else {
+      const Node &left = tree[node.leftFirst];
+      const Node &right = tree[node.leftFirst + 1];
+      node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+      node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+    }
+  }
+
+  nodes.reserve(tree.size() / 3 + 1);
+  collapse(tree, 0);
+
+  refit();
+  MemoryTracker::trackCpu(this, MEMORY_CPU_SCENE,
+                          nodes.capacity() * sizeof(WideNode) +
+                              primitives.capacity() * sizeof(Primitive) +
+                              slotOf.capacity() * sizeof(int));
+}
+
+static float surfaceArea(const vec3 &bmin, const vec3 &bmax) {
+  vec3 e = bmax - bmin;
+  return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void BodyBVH::subdivide(vector<Node> &tree, int nodeIndex,
+                        vector<int> &order, const vector<vec3> &boxMin,
+                        const vector<vec3> &boxMax, int depth) {
+  int first = tree[nodeIndex].leftFirst;
+  int count = tree[nodeIndex].count;
+
+  if (count <= LEAF_SIZE || depth >= MAX_DEPTH - 1)
+    return;
+
+  vec3 nodeMin(numeric_limits<float>::max());
+  vec3 nodeMax(-numeric_limits<float>::max());
+  vec3 cmin(numeric_limits<float>::max());
+  vec3 cmax(-numeric_limits<float>::max());
+  for (int i = first; i < first + count; ++i) {
+    int p = order[i];
+    nodeMin = glm::min(nodeMin, boxMin[p]);
+    nodeMax = glm::max(nodeMax, boxMax[p]);
+    vec3 centroid = (boxMin[p] + boxMax[p]) * 0.5f;
+    cmin = glm::min(cmin, centroid);
+    cmax = glm::max(cmax, centroid);
+  }
+
+  // binned surface area heuristic: bucket the centroids along each axis and
+  // keep the plane with the lowest expected traversal cost
+  struct Bin {
+    vec3 bmin, bmax;
+    int count;
+  };
+
+  float bestCost = numeric_limits<float>::max();
+  int bestAxis = -1;
+  int bestSplit = 0;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    float extent = cmax[axis] - cmin[axis];
+    if (extent <= 0.0f)
+      continue;
+
+    Bin bins[SAH_BINS];
+    for (int b = 0; b < SAH_BINS; ++b) {
+      bins[b].bmin = vec3(numeric_limits<float>::max());
+      bins[b].bmax = vec3(-numeric_limits<float>::max());
+      bins[b].count = 0;
+    }
+
+    float scale = SAH_BINS / extent;
+    for (int i = first; i < first + count; ++i) {
+      int p = order[i];
+      float centroid = (boxMin[p][axis] + boxMax[p][axis]) * 0.5f;
+      int b = std::min(SAH_BINS - 1, (int)((centroid - cmin[axis]) * scale));
+      bins[b].bmin = glm::min(bins[b].bmin, boxMin[p]);
+      bins[b].bmax = glm::max(bins[b].bmax, boxMax[p]);
+      bins[b].count++;
+    }
+
+    // sweep from the right to get the cost of every right-hand side
+    float rightArea[SAH_BINS];
+    int rightCount[SAH_BINS];
+    vec3 rmin(numeric_limits<float>::max());
+    vec3 rmax(-numeric_limits<float>::max());
+    int rcount = 0;
+    for (int b = SAH_BINS - 1; b > 0; --b) {
+      rmin = glm::min(rmin, bins[b].bmin);
+      rmax = glm::max(rmax, bins[b].bmax);
+      rcount += bins[b].count;
+      rightArea[b] = rcount > 0 ? surfaceArea(rmin, rmax) : 0.0f;
+      rightCount[b] = rcount;
+    }
+
+    vec3 lmin(numeric_limits<float>::max());
+    vec3 lmax(-numeric_limits<float>::max());
+    int lcount = 0;
+    for (int b = 0; b < SAH_BINS - 1; ++b) {
+      lmin = glm::min(lmin, bins[b].bmin);
+      lmax = glm::max(lmax, bins[b].bmax);
+      lcount += bins[b].count;
+      if (lcount == 0 || rightCount[b + 1] == 0)
+        continue;
+
+      float cost = surfaceArea(lmin, lmax) * lcount +
+                   rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = b;
+      }
+    }
+  }
+
+  int half;
+  if (bestAxis < 0) {
+    // all centroids coincide, any split is as good as another
+    half = count / 2;
+  } else {
+    if (count <= MAX_LEAF_SIZE &&
+        bestCost >= surfaceArea(nodeMin, nodeMax) * count)
+      return; // splitting would not pay off
+
+    float extent = cmax[bestAxis] - cmin[bestAxis];
+    float scale = SAH_BINS / extent;
+    float origin = cmin[bestAxis];
+    int axis = bestAxis;
+    int split = bestSplit;
+
+    int *middle = std::partition(
+        &order[first], &order[first] + count, [&](int p) {
+          float centroid = (boxMin[p][axis] + boxMax[p][axis]) * 0.5f;
+          int b = std::min(SAH_BINS - 1, (int)((centroid - origin) * scale));
+          return b <= split;
+        });
+    half = (int)(middle - &order[first]);
+
+    if (half == 0 || half == count)
+      half = count / 2;
+  }
+
+  int left = (int)tree.size();
+  Node leftNode;
+  leftNode.leftFirst = first;
+  leftNode.count = half;
+  Node rightNode;
+  rightNode.leftFirst = first + half;
+  rightNode.count = count - half;
+  tree.push_back(leftNode);
+  tree.push_back(rightNode);
+
+  tree[nodeIndex].leftFirst = left;
+  tree[nodeIndex].count = 0;
+
+  subdivide(tree, left, order, boxMin, boxMax, depth + 1);
+  subdivide(tree, left + 1, order, boxMin, boxMax, depth + 1);
+}
+
+int BodyBVH::collapse(const vector<Node> &tree, int nodeIndex) {
+  // replace the largest inner node among the gathered ones by its two
+  // children until there are four, or only leaves are left
+  int gathered[4] = {nodeIndex, 0, 0, 0};
+  int count = 1;
+  while (count < 4) {
+    int open = -1;
+    float largest = -1.0f;
+    for (int i = 0; i < count; ++i) {
+      const Node &node = tree[gathered[i]];
+      float area = surfaceArea(node.boundsMin, node.boundsMax);
+      if (node.count == 0 && area > largest) {
+        largest = area;
+        open = i;
+      }
+    }
+    if (open < 0)
+      break;
+
+    int first = tree[gathered[open]].leftFirst;
+    gathered[open] = first;
+    gathered[count++] = first + 1;
+  }
+
+  // preorder, so children always sit after their parent
+  int index = (int)nodes.size();
+  nodes.push_back(WideNode());
+  for (int c = 0; c < 4; ++c) {
+    int child = 0, primitiveCount = -1;
+    if (c < count) {
+      const Node &node = tree[gathered[c]];
+      primitiveCount = node.count;
+      child = node.count > 0 ? node.leftFirst : collapse(tree, gathered[c]);
+    }
+    WideNode &wide = nodes[index];
+    wide.child[c] = child;
+    wide.count[c] = primitiveCount;
+    wide.minX[c] = wide.minY[c] = wide.minZ[c] = 0.0f;
+    wide.maxX[c] = wide.maxY[c] = wide.maxZ[c] = 0.0f;
+  }
+  return index;
+}
+
+void BodyBVH::setSphere(int index, const vec3 &center, float radius) {
+  Primitive &prim = primitives[slotOf[index]];
+  prim.center = center;
+  prim.radius = radius;
+}
+
+void BodyBVH::setAnnulus(int index, const vec3 &center, const vec3 &normal,
+                         float innerRadius, float outerRadius) {
+  Primitive &prim = primitives[slotOf[index]];
+  prim.center = center;
+  prim.normal = normal;
+  prim.innerRadius = innerRadius;
+  prim.radius = outerRadius;
+}
+
+void BodyBVH::primitiveBounds(const Primitive &prim, vec3 &bmin,
+                              vec3 &bmax) const {
+  vec3 extent(prim.radius);
+
+  if (prim.type == PRIMITIVE_ANNULUS) {
+    // a disk only extends sqrt(1 - n_i^2) * r along each axis
+    vec3 n = prim.normal;
+    extent = prim.radius * vec3(sqrt(std::max(0.0f, 1.0f - n.x * n.x)),
+                                sqrt(std::max(0.0f, 1.0f - n.y * n.y)),
+                                sqrt(std::max(0.0f, 1.0f - n.z * n.z)));
+  }
+
+  bmin = prim.center - extent;
+  bmax = prim.center + extent;
+}
+
+void BodyBVH::rangeBounds(int first, int count, vec3 &bmin,
+                          vec3 &bmax) const {
+  vec3 pmin, pmax;
+  primitiveBounds(primitives[first], bmin, bmax);
+
+  for (int i = first + 1; i < first + count; ++i) {
+    primitiveBounds(primitives[i], pmin, pmax);
+    bmin = glm::min(bmin, pmin);
+    bmax = glm::max(bmax, pmax);
+  }
+}
+
+void BodyBVH::refit() {
+  // children always sit after their parent, so walking backwards visits
+  // every child before the node that encloses it
+  for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+    WideNode &node = nodes[i];
+
+    for (int c = 0; c < 4; ++c) {
+      if (node.count[c] < 0)
+        continue;
+
+      vec3 bmin, bmax;
+      if (node.count[c] > 0) {
+        rangeBounds(node.child[c], node.count[c], bmin, bmax);
+      } else {
+        const WideNode &child = nodes[node.child[c]];
+        bmin = vec3(numeric_limits<float>::max());
+        bmax = vec3(-numeric_limits<float>::max());
+        for (int k = 0; k < 4; ++k) {
+          if (child.count[k] < 0)
+            continue;
+          bmin = glm::min(bmin, vec3(child.minX[k], child.minY[k],
+                                     child.minZ[k]));
+          bmax = glm::max(bmax, vec3(child.maxX[k], child.maxY[k],
+                                     child.maxZ[k]));
+        }
+      }
+
+      node.minX[c] = bmin.x;
+      node.minY[c] = bmin.y;
+      node.minZ[c] = bmin.z;
+      node.maxX[c] = bmax.x;
+      node.maxY[c] = bmax.y;
+      node.maxZ[c] = bmax.z;
+    }
+  }
+}
+
+// a large finite stand-in for 1/0: infinity would turn a box or ray origin
+// at 0 on that axis into 0 * inf = NaN in the slab test below
+static float safeInverse(float x) {
+  if (fabs(x) < 1e-30f)
+    return x < 0.0f ? -1e30f : 1e30f;
+  return 1.0f / x;
+}
+
+bool BodyBVH::intersect(const Primitive &prim, const vec3 &origin,
+                        const vec3 &dir, float &t) const {
+  if (prim.type == PRIMITIVE_SPHERE) {
+    // measure the miss distance directly instead of b^2 - c, which cancels
+    // out for small bodies seen from thousands of units away
+    vec3 oc = origin - prim.center;
+    float b = dot(oc, dir);
+    vec3 perpendicular = oc - dir * b;
+    float disc = prim.radius * prim.radius - dot(perpendicular, perpendicular);
+    if (disc < 0.0f)
+      return false;
+
+    float sq = sqrt(disc);
+    t = -b - sq;
+    if (t < 0.0f)
+      t = -b + sq; // origin inside the sphere
+    return t >= 0.0f;
+  }
+
+  // annulus: hit the ring plane, then check the radial distance
+  float denom = dot(dir, prim.normal);
+  if (fabs(denom) < 1e-8f)
+    return false;
+
+  t = dot(prim.center - origin, prim.normal) / denom;
+  if (t < 0.0f)
+    return false;
+
+  vec3 offset = origin + dir * t - prim.center;
+  float r2 = dot(offset, offset);
+  return r2 >= prim.innerRadius * prim.innerRadius &&
+         r2 <= prim.radius * prim.radius;
+}
+
+bool BodyBVH::raycast(const vec3 &origin, const vec3 &direction,
+                      RayHit &hit) const {
+  if (nodes.empty())
+    return false;
+
+  vec3 dir = normalize(direction);
+  vec3 invDir(safeInverse(dir.x), safeInverse(dir.y), safeInverse(dir.z));
+  // the slab test as bound * invDir - scaledOrigin, one multiply-add per
+  // plane
+  vec3 scaledOrigin = origin * invDir;
+  const float miss = numeric_limits<float>::infinity();
+
+  float best = miss;
+  int bestPrim = -1;
+
+  struct Entry {
+    int index;      // wide node, or first primitive of a leaf
+    int count;      // primitives in a leaf, 0 for a wide node
+    float distance; // where the ray enters its box
+  };
+  // a node pushes at most four entries and pops one
+  Entry stack[MAX_DEPTH * 3 + 1];
+  int stackSize = 0;
+  stack[stackSize].index = 0;
+  stack[stackSize].count = 0;
+  stack[stackSize++].distance = 0.0f;
+
+  while (stackSize > 0) {
+    Entry entry = stack[--stackSize];
+    // a hit found since the push may already be nearer than the box
+    if (entry.distance >= best)
+      continue;
+
+    if (entry.count > 0) {
+      for (int i = entry.index; i < entry.index + entry.count; ++i) {
+        float t;
+        if (intersect(primitives[i], origin, dir, t) && t < best) {
+          best = t;
+          bestPrim = i;
+        }
+      }
+      continue;
+    }
+
+    const WideNode &node = nodes[entry.index];
+    float distance[4];
+    for (int c = 0; c < 4; ++c) {
+      float tx1 = node.minX[c] * invDir.x - scaledOrigin.x;
+      float tx2 = node.maxX[c] * invDir.x - scaledOrigin.x;
+      float ty1 = node.minY[c] * invDir.y - scaledOrigin.y;
+      float ty2 = node.maxY[c] * invDir.y - scaledOrigin.y;
+      float tz1 = node.minZ[c] * invDir.z - scaledOrigin.z;
+      float tz2 = node.maxZ[c] * invDir.z - scaledOrigin.z;
+      float tmin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)),
+                            std::min(tz1, tz2));
+      float tmax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)),
+                            std::max(tz1, tz2));
+      bool hitBox = tmax >= tmin && tmax >= 0.0f && tmin < best;
+      distance[c] = hitBox && node.count[c] >= 0 ? tmin : miss;
+    }
+
+    // push the boxes that were hit farthest first, so the nearest is
+    // visited next and 'best' shrinks as early as possible
+    int order[4];
+    int hits = 0;
+    for (int c = 0; c < 4; ++c) {
+      if (distance[c] == miss)
+        continue;
+      int k = hits++;
+      for (; k > 0 && distance[order[k - 1]] < distance[c]; --k)
+        order[k] = order[k - 1];
+      order[k] = c;
+    }
+    for (int k = 0; k < hits; ++k) {
+      int c = order[k];
+      stack[stackSize].index = node.child[c];
+      stack[stackSize].count = node.count[c];
+      stack[stackSize++].distance = distance[c];
+    }
+  }
+
+  if (bestPrim < 0)
+    return false;
+
+  hit.id = primitives[bestPrim].id;
+  hit.distance = best;
+  hit.point = origin + dir * best;
+  return true;
+}
+
+bool BodyBVH::pick(float screenX, float screenY, int width, int height,
+                   const mat4 &view, const mat4 &projection,
+                   RayHit &hit) const {
+  vec3 origin, dir;
+  screenRay(screenX, screenY, width, height, view, projection, origin, dir);
+  return raycast(origin, dir, hit);
+}
+
+void BodyBVH::screenRay(float screenX, float screenY, int width, int height,
+                        const mat4 &view, const mat4 &projection, vec3 &origin,
+                        vec3 &dir) {
+  // window coordinates -> normalized device coordinates -> world space
+  float x = 2.0f * screenX / width - 1.0f;
+  float y = 1.0f - 2.0f * screenY / height;
+
+  mat4 inv = inverse(projection * view);
+  vec4 nearPoint = inv * vec4(x, y, -1.0f, 1.0f);
+  vec4 farPoint = inv * vec4(x, y, 1.0f, 1.0f);
+
+  origin = vec3(nearPoint) / nearPoint.w;
+  dir = normalize(vec3(farPoint) / farPoint.w - origin);
+}
@@ -0,0 +1,76 @@
+#include "profiler.h"
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+Profiler::Profiler(float interval)
+    : reportInterval(interval), intervalStart(-1.0), lastFrameStart(-1.0),
+      frameTimeSum(0.0), frames(0) {}
+
+Profiler::Stat &Profiler::find(const string &name, bool averaged) {
+  for (auto &stat : stats) {
+    if (stat.name == name)
+      return stat;
+  }
+
+  Stat stat;
+  stat.name = name;
+  stat.value = 0.0;
+  stat.sum = 0.0;
+  stat.averaged = averaged;
+  stats.push_back(stat);
+  return stats.back();
+}
+
+void Profiler::beginFrame(double now) {
+  if (intervalStart < 0.0)
+    intervalStart = now;
+
+  if (lastFrameStart >= 0.0) {
+    frameTimeSum += now - lastFrameStart;
+    frames++;
+  }
+  lastFrameStart = now;
+}
+
+void Profiler::set(const string &name, double value) {
+  find(name, false).value = value;
+}
+
+void Profiler::add(const string &name, double value) {
+  find(name, true).sum += value;
+}
+
+void Profiler::note(const string &text) { notes.push_back(text); }
+
+double Profiler::getAverageFrameTime() const {
+  return frames > 0 ? frameTimeSum / frames : 0.0;
+}
+
+bool Profiler::report(double now) {
+  if (intervalStart < 0.0 || now - intervalStart < reportInterval ||
+      frames == 0)
+    return false;
+
+  double frameTime = getAverageFrameTime();
+
+  cout << fixed << setprecision(2) << "[profile] " << 1.0 / frameTime
+       << " fps, " << frameTime * 1000.0 << " ms";
+
+  for (auto &stat : stats) {
+    double value = stat.averaged ? stat.sum / frames : stat.value;
+    cout << " | " << stat.name << " " << value;
+    stat.sum = 0.0;
+  }
+  for (const auto &text : notes) {
+    cout << " | " << text;
+  }
+  notes.clear();
+  cout << defaultfloat << endl;
+
+  intervalStart = now;
+  frameTimeSum = 0.0;
+  frames = 0;
+  return true;
+}
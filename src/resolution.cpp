@@ -0,0 +1,150 @@
+#include "resolution.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+DynamicResolution::DynamicResolution(int width, int height,
+                                     float targetFrameTime, float minimumScale,
+                                     float step, float hysteresisFraction,
+                                     int settle)
+    : target(max(width, 1), max(height, 1)), queryIndex(0), timing(false),
+      enabled(false), scale(1.0f), minScale(minimumScale), scaleStep(step),
+      targetTime(targetFrameTime), hysteresis(hysteresisFraction),
+      settleFrames(settle), gpuTime(0.0), hasGpuTime(false),
+      samplesSinceChange(0), decisions(0), windowWidth(max(width, 1)),
+      windowHeight(max(height, 1)) {
+  glGenQueries(QUERY_COUNT, queries);
+  for (int i = 0; i < QUERY_COUNT; ++i)
+    queryPending[i] = false;
+}
+
+DynamicResolution::~DynamicResolution() {
+  glDeleteQueries(QUERY_COUNT, queries);
+}
+
+void DynamicResolution::begin(int width, int height) {
+  // a minimized window reports 0x0
+  windowWidth = max(width, 1);
+  windowHeight = max(height, 1);
+
+  collectQueries();
+
+  if (enabled) {
+    target.resize(windowWidth, windowHeight);
+    target.bind();
+    glViewport(0, 0, getRenderWidth(), getRenderHeight());
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+  }
+
+  // only one query per slot can be in flight, skip timing if all are busy
+  timing = !queryPending[queryIndex];
+  if (timing)
+    glBeginQuery(GL_TIME_ELAPSED, queries[queryIndex]);
+}
+
+void DynamicResolution::end() {
+  if (enabled) {
+    // depth is not needed after the scene pass, only color is upscaled
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.ID);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, getRenderWidth(), getRenderHeight(), 0, 0,
+                      windowWidth, windowHeight, GL_COLOR_BUFFER_BIT,
+                      GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+  }
+
+  // the blit is part of the frame cost, so it is inside the timed range
+  if (timing) {
+    glEndQuery(GL_TIME_ELAPSED);
+    queryPending[queryIndex] = true;
+    queryIndex = (queryIndex + 1) % QUERY_COUNT;
+  }
+}
+
+void DynamicResolution::collectQueries() {
+  // queries finish in submission order, starting with the oldest slot
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    int slot = (queryIndex + i) % QUERY_COUNT;
+    if (!queryPending[slot])
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+    queryPending[slot] = false;
+    govern(elapsed * 1e-9);
+  }
+}
+
+void DynamicResolution::govern(double sample) {
+  if (!hasGpuTime) {
+    gpuTime = sample;
+    hasGpuTime = true;
+  } else {
+    gpuTime += (sample - gpuTime) * 0.2;
+  }
+
+  if (!enabled)
+    return;
+
+  // let the smoothed time catch up with the last change first
+  if (++samplesSinceChange < settleFrames)
+    return;
+
+  // fill-rate bound work scales with the pixel count, i.e. with scale^2
+  if (gpuTime > targetTime * (1.0f + hysteresis)) {
+    float fit = quantize(scale * (float)sqrt(targetTime / gpuTime));
+    float newScale = max(min(fit, scale - scaleStep), minScale);
+    if (newScale < scale)
+      setScale(newScale, "over budget");
+  } else if (scale < 1.0f) {
+    float next = min(scale + scaleStep, 1.0f);
+    double predicted = gpuTime * (next / scale) * (next / scale);
+    if (predicted < targetTime * (1.0f - hysteresis))
+      setScale(next, "headroom");
+  }
+}
+
+void DynamicResolution::setScale(float newScale, const char *reason) {
+  char buffer[96];
+  snprintf(buffer, sizeof(buffer), "res %.0f%% -> %.0f%% (%s, gpu %.1f ms)",
+           scale * 100.0f, newScale * 100.0f, reason, gpuTime * 1000.0);
+  lastDecision = buffer;
+  decisions++;
+
+  scale = newScale;
+  samplesSinceChange = 0;
+}
+
+float DynamicResolution::quantize(float value) const {
+  // the epsilon keeps exact multiples from rounding down a step
+  return floor(value / scaleStep + 1e-4f) * scaleStep;
+}
+
+void DynamicResolution::setEnabled(bool enable) {
+  enabled = enable;
+  samplesSinceChange = 0;
+}
+
+int DynamicResolution::getRenderWidth() const {
+  return max(1, (int)(windowWidth * getScale() + 0.5f));
+}
+
+int DynamicResolution::getRenderHeight() const {
+  return max(1, (int)(windowHeight * getScale() + 0.5f));
+}
+
+string DynamicResolution::takeDecision() {
+  string decision = lastDecision;
+  lastDecision.clear();
+  return decision;
+}
@@ -0,0 +1,218 @@
+#include "ring_particles.h"
+#include "gl_state.h"
+#include "memory.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#define PI 3.14159265358979323846
+
+using namespace std;
+using namespace glm;
+
+// leave particle mode a bit further out than it is entered, so hovering
+// around the switch distance doesn't flicker between the two
+static const float SWITCH_HYSTERESIS = 1.1f;
+// never thin the ring below this share of the particles
+static const float MIN_SHARE = 0.02f;
+// floor for the tilt factor of the projected area, see update()
+static const float MIN_FACING = 0.25f;
+
+RingParticles::RingParticles(int count, float innerRad, float outerRad,
+                             float thickness, float minSize, float maxSize,
+                             float degreesPerSecond, float lodDistance,
+                             float gpuBudgetSeconds)
+    : maxParticles(count), innerRadius(innerRad), outerRadius(outerRad),
+      queryIndex(0), switchDistance(lodDistance), gpuBudget(gpuBudgetSeconds),
+      active(false), coverageCount(0),
+      budgetCount(count), drawnCount(0), gpuTime(0.0), throughput(0.0) {
+  vector<Instance> instances;
+  createInstances(count, innerRad, outerRad, thickness, minSize, maxSize,
+                  degreesPerSecond, instances);
+  createBuffers(instances);
+
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    glGenQueries(2, queries[i]);
+    queryPending[i] = false;
+    queryDrawn[i] = 0;
+  }
+}
+
+RingParticles::~RingParticles() {
+  for (int i = 0; i < QUERY_COUNT; ++i)
+    glDeleteQueries(2, queries[i]);
+  GLState::deleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &quadVBO);
+  glDeleteBuffers(1, &instanceVBO);
+  MemoryTracker::releaseBuffer(quadVBO);
+  MemoryTracker::releaseBuffer(instanceVBO);
+}
+
+void RingParticles::createInstances(int count, float innerRad, float outerRad,
+                                    float thickness, float minSize,
+                                    float maxSize, float degreesPerSecond,
+                                    vector<Instance> &instances) {
+  mt19937 rng(1610); // fixed seed, the rings look the same every run
+  uniform_real_distribution<float> unit(0.0f, 1.0f);
+  normal_distribution<float> height(0.0f, thickness * 0.5f);
+
+  float inner2 = innerRad * innerRad;
+  float outer2 = outerRad * outerRad;
+
+  instances.resize(count);
+  for (auto &instance : instances) {
+    // uniform over the annulus area, not over the radius
+    float radius = sqrt(inner2 + (outer2 - inner2) * unit(rng));
+    // kepler's third law: angular speed falls off with r^1.5
+    float speed = degreesPerSecond * pow(innerRad / radius, 1.5f) *
+                  (float)PI / 180.0f;
+    instance.orbit = vec4(radius, unit(rng) * 2.0f * (float)PI, speed,
+                          height(rng));
+    float t = unit(rng);
+    instance.size = minSize + (maxSize - minSize) * t * t;
+  }
+}
+
+void RingParticles::createBuffers(const vector<Instance> &instances) {
+  // one camera-facing quad, expanded in the vertex shader
+  const float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &quadVBO);
+  glGenBuffers(1, &instanceVBO);
+
+  GLState::bindVertexArray(VAO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(quadVBO, MEMORY_GEOMETRY, sizeof(corners));
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
+                        (void *)0);
+  glEnableVertexAttribArray(0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance),
+               instances.data(), GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(instanceVBO, MEMORY_INSTANCES,
+                             instances.size() * sizeof(Instance));
+
+  // per instance: orbit and size
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(1, 1);
+  glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)sizeof(vec4));
+  glEnableVertexAttribArray(2);
+  glVertexAttribDivisor(2, 1);
+
+  GLState::bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void RingParticles::collectQueries() {
+  // queries finish in submission order, starting with the oldest slot
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    int slot = (queryIndex + i) % QUERY_COUNT;
+    if (!queryPending[slot])
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available)
+      break;
+
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+    queryPending[slot] = false;
+
+    double elapsed = (end - start) * 1e-9;
+    int drawn = queryDrawn[slot];
+    if (drawn <= 0 || elapsed <= 0.0)
+      continue;
+
+    if (gpuTime == 0.0) {
+      gpuTime = elapsed;
+      throughput = drawn / elapsed;
+    } else {
+      gpuTime += (elapsed - gpuTime) * 0.2;
+      throughput += (drawn / elapsed - throughput) * 0.2;
+    }
+
+    // the pass is vertex bound, so its cost grows linearly with the count
+    double fit = gpuBudget * throughput;
+    budgetCount = (int)min((double)maxParticles,
+                           max(fit, (double)maxParticles * MIN_SHARE));
+  }
+}
+
+void RingParticles::update(const Ring &ring, const vec3 &eye, float fovY,
+                           float viewportWidth, float viewportHeight) {
+  collectQueries();
+
+  vec3 toEye = eye - ring.getPosition();
+  float distance = length(toEye);
+  float limit = switchDistance * outerRadius;
+  active = distance < (active ? limit * SWITCH_HYSTERESIS : limit);
+
+  if (!active) {
+    coverageCount = 0;
+    drawnCount = 0;
+    return;
+  }
+
+  // projected area of the annulus as a share of the viewport. seen edge-on
+  // the area vanishes but the particles still pile up along the line of
+  // sight, so the tilt factor has a floor
+  float pixelsPerUnit =
+      viewportHeight * 0.5f / tan(fovY * 0.5f) / max(distance, 1e-3f);
+  float facing = distance > 0.0f
+                     ? fabs(dot(ring.getNormal(), toEye / distance))
+                     : 1.0f;
+  float area = (float)PI *
+               (outerRadius * outerRadius - innerRadius * innerRadius) *
+               pixelsPerUnit * pixelsPerUnit * max(facing, MIN_FACING);
+  float share = area / max(viewportWidth * viewportHeight, 1.0f);
+  share = min(max(share, MIN_SHARE), 1.0f);
+
+  coverageCount = (int)(share * maxParticles);
+  drawnCount = min(coverageCount, budgetCount);
+}
+
+void RingParticles::render(Ring &ring, Shader &particleShader,
+                           Shader &ringShader, float time,
+                           float viewportHeight) {
+  if (!active) {
+    ring.render(ringShader);
+    return;
+  }
+  if (drawnCount <= 0)
+    return;
+
+  particleShader.use();
+  particleShader.setMat4("model", ring.getModelMatrix());
+  particleShader.setFloat("time", time);
+  particleShader.setFloat("innerRadius", innerRadius);
+  particleShader.setFloat("outerRadius", outerRadius);
+  particleShader.setFloat("viewportHeight", viewportHeight);
+
+  ring.getTexture()->bind(0);
+  particleShader.setInt("texture1", 0);
+
+  // opaque discs with depth writes, no blending or sorting needed
+  bool timing = !queryPending[queryIndex];
+  if (timing)
+    glQueryCounter(queries[queryIndex][0], GL_TIMESTAMP);
+
+  GLState::setOpaque();
+  GLState::bindVertexArray(VAO);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, drawnCount);
+
+  if (timing) {
+    glQueryCounter(queries[queryIndex][1], GL_TIMESTAMP);
+    queryPending[queryIndex] = true;
+    queryDrawn[queryIndex] = drawnCount;
+    queryIndex = (queryIndex + 1) % QUERY_COUNT;
+  }
+}
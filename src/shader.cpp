@@ -1,4 +1,5 @@
 #include "shader.h"
+#include "gl_state.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -6,10 +7,12 @@
 
 using namespace std;
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
+Shader::Shader(const char* vertexPath, const char* fragmentPath,
+               const string &header) {
 
-    string vertexCode = loadShaderFromFile(vertexPath);
-    string fragmentCode = loadShaderFromFile(fragmentPath);
+    string vertexCode = insertHeader(loadShaderFromFile(vertexPath), header);
+    string fragmentCode =
+        insertHeader(loadShaderFromFile(fragmentPath), header);
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
     
@@ -35,8 +38,44 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
     glDeleteShader(fragment);
 }
 
+Shader::Shader(const char* vertexPath, const char* geometryPath,
+               const vector<string> &feedbackVaryings) {
+
+    unsigned int vertex = compileStage(GL_VERTEX_SHADER, vertexPath, "VERTEX");
+    unsigned int geometry =
+        compileStage(GL_GEOMETRY_SHADER, geometryPath, "GEOMETRY");
+
+    ID = glCreateProgram();
+    glAttachShader(ID, vertex);
+    glAttachShader(ID, geometry);
+
+    // the captured outputs must be named before linking
+    vector<const char*> names;
+    for (const auto &varying : feedbackVaryings)
+        names.push_back(varying.c_str());
+    glTransformFeedbackVaryings(ID, (GLsizei)names.size(), names.data(),
+                                GL_INTERLEAVED_ATTRIBS);
+
+    glLinkProgram(ID);
+    checkCompileErrors(ID, "PROGRAM");
+
+    glDeleteShader(vertex);
+    glDeleteShader(geometry);
+}
+
+unsigned int Shader::compileStage(GLenum stage, const char* path, string type) {
+    string code = loadShaderFromFile(path);
+    const char* source = code.c_str();
+
+    unsigned int shader = glCreateShader(stage);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    checkCompileErrors(shader, type);
+    return shader;
+}
+
 void Shader::use() const {
-    glUseProgram(ID);
+    GLState::useProgram(ID);
 }
 
 void Shader::setBool(const string &name, bool value) const {
@@ -63,6 +102,12 @@ void Shader::setMat4(const string &name, const glm::mat4 &mat) const {
     glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
 }
 
+void Shader::bindUniformBlock(const string &name, unsigned int binding) const {
+    unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, index, binding);
+}
+
 void Shader::checkCompileErrors(unsigned int shader, string type) {
     int success;
     char infoLog[1024];
@@ -96,3 +141,12 @@ string Shader::loadShaderFromFile(const char* filePath) {
     
     return buffer.str();
 }
+
+string Shader::insertHeader(const string &code, const string &header) {
+    if (header.empty())
+        return code;
+    size_t lineEnd = code.find('\n');
+    if (lineEnd == string::npos)
+        return code + "\n" + header;
+    return code.substr(0, lineEnd + 1) + header + code.substr(lineEnd + 1);
+}
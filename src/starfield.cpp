@@ -0,0 +1,120 @@
+#include "starfield.h"
+#include "clock.h"
+#include "gl_state.h"
+#include "memory.h"
+#include "star_catalog.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+StarField::StarField(float magnitudeLimit, float referenceFovY, float minSize,
+                     float maxSize, float limitBrightness)
+    : VAO(0), VBO(0), magnitudeLimit(magnitudeLimit),
+      referenceFovY(referenceFovY), minSize(minSize), maxSize(maxSize),
+      limitBrightness(limitBrightness), drawnCount(0), loadTime(0.0),
+      gpuBytes(0) {}
+
+StarField::~StarField() {
+  MemoryTracker::releaseBuffer(VBO);
+  MemoryTracker::releaseCpu(this);
+  GLState::deleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+}
+
+bool StarField::load(const char *path) {
+  double start = now();
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    cerr << "Failed to open " << path << endl;
+    return false;
+  }
+
+  StarCatalogHeader header;
+  vector<StarRecord> records;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, STAR_CATALOG_MAGIC, 4) == 0 &&
+               header.version == STAR_CATALOG_VERSION &&
+               header.recordSize == sizeof(StarRecord);
+  if (valid) {
+    records.resize(header.count);
+    valid = fread(records.data(), sizeof(StarRecord), records.size(), file) ==
+            records.size();
+  }
+  fclose(file);
+  if (!valid || records.empty()) {
+    cerr << "Invalid star catalog " << path << endl;
+    return false;
+  }
+
+  magnitudes.resize(records.size());
+  for (size_t i = 0; i < records.size(); ++i)
+    magnitudes[i] = records[i].magnitude * 0.001f;
+  MemoryTracker::trackCpu(this, MEMORY_CPU_SCENE,
+                          magnitudes.capacity() * sizeof(float));
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  GLState::bindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  gpuBytes = records.size() * sizeof(StarRecord);
+  glBufferData(GL_ARRAY_BUFFER, gpuBytes, records.data(), GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(VBO, MEMORY_GEOMETRY, gpuBytes);
+
+  // the records as stored: normalised direction, magnitude in thousandths
+  // (scaled in the shader) and an 8-bit colour
+  glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(StarRecord),
+                        (void *)offsetof(StarRecord, direction));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 1, GL_SHORT, GL_FALSE, sizeof(StarRecord),
+                        (void *)offsetof(StarRecord, magnitude));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StarRecord),
+                        (void *)offsetof(StarRecord, color));
+  glEnableVertexAttribArray(2);
+
+  GLState::bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  loadTime = now() - start;
+  return true;
+}
+
+void StarField::render(Shader &shader, float fovY) {
+  drawnCount = 0;
+  if (magnitudes.empty())
+    return;
+
+  // zooming in gathers light like a wider aperture: 5 magnitudes per tenfold
+  // magnification
+  float limit = magnitudeLimit + 5.0f * log10(tan(referenceFovY * 0.5f) /
+                                              tan(fovY * 0.5f));
+  drawnCount = (int)(upper_bound(magnitudes.begin(), magnitudes.end(), limit) -
+                     magnitudes.begin());
+  if (drawnCount == 0)
+    return;
+
+  shader.use();
+  shader.setFloat("magnitudeLimit", limit);
+  shader.setFloat("limitBrightness", limitBrightness);
+  shader.setFloat("minSize", minSize);
+  shader.setFloat("maxSize", maxSize);
+
+  // at infinity on the far plane like the sky, drawn after the bodies so
+  // the depth test drops the stars behind them
+  // point size only matters for points and nothing else draws any, so it
+  // is left on
+  GLState::setCapability(GL_DEPTH_TEST, true);
+  GLState::depthFunc(GL_LEQUAL);
+  GLState::depthMask(false);
+  GLState::setCapability(GL_PROGRAM_POINT_SIZE, true);
+  GLState::setCapability(GL_BLEND, true);
+  GLState::blendFunc(GL_ONE, GL_ONE);
+
+  GLState::bindVertexArray(VAO);
+  glDrawArrays(GL_POINTS, 0, drawnCount);
+}
@@ -0,0 +1,550 @@
+#include "streamer.h"
+#include "clock.h"
+#include "cubemap.h"
+#include "gl_state.h"
+#include "memory.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+TextureStreamer::TextureStreamer(size_t budget, int tile, int fallback,
+                                 int tilesEachFrame)
+    : budgetBytes(budget), residentBytes(0), tileSize(tile),
+      fallbackSize(fallback), tilesPerFrame(tilesEachFrame), frame(0),
+      sharedLoads(0), decoder(1) {}
+
+TextureStreamer::~TextureStreamer() {
+  for (auto &tex : textures) {
+    GLState::deleteTextures(1, &tex.texture->ID);
+    MemoryTracker::releaseTexture(tex.texture->ID);
+    MemoryTracker::releaseCpu(tex.texture);
+    delete tex.texture;
+  }
+  for (Texture *texture : cubemaps) {
+    GLState::deleteTextures(1, &texture->ID);
+    MemoryTracker::releaseTexture(texture->ID);
+    delete texture;
+  }
+}
+
+// 2x2 box filter, odd edges repeat the last row or column
+static void downsample(const unsigned char *src, int srcWidth, int srcHeight,
+                       unsigned char *dst, int dstWidth, int dstHeight,
+                       int channels) {
+  for (int y = 0; y < dstHeight; ++y) {
+    int y0 = min(y * 2, srcHeight - 1);
+    int y1 = min(y * 2 + 1, srcHeight - 1);
+    for (int x = 0; x < dstWidth; ++x) {
+      int x0 = min(x * 2, srcWidth - 1);
+      int x1 = min(x * 2 + 1, srcWidth - 1);
+      for (int c = 0; c < channels; ++c) {
+        int sum = src[((size_t)y0 * srcWidth + x0) * channels + c] +
+                  src[((size_t)y0 * srcWidth + x1) * channels + c] +
+                  src[((size_t)y1 * srcWidth + x0) * channels + c] +
+                  src[((size_t)y1 * srcWidth + x1) * channels + c];
+        dst[((size_t)y * dstWidth + x) * channels + c] =
+            (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// decodes the file and filters it down to the given level, the same chain
+// load() builds. empty if the file can no longer be read
+static void decodeLevel(const string &path, int level, int channels,
+                        vector<unsigned char> &pixels) {
+  int width, height, fileChannels;
+  unsigned char *data =
+      stbi_load(path.c_str(), &width, &height, &fileChannels, channels);
+  if (!data)
+    return;
+
+  pixels.assign(data, data + (size_t)width * height * channels);
+  stbi_image_free(data);
+
+  vector<unsigned char> next;
+  for (int i = 0; i < level; ++i) {
+    int w = max(1, width / 2);
+    int h = max(1, height / 2);
+    next.resize((size_t)w * h * channels);
+    downsample(pixels.data(), width, height, next.data(), w, h, channels);
+    pixels.swap(next);
+    width = w;
+    height = h;
+  }
+  pixels.resize((size_t)width * height * channels);
+  pixels.shrink_to_fit();
+}
+
+Texture *TextureStreamer::findLoaded(const char *path, GLenum target) {
+  auto it = loaded.find(make_pair(string(path), target));
+  if (it == loaded.end())
+    return nullptr;
+  ++sharedLoads;
+  return it->second;
+}
+
+Texture *TextureStreamer::load(const char *path) {
+  Texture *shared = findLoaded(path, GL_TEXTURE_2D);
+  if (shared)
+    return shared;
+
+  StreamedTexture tex;
+  tex.path = path;
+  tex.residentLevel = 0;
+  tex.loadingLevel = -1;
+  tex.fallbackLevel = 0;
+  tex.wantedLevel = 0;
+  tex.unreadable = false;
+
+  unsigned int textureID;
+  glGenTextures(1, &textureID);
+  tex.texture = new Texture(textureID, path);
+  loaded[make_pair(string(path), (GLenum)GL_TEXTURE_2D)] = tex.texture;
+
+  int width, height, nrChannels;
+  unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
+  if (!data) {
+    cerr << "Failed to load texture: " << path << endl;
+    tex.channels = 0;
+    tex.format = GL_RGB;
+    textures.push_back(move(tex));
+    return textures.back().texture;
+  }
+
+  tex.channels = nrChannels;
+  if (nrChannels == 1)
+    tex.format = GL_RED;
+  else if (nrChannels == 4)
+    tex.format = GL_RGBA;
+  else
+    tex.format = GL_RGB;
+
+  // the level sizes of the whole mip chain, the gpu only ever receives the
+  // levels that are currently needed
+  for (int w = width, h = height;; w = max(1, w / 2), h = max(1, h / 2)) {
+    Level level;
+    level.width = w;
+    level.height = h;
+    level.allocated = false;
+    level.tilesPending = 0;
+    level.lastUsedFrame = 0;
+    tex.levels.push_back(level);
+    if (w == 1 && h == 1)
+      break;
+  }
+
+  int levelCount = (int)tex.levels.size();
+  tex.fallbackLevel = levelCount - 1;
+  for (int i = 0; i < levelCount; ++i) {
+    if (max(tex.levels[i].width, tex.levels[i].height) <= fallbackSize) {
+      tex.fallbackLevel = i;
+      break;
+    }
+  }
+  tex.residentLevel = tex.fallbackLevel;
+  tex.wantedLevel = tex.fallbackLevel;
+
+  GLState::bindTexture(GL_TEXTURE_2D, textureID);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  // filter down with two buffers, the fallback levels go up in full once
+  // and nothing stays on the cpu
+  vector<unsigned char> pixels(data, data + (size_t)width * height *
+                                                nrChannels);
+  stbi_image_free(data);
+  vector<unsigned char> next;
+  for (int i = 0; i < levelCount; ++i) {
+    Level &level = tex.levels[i];
+    if (i > 0) {
+      const Level &src = tex.levels[i - 1];
+      next.resize((size_t)level.width * level.height * nrChannels);
+      downsample(pixels.data(), src.width, src.height, next.data(),
+                 level.width, level.height, nrChannels);
+      pixels.swap(next);
+    }
+    if (i < tex.fallbackLevel)
+      continue;
+
+    glTexImage2D(GL_TEXTURE_2D, i, tex.format, level.width, level.height, 0,
+                 tex.format, GL_UNSIGNED_BYTE, pixels.data());
+    level.allocated = true;
+    residentBytes += levelBytes(tex, i);
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  trackMemory(tex);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tex.fallbackLevel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  cout << "Texture streamed: " << path << " (" << width << "x" << height
+       << ", " << levelCount << " levels, resident from "
+       << tex.levels[tex.fallbackLevel].width << "x"
+       << tex.levels[tex.fallbackLevel].height << ")" << endl;
+
+  textures.push_back(move(tex));
+  return textures.back().texture;
+}
+
+Texture *TextureStreamer::loadCubemap(const char *path, const char *cacheDir,
+                                      unsigned int threads) {
+  Texture *shared = findLoaded(path, GL_TEXTURE_CUBE_MAP);
+  if (shared)
+    return shared;
+
+  unsigned int textureID;
+  glGenTextures(1, &textureID);
+  Texture *texture = new Texture(textureID, path, GL_TEXTURE_CUBE_MAP);
+  cubemaps.push_back(texture);
+  loaded[make_pair(string(path), (GLenum)GL_TEXTURE_CUBE_MAP)] = texture;
+
+  // assets/textures/2k_moon.jpg is cached as <cacheDir>/2k_moon.cube
+  string name = path;
+  name = name.substr(name.find_last_of("/\\") + 1);
+  name = name.substr(0, name.find_last_of('.'));
+  string cached = string(cacheDir) + "/" + name + ".cube";
+
+  int width = 0, height = 0, nrChannels = 0;
+  stbi_info(path, &width, &height, &nrChannels);
+
+  double start = now();
+  CubemapImage image;
+  bool converted = !readCubemap(cached.c_str(), image);
+  if (converted) {
+    unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
+    if (!data) {
+      cerr << "Failed to load texture: " << path << endl;
+      return texture;
+    }
+    ThreadPool pool(threads);
+    convertEquirect(data, width, height, nrChannels, cubemapFaceSize(width),
+                    &pool, image);
+    stbi_image_free(data);
+  }
+  double seconds = now() - start;
+
+  GLenum format = GL_RGB;
+  if (image.channels == 1)
+    format = GL_RED;
+  else if (image.channels == 4)
+    format = GL_RGBA;
+
+  GLState::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  int levelCount = (int)image.levels.size();
+  for (int level = 0; level < levelCount; ++level) {
+    int size = image.levelSize(level);
+    for (int face = 0; face < 6; ++face) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, format, size,
+                   size, 0, format, GL_UNSIGNED_BYTE, image.face(level, face));
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  MemoryTracker::trackTexture(textureID, MEMORY_TEXTURES, image.getBytes());
+
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  size_t before = equirectBytes(max(width, 1), max(height, 1), image.channels);
+  cout << "Cubemap " << (converted ? "converted" : "loaded") << ": " << path
+       << " (6x" << image.faceSize << "x" << image.faceSize << " in "
+       << seconds * 1000.0 << " ms";
+  if (converted) {
+    cout << ", " << 6.0 * image.faceSize * image.faceSize / seconds / 1e6
+         << " Mtexel/s";
+  }
+  cout << ", " << image.getBytes() / 1048576.0 << " MB against "
+       << before / 1048576.0 << " MB as a 2d map";
+  if (width > 0) {
+    cout << ", " << 100.0 * cubemapCentreResolution(image.faceSize, width)
+         << "% of its resolution at the face centres";
+  }
+  cout << ")" << endl;
+  return texture;
+}
+
+int TextureStreamer::findTexture(const Texture *texture) const {
+  for (size_t i = 0; i < textures.size(); ++i) {
+    if (textures[i].texture == texture)
+      return (int)i;
+  }
+  return -1;
+}
+
+size_t TextureStreamer::levelBytes(const StreamedTexture &tex,
+                                   int level) const {
+  return (size_t)tex.levels[level].width * tex.levels[level].height *
+         tex.channels;
+}
+
+void TextureStreamer::request(const Texture *texture, float texels) {
+  int index = findTexture(texture);
+  if (index < 0 || textures[index].levels.empty() ||
+      textures[index].unreadable)
+    return;
+
+  StreamedTexture &tex = textures[index];
+
+  // pick the coarsest level that still has at least the texels needed
+  int level = tex.fallbackLevel;
+  if (texels > 0.0f) {
+    float ratio = tex.levels[0].width / texels;
+    level = ratio <= 1.0f ? 0 : (int)floor(log2(ratio));
+    level = min(level, tex.fallbackLevel);
+  }
+
+  tex.wantedLevel = min(tex.wantedLevel, level);
+  for (int i = level; i < tex.fallbackLevel; ++i) {
+    tex.levels[i].lastUsedFrame = frame;
+  }
+}
+
+void TextureStreamer::update() {
+  schedule(false);
+  upload(tilesPerFrame);
+
+  // the budget may have shrunk or levels piled up while they were in use
+  while (residentBytes > budgetBytes && evictOne(frame)) {
+  }
+
+  for (auto &tex : textures)
+    tex.wantedLevel = tex.fallbackLevel;
+  frame++;
+}
+
+void TextureStreamer::flush() {
+  // upload everything requested right away, used when frames must be complete
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    schedule(true);
+    if (!queue.empty()) {
+      upload(INT_MAX);
+      progress = true;
+    }
+  }
+
+  for (auto &tex : textures)
+    tex.wantedLevel = tex.fallbackLevel;
+  frame++;
+}
+
+void TextureStreamer::schedule(bool wait) {
+  // refine one level at a time per texture, coarse to fine, so the sampler
+  // always sees a contiguous chain from the base level down
+  for (size_t i = 0; i < textures.size(); ++i) {
+    StreamedTexture &tex = textures[i];
+    if (tex.decoding.valid()) {
+      if (wait)
+        tex.decoding.wait();
+      if (tex.decoding.wait_for(chrono::seconds(0)) == future_status::ready)
+        queueTiles((int)i);
+    }
+    if (tex.loadingLevel >= 0 || tex.wantedLevel >= tex.residentLevel)
+      continue;
+
+    int next = tex.residentLevel - 1;
+    size_t needed = levelBytes(tex, next);
+
+    // only levels nobody used this frame may make room
+    while (residentBytes + needed > budgetBytes && evictOne(frame)) {
+    }
+
+    if (residentBytes + needed <= budgetBytes) {
+      scheduleLevel((int)i, next);
+      if (wait) {
+        tex.decoding.wait();
+        queueTiles((int)i);
+      }
+    }
+  }
+}
+
+void TextureStreamer::upload(int maxTiles) {
+  for (int uploaded = 0; uploaded < maxTiles && !queue.empty(); ++uploaded) {
+    TileRequest tile = queue.front();
+    queue.pop_front();
+    uploadTile(tile);
+  }
+}
+
+void TextureStreamer::allocateLevel(StreamedTexture &tex, int level) {
+  Level &l = tex.levels[level];
+  GLState::bindTexture(GL_TEXTURE_2D, tex.texture->ID);
+  glTexImage2D(GL_TEXTURE_2D, level, tex.format, l.width, l.height, 0,
+               tex.format, GL_UNSIGNED_BYTE, NULL);
+  l.allocated = true;
+  residentBytes += levelBytes(tex, level);
+  trackMemory(tex);
+}
+
+void TextureStreamer::freeLevel(StreamedTexture &tex, int level) {
+  Level &l = tex.levels[level];
+  if (!l.allocated)
+    return;
+
+  // respecifying the level with zero size releases its storage, the level
+  // sits below GL_TEXTURE_BASE_LEVEL so the texture stays complete
+  GLState::bindTexture(GL_TEXTURE_2D, tex.texture->ID);
+  glTexImage2D(GL_TEXTURE_2D, level, tex.format, 0, 0, 0, tex.format,
+               GL_UNSIGNED_BYTE, NULL);
+  l.allocated = false;
+  l.tilesPending = 0;
+  residentBytes -= levelBytes(tex, level);
+  trackMemory(tex);
+}
+
+void TextureStreamer::trackMemory(const StreamedTexture &tex) const {
+  // the gpu side counts the allocated levels, the cpu side the decoded
+  // level whose tiles are uploading
+  size_t gpu = 0, cpu = 0;
+  for (int i = 0; i < (int)tex.levels.size(); ++i) {
+    if (tex.levels[i].allocated)
+      gpu += levelBytes(tex, i);
+    if (tex.levels[i].pixels)
+      cpu += tex.levels[i].pixels->capacity();
+  }
+  MemoryTracker::trackTexture(tex.texture->ID, MEMORY_TEXTURES, gpu);
+  MemoryTracker::trackCpu(tex.texture, MEMORY_CPU_TEXTURES, cpu);
+}
+
+void TextureStreamer::scheduleLevel(int index, int level) {
+  StreamedTexture &tex = textures[index];
+
+  // the storage is allocated now so the budget counts the level while it
+  // decodes, the worker only touches its own buffer
+  allocateLevel(tex, level);
+  tex.loadingLevel = level;
+
+  shared_ptr<vector<unsigned char>> pixels =
+      make_shared<vector<unsigned char>>();
+  tex.levels[level].pixels = pixels;
+  string path = tex.path;
+  int channels = tex.channels;
+  tex.decoding = decoder.submit([path, level, channels, pixels]() {
+    decodeLevel(path, level, channels, *pixels);
+  });
+}
+
+void TextureStreamer::queueTiles(int index) {
+  StreamedTexture &tex = textures[index];
+  Level &l = tex.levels[tex.loadingLevel];
+  tex.decoding.get();
+  trackMemory(tex);
+
+  if (l.pixels->size() != levelBytes(tex, tex.loadingLevel)) {
+    cerr << "Failed to decode texture: " << tex.path << endl;
+    int level = tex.loadingLevel;
+    l.pixels.reset();
+    tex.loadingLevel = -1;
+    tex.unreadable = true;
+    freeLevel(tex, level);
+    return;
+  }
+
+  l.tilesPending = 0;
+  for (int y = 0; y < l.height; y += tileSize) {
+    for (int x = 0; x < l.width; x += tileSize) {
+      TileRequest tile;
+      tile.texture = index;
+      tile.level = tex.loadingLevel;
+      tile.x = x;
+      tile.y = y;
+      queue.push_back(tile);
+      l.tilesPending++;
+    }
+  }
+}
+
+void TextureStreamer::uploadTile(const TileRequest &tile) {
+  StreamedTexture &tex = textures[tile.texture];
+  Level &l = tex.levels[tile.level];
+
+  int w = min(tileSize, l.width - tile.x);
+  int h = min(tileSize, l.height - tile.y);
+
+  GLState::bindTexture(GL_TEXTURE_2D, tex.texture->ID);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, l.width);
+  glTexSubImage2D(
+      GL_TEXTURE_2D, tile.level, tile.x, tile.y, w, h, tex.format,
+      GL_UNSIGNED_BYTE,
+      &(*l.pixels)[((size_t)tile.y * l.width + tile.x) * tex.channels]);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  if (--l.tilesPending == 0) {
+    tex.loadingLevel = -1;
+    tex.residentLevel = tile.level;
+    setBaseLevel(tex, tile.level);
+    // the gpu has its copy, an evicted level is decoded again when wanted
+    l.pixels.reset();
+    trackMemory(tex);
+  }
+}
+
+void TextureStreamer::setBaseLevel(StreamedTexture &tex, int level) {
+  GLState::bindTexture(GL_TEXTURE_2D, tex.texture->ID);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+bool TextureStreamer::evictOne(unsigned long protectFrame) {
+  // candidates are the finest allocated level of each texture, the chain
+  // has to stay contiguous so nothing coarser can go first
+  int victim = -1;
+  int victimLevel = -1;
+  unsigned long oldest = protectFrame;
+
+  for (size_t i = 0; i < textures.size(); ++i) {
+    StreamedTexture &tex = textures[i];
+    int finest = tex.loadingLevel >= 0 ? tex.loadingLevel : tex.residentLevel;
+    if (finest >= tex.fallbackLevel)
+      continue;
+
+    if (tex.levels[finest].lastUsedFrame < oldest) {
+      oldest = tex.levels[finest].lastUsedFrame;
+      victim = (int)i;
+      victimLevel = finest;
+    }
+  }
+
+  if (victim < 0)
+    return false;
+
+  StreamedTexture &tex = textures[victim];
+
+  if (victimLevel == tex.loadingLevel) {
+    // drop the queued tiles of a level that never finished loading, or let
+    // a decode still running finish into a buffer nobody reads
+    tex.decoding = future<void>();
+    tex.levels[victimLevel].pixels.reset();
+    deque<TileRequest> remaining;
+    for (const auto &tile : queue) {
+      if (tile.texture != victim || tile.level != victimLevel)
+        remaining.push_back(tile);
+    }
+    queue.swap(remaining);
+    tex.loadingLevel = -1;
+  } else {
+    tex.residentLevel = victimLevel + 1;
+    setBaseLevel(tex, tex.residentLevel);
+  }
+
+  freeLevel(tex, victimLevel);
+  return true;
+}
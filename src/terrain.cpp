@@ -0,0 +1,438 @@
+#include "terrain.h"
+#include "frame_builder.h"
+#include "gl_state.h"
+#include "memory.h"
+#include "mesh.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// the key packs body, face, level and position, so levels stop at 20
+static const int MAX_KEY_LEVEL = 20;
+// keep at least the roots and a few levels below them
+static const int MIN_SLOTS = 6 * 5;
+
+// cube faces as (normal, u axis, v axis) with u x v = normal
+static const float FACES[6][3][3] = {
+    {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},  {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+    {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}},  {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+    {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},   {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}}};
+
+// point (u, v) in [-1, 1]^2 of a cube face moved onto the unit sphere. the
+// spherified mapping spreads the vertices more evenly than normalising
+static vec3 cubeToSphere(int face, float u, float v) {
+  const float(*f)[3] = FACES[face];
+  float x = f[0][0] + f[1][0] * u + f[2][0] * v;
+  float y = f[0][1] + f[1][1] * u + f[2][1] * v;
+  float z = f[0][2] + f[1][2] * u + f[2][2] * v;
+  float x2 = x * x, y2 = y * y, z2 = z * z;
+  return vec3(x * sqrt(1.0f - y2 * 0.5f - z2 * 0.5f + y2 * z2 / 3.0f),
+              y * sqrt(1.0f - z2 * 0.5f - x2 * 0.5f + z2 * x2 / 3.0f),
+              z * sqrt(1.0f - x2 * 0.5f - y2 * 0.5f + x2 * y2 / 3.0f));
+}
+
+// largest distance between the unit sphere and a chunk's flat triangles, as
+// a fraction of the radius: a face spans a quarter turn, halved per level
+static float geometricError(int level, int resolution) {
+  float angle = 1.5707963f / (float)(1 << level) / resolution;
+  return 1.0f - cos(angle * 0.5f);
+}
+
+TerrainRenderer::TerrainRenderer(int resolution, size_t budgetBytes,
+                                 float maxPixelError, float minPixels,
+                                 int maxLevel, unsigned int threads,
+                                 int uploadsPerFrame, int maxPending)
+    : resolution(max(1, resolution)), maxPixelError(maxPixelError),
+      minPixels(minPixels), maxLevel(min(max(maxLevel, 0), MAX_KEY_LEVEL)),
+      uploadsPerFrame(max(uploadsPerFrame, 1)),
+      maxPending(max(maxPending, 1)), frame(0), drawnChunks(0),
+      uploadedChunks(0), pool(threads) {
+  int n = this->resolution + 1;
+  vertexCount = n * n + 4 * n;
+  chunkBytes = (size_t)vertexCount * VERTEX_FORMAT_TERRAIN.stride;
+  maxSlots = max((int)(budgetBytes / chunkBytes), MIN_SLOTS);
+
+  vector<unsigned short> indices;
+  generateIndices(this->resolution, indices);
+  indexCount = (int)indices.size();
+
+  // the element binding belongs to the bound vertex array, keep it off ours
+  GLState::bindVertexArray(0);
+  glGenBuffers(1, &IBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               indices.size() * sizeof(unsigned short), indices.data(),
+               GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(IBO, MEMORY_GEOMETRY,
+                             indices.size() * sizeof(unsigned short));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+TerrainRenderer::~TerrainRenderer() {
+  // workers write into results, let them finish first
+  pool.wait();
+
+  for (Slot &slot : slots) {
+    MemoryTracker::releaseBuffer(slot.VBO);
+    glDeleteBuffers(1, &slot.VBO);
+    GLState::deleteVertexArrays(1, &slot.VAO);
+  }
+  MemoryTracker::releaseBuffer(IBO);
+  glDeleteBuffers(1, &IBO);
+}
+
+uint64_t TerrainRenderer::makeKey(int body, int face, int level, int x,
+                                  int y) {
+  return ((uint64_t)(body & 0xFFFF) << 48) | ((uint64_t)face << 45) |
+         ((uint64_t)level << 40) | ((uint64_t)x << 20) | (uint64_t)y;
+}
+
+void TerrainRenderer::generateChunk(int face, int level, int x, int y,
+                                    int resolution, float skirtDepth,
+                                    vector<float> &positions) {
+  int n = resolution + 1;
+  positions.resize((size_t)(n * n + 4 * n) * 3);
+
+  float size = 2.0f / (float)(1 << level);
+  float u0 = -1.0f + x * size;
+  float v0 = -1.0f + y * size;
+  float step = size / resolution;
+
+  float *out = positions.data();
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      vec3 p = cubeToSphere(face, u0 + i * step, v0 + j * step);
+      *out++ = p.x;
+      *out++ = p.y;
+      *out++ = p.z;
+    }
+  }
+
+  // skirts along the bottom, top, left and right edges
+  float scale = 1.0f - skirtDepth;
+  for (int edge = 0; edge < 4; ++edge) {
+    for (int k = 0; k < n; ++k) {
+      int i = edge < 2 ? k : (edge == 2 ? 0 : resolution);
+      int j = edge < 2 ? (edge == 0 ? 0 : resolution) : k;
+      const float *p = &positions[(size_t)(j * n + i) * 3];
+      *out++ = p[0] * scale;
+      *out++ = p[1] * scale;
+      *out++ = p[2] * scale;
+    }
+  }
+}
+
+void TerrainRenderer::generateIndices(int resolution,
+                                      vector<unsigned short> &indices) {
+  int n = resolution + 1;
+  indices.clear();
+  indices.reserve((size_t)resolution * resolution * 6 + 4 * resolution * 6);
+
+  auto quad = [&indices](int a, int b, int c, int d) {
+    unsigned short corners[6] = {(unsigned short)a, (unsigned short)b,
+                                 (unsigned short)c, (unsigned short)a,
+                                 (unsigned short)c, (unsigned short)d};
+    indices.insert(indices.end(), corners, corners + 6);
+  };
+
+  for (int j = 0; j < resolution; ++j) {
+    for (int i = 0; i < resolution; ++i) {
+      int corner = j * n + i;
+      quad(corner, corner + 1, corner + n + 1, corner + n);
+    }
+  }
+
+  // each skirt vertex hangs below the edge vertex generateChunk copied
+  for (int edge = 0; edge < 4; ++edge) {
+    int skirt = n * n + edge * n;
+    for (int k = 0; k < resolution; ++k) {
+      int i = edge < 2 ? k : (edge == 2 ? 0 : resolution);
+      int j = edge < 2 ? (edge == 0 ? 0 : resolution) : k;
+      int grid = j * n + i;
+      int next = edge < 2 ? grid + 1 : grid + n;
+      quad(grid, next, skirt + k + 1, skirt + k);
+    }
+  }
+}
+
+bool TerrainRenderer::touch(uint64_t key, int &slot) {
+  auto it = resident.find(key);
+  if (it == resident.end())
+    return false;
+  slot = it->second;
+  slots[slot].lastUsed = frame;
+  return true;
+}
+
+void TerrainRenderer::request(uint64_t key, int face, int level, int x,
+                              int y) {
+  if (pending.count(key) || (int)pending.size() >= maxPending)
+    return;
+  pending.insert(key);
+
+  int chunkResolution = resolution;
+  // deep enough to meet a neighbour two levels coarser
+  float skirtDepth = geometricError(max(level - 2, 0), resolution);
+  pool.submit([this, key, face, level, x, y, chunkResolution, skirtDepth]() {
+    Result result;
+    result.key = key;
+    generateChunk(face, level, x, y, chunkResolution, skirtDepth,
+                  result.positions);
+
+    lock_guard<mutex> lock(resultMutex);
+    results.push_back(move(result));
+  });
+}
+
+int TerrainRenderer::acquireSlot() {
+  if ((int)slots.size() < maxSlots) {
+    Slot slot;
+    slot.used = false;
+    slot.key = 0;
+    slot.lastUsed = 0;
+
+    glGenVertexArrays(1, &slot.VAO);
+    glGenBuffers(1, &slot.VBO);
+    GLState::bindVertexArray(slot.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, slot.VBO);
+    glBufferData(GL_ARRAY_BUFFER, chunkBytes, nullptr, GL_DYNAMIC_DRAW);
+    MemoryTracker::trackBuffer(slot.VBO, MEMORY_GEOMETRY, chunkBytes);
+    Mesh::setupAttributes(VERTEX_FORMAT_TERRAIN);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+
+    GLState::bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    slots.push_back(slot);
+    return (int)slots.size() - 1;
+  }
+
+  // least recently used, never one the current frame draws
+  int oldest = -1;
+  for (int i = 0; i < (int)slots.size(); ++i) {
+    const Slot &slot = slots[i];
+    if (slot.used && slot.lastUsed == frame)
+      continue;
+    if (!slot.used)
+      return i;
+    if (oldest < 0 || slot.lastUsed < slots[oldest].lastUsed)
+      oldest = i;
+  }
+  if (oldest >= 0) {
+    resident.erase(slots[oldest].key);
+    slots[oldest].used = false;
+  }
+  return oldest;
+}
+
+int TerrainRenderer::uploadResults(int limit) {
+  vector<Result> ready;
+  {
+    lock_guard<mutex> lock(resultMutex);
+    int count = min(limit, (int)results.size());
+    ready.reserve(count);
+    for (int i = 0; i < count; ++i)
+      ready.push_back(move(results[i]));
+    results.erase(results.begin(), results.begin() + count);
+  }
+
+  int uploaded = 0;
+  for (Result &result : ready) {
+    pending.erase(result.key);
+    if (resident.count(result.key))
+      continue;
+
+    // every slot is in use this frame, the chunk is requested again later
+    int index = acquireSlot();
+    if (index < 0)
+      continue;
+
+    Slot &slot = slots[index];
+    glBindBuffer(GL_ARRAY_BUFFER, slot.VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, chunkBytes, result.positions.data());
+    slot.key = result.key;
+    slot.used = true;
+    slot.lastUsed = frame;
+    resident[result.key] = index;
+    uploaded++;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return uploaded;
+}
+
+void TerrainRenderer::visit(int body, int face, int level, int x, int y,
+                            int slot, const vec3 &eyeLocal,
+                            const Frustum &frustum, float pixelsPerRadian,
+                            vector<int> &out, bool &requested) {
+  float size = 2.0f / (float)(1 << level);
+  float u0 = -1.0f + x * size;
+  float v0 = -1.0f + y * size;
+  vec3 center = cubeToSphere(face, u0 + size * 0.5f, v0 + size * 0.5f);
+
+  // angular radius of the chunk around its center direction
+  float spread = 1.0f;
+  for (int corner = 0; corner < 4; ++corner) {
+    vec3 p = cubeToSphere(face, u0 + size * (corner & 1),
+                          v0 + size * (corner >> 1));
+    spread = min(spread, dot(center, p));
+  }
+  float alpha = acos(clamp(spread, -1.0f, 1.0f));
+
+  // behind the horizon seen from the eye
+  float distance = length(eyeLocal);
+  if (distance > 1.0f) {
+    float horizon = acos(1.0f / distance);
+    float angle = acos(clamp(dot(center, eyeLocal) / distance, -1.0f, 1.0f));
+    if (angle - alpha > horizon)
+      return;
+  }
+
+  // out of view: the chunk lies within a chord of its center
+  float chord = 2.0f * sin(alpha * 0.5f);
+  float eyeDistance = length(eyeLocal - center);
+  if (!FrameBuilder::sphereInFrustum(frustum.planes, center, chord,
+                                     eyeDistance, frustum.sideMargin))
+    return;
+
+  float nearest = max(eyeDistance - chord, 1e-6f);
+  float pixels = geometricError(level, resolution) / nearest * pixelsPerRadian;
+
+  if (level < maxLevel && pixels > maxPixelError) {
+    uint64_t keys[4];
+    int children[4];
+    bool ready = true;
+    for (int i = 0; i < 4; ++i) {
+      int cx = x * 2 + (i & 1), cy = y * 2 + (i >> 1);
+      keys[i] = makeKey(body, face, level + 1, cx, cy);
+      if (!touch(keys[i], children[i])) {
+        request(keys[i], face, level + 1, cx, cy);
+        requested = true;
+        ready = false;
+      }
+    }
+
+    // split only once all four can replace this chunk
+    if (ready) {
+      for (int i = 0; i < 4; ++i) {
+        visit(body, face, level + 1, x * 2 + (i & 1), y * 2 + (i >> 1),
+              children[i], eyeLocal, frustum, pixelsPerRadian, out,
+              requested);
+      }
+      return;
+    }
+  }
+
+  out.push_back(slot);
+}
+
+void TerrainRenderer::select(int body, const BodyDraw &draw, const vec3 &eye,
+                             const vec4 planes[6], float sideMargin,
+                             float pixelsPerRadian, Selection &selection,
+                             bool &requested) {
+  int roots[6];
+  bool ready = true;
+  for (int face = 0; face < 6; ++face) {
+    uint64_t key = makeKey(body, face, 0, 0, 0);
+    if (!touch(key, roots[face])) {
+      request(key, face, 0, 0, 0);
+      requested = true;
+      ready = false;
+    }
+  }
+  // the mesh stands in until the whole sphere can be drawn
+  if (!ready)
+    return;
+
+  // camera and frustum in the unit sphere's space, distances are in radii.
+  // a plane maps to object space through the transposed model matrix
+  vec3 eyeLocal = vec3(inverse(draw.model) * vec4(eye, 1.0f));
+  Frustum frustum;
+  mat4 toLocal = transpose(draw.model);
+  for (int i = 0; i < 6; ++i) {
+    vec4 plane = toLocal * planes[i];
+    frustum.planes[i] = plane * (1.0f / length(vec3(plane)));
+  }
+  frustum.sideMargin = sideMargin;
+
+  selection.active = true;
+  for (int face = 0; face < 6; ++face) {
+    visit(body, face, 0, 0, 0, roots[face], eyeLocal, frustum,
+          pixelsPerRadian, selection.slots, requested);
+  }
+}
+
+void TerrainRenderer::update(const vector<BodyDraw> &draws,
+                             const FrameInput &camera, float viewportHeight,
+                             bool complete) {
+  frame++;
+  drawnChunks = 0;
+  uploadedChunks = 0;
+  float fovY = camera.fovY;
+  float pixelsPerRadian = viewportHeight * 0.5f / tan(fovY * 0.5f);
+  vec4 planes[6];
+  FrameBuilder::frustumPlanes(camera.projection * camera.view, planes);
+  float sideMargin = sin(camera.cullMargin);
+
+  // a level per pass at most, the cap only guards against a full pool
+  for (int pass = 0; pass <= maxLevel + 1; ++pass) {
+    for (auto &entry : selections) {
+      entry.second.active = false;
+      entry.second.slots.clear();
+    }
+
+    bool requested = false;
+    for (const BodyDraw &draw : draws) {
+      if (draw.id < 0 || draw.fade > 0.0f)
+        continue;
+
+      float size = viewportHeight;
+      if (draw.depth > draw.radius) {
+        float angularRadius = asin(draw.radius / draw.depth);
+        size = tan(angularRadius) / tan(fovY * 0.5f) * viewportHeight;
+      }
+      if (size < minPixels)
+        continue;
+
+      select(draw.id, draw, camera.eye, planes, sideMargin, pixelsPerRadian,
+             selections[draw.id], requested);
+    }
+
+    // uploaded after selecting, so eviction spares this frame's chunks
+    if (!complete) {
+      uploadedChunks += uploadResults(uploadsPerFrame);
+      return;
+    }
+    if (!requested)
+      return;
+    pool.wait();
+    uploadedChunks += uploadResults(INT_MAX);
+  }
+}
+
+bool TerrainRenderer::isActive(int id) const {
+  auto it = selections.find(id);
+  return it != selections.end() && it->second.active;
+}
+
+void TerrainRenderer::render(Shader &shader, const BodyDraw &draw) {
+  auto it = selections.find(draw.id);
+  if (it == selections.end())
+    return;
+
+  shader.setMat4("model", draw.model);
+  shader.setVec3("material_Ka", draw.ka);
+  shader.setVec3("material_Kd", draw.kd);
+  shader.setVec3("material_Ks", draw.ks);
+  shader.setFloat("material_shininess", draw.shininess);
+  draw.texture->bind(0);
+  shader.setInt("texture1", 0);
+
+  for (int index : it->second.slots) {
+    GLState::bindVertexArray(slots[index].VAO);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0);
+  }
+  drawnChunks += (int)it->second.slots.size();
+}
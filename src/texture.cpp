@@ -1,20 +1,27 @@
 #include "texture.h"
+#include "gl_state.h"
+#include "memory.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
 
 using namespace std;
 
-Texture::Texture(const char *texturePath) : path(texturePath) {
+Texture::Texture(const char *texturePath)
+    : target(GL_TEXTURE_2D), path(texturePath) {
   ID = loadFromFile(texturePath);
 }
 
+Texture::Texture(unsigned int textureID, const char *texturePath,
+                 GLenum textureTarget)
+    : ID(textureID), target(textureTarget), path(texturePath) {}
+
 void Texture::bind(unsigned int unit) const {
-  glActiveTexture(GL_TEXTURE0 + unit);
-  glBindTexture(GL_TEXTURE_2D, ID);
+  GLState::activeTexture(unit);
+  GLState::bindTexture(target, ID);
 }
 
-void Texture::unbind() const { glBindTexture(GL_TEXTURE_2D, 0); }
+void Texture::unbind() const { GLState::bindTexture(target, 0); }
 
 unsigned int Texture::loadFromFile(const char *path) {
   unsigned int textureID;
@@ -31,10 +38,13 @@ unsigned int Texture::loadFromFile(const char *path) {
     else if (nrChannels == 4)
       format = GL_RGBA;
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
                  GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
+    MemoryTracker::trackTexture(
+        textureID, MEMORY_TEXTURES,
+        MemoryTracker::textureBytes(width, height, nrChannels, true));
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
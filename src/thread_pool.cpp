@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : activeTasks(0), stopping(false) {
+  if (threadCount == 0)
+    threadCount = thread::hardware_concurrency();
+  if (threadCount == 0)
+    threadCount = 1;
+
+  for (unsigned int i = 0; i < threadCount; ++i) {
+    workers.push_back(thread(&ThreadPool::workerLoop, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+future<void> ThreadPool::submit(const function<void()> &task) {
+  packaged_task<void()> packaged(task);
+  future<void> result = packaged.get_future();
+
+  {
+    lock_guard<mutex> lock(queueMutex);
+    tasks.push(move(packaged));
+  }
+  taskAvailable.notify_one();
+
+  return result;
+}
+
+void ThreadPool::wait() {
+  unique_lock<mutex> lock(queueMutex);
+  allIdle.wait(lock, [this] { return tasks.empty() && activeTasks == 0; });
+}
+
+void ThreadPool::parallelFor(int count, int minChunk,
+                             const function<void(int, int, int)> &body) {
+  if (count <= 0)
+    return;
+  int tasks = max(1, min(maxTasks(), count / max(minChunk, 1)));
+  int chunk = (count + tasks - 1) / tasks;
+
+  if (tasks == 1 || workers.size() == 1) {
+    for (int t = 0; t * chunk < count; ++t)
+      body(t, t * chunk, min(count, (t + 1) * chunk));
+    return;
+  }
+
+  // waits on its own chunks only, other work may share the pool
+  vector<future<void>> pending;
+  for (int t = 0; t * chunk < count; ++t) {
+    int begin = t * chunk;
+    int end = min(count, begin + chunk);
+    pending.push_back(
+        submit([&body, t, begin, end]() { body(t, begin, end); }));
+  }
+  for (future<void> &done : pending)
+    done.get();
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    packaged_task<void()> task;
+
+    {
+      unique_lock<mutex> lock(queueMutex);
+      taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+      if (stopping && tasks.empty())
+        return;
+
+      task = move(tasks.front());
+      tasks.pop();
+      activeTasks++;
+    }
+
+    task();
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      activeTasks--;
+      if (tasks.empty() && activeTasks == 0)
+        allIdle.notify_all();
+    }
+  }
+}
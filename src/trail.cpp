@@ -0,0 +1,168 @@
+#include "trail.h"
+#include "gl_state.h"
+#include "memory.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+TrailRenderer::TrailRenderer(int maxTrails, int samplesPerTrail,
+                             float sampleInterval)
+    : capacity(max(maxTrails, 1)), length(max(samplesPerTrail, 2)),
+      interval(sampleInterval), trailCount(0),
+      samples((size_t)capacity * length, vec3(0.0f)),
+      seeded(capacity, false), needsFullUpload(false), head(0),
+      sinceSample(0.0f) {
+  createBuffers();
+  MemoryTracker::trackCpu(this, MEMORY_CPU_SCENE,
+                          samples.size() * sizeof(vec3) + seeded.size() / 8);
+}
+
+TrailRenderer::~TrailRenderer() {
+  GLState::deleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &IBO);
+  GLState::deleteTextures(1, &colorTexture);
+  glDeleteBuffers(1, &colorBuffer);
+  MemoryTracker::releaseBuffer(VBO);
+  MemoryTracker::releaseBuffer(IBO);
+  MemoryTracker::releaseBuffer(colorBuffer);
+  MemoryTracker::releaseCpu(this);
+}
+
+void TrailRenderer::createBuffers() {
+  // line k of a trail joins its samples k and k+1 around the ring. indices
+  // are grouped per trail so drawing the first n trails is a prefix
+  vector<unsigned int> indices;
+  indices.reserve((size_t)capacity * length * 2);
+  for (int t = 0; t < capacity; ++t) {
+    for (int k = 0; k < length; ++k) {
+      indices.push_back(k * capacity + t);
+      indices.push_back(((k + 1) % length) * capacity + t);
+    }
+  }
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &IBO);
+
+  GLState::bindVertexArray(VAO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, samples.size() * sizeof(vec3), samples.data(),
+               GL_DYNAMIC_DRAW);
+  MemoryTracker::trackBuffer(VBO, MEMORY_INSTANCES,
+                             samples.size() * sizeof(vec3));
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+               indices.data(), GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(IBO, MEMORY_GEOMETRY,
+                             indices.size() * sizeof(unsigned int));
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void *)0);
+  glEnableVertexAttribArray(0);
+
+  GLState::bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // colors are looked up by trail index in the vertex shader
+  glGenBuffers(1, &colorBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, colorBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, capacity * 4, NULL, GL_STATIC_DRAW);
+  MemoryTracker::trackBuffer(colorBuffer, MEMORY_INSTANCES, capacity * 4);
+
+  glGenTextures(1, &colorTexture);
+  GLState::bindTexture(GL_TEXTURE_BUFFER, colorTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, colorBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+int TrailRenderer::addTrail(const vec3 &color) {
+  if (trailCount == capacity)
+    return -1;
+
+  unsigned char rgba[4] = {(unsigned char)(clamp(color.x, 0.0f, 1.0f) * 255.0f),
+                           (unsigned char)(clamp(color.y, 0.0f, 1.0f) * 255.0f),
+                           (unsigned char)(clamp(color.z, 0.0f, 1.0f) * 255.0f),
+                           255};
+
+  glBindBuffer(GL_TEXTURE_BUFFER, colorBuffer);
+  glBufferSubData(GL_TEXTURE_BUFFER, trailCount * 4, 4, rgba);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  seeded[trailCount] = false;
+  return trailCount++;
+}
+
+void TrailRenderer::setPosition(int trail, const vec3 &position) {
+  if (trail < 0 || trail >= trailCount)
+    return;
+
+  if (!seeded[trail]) {
+    for (int k = 0; k < length; ++k)
+      samples[(size_t)k * capacity + trail] = position;
+    seeded[trail] = true;
+    needsFullUpload = true;
+  }
+
+  samples[(size_t)head * capacity + trail] = position;
+}
+
+void TrailRenderer::update(float deltaTime) {
+  if (trailCount == 0)
+    return;
+
+  sinceSample += deltaTime;
+  if (sinceSample >= interval) {
+    // the finished head row keeps its last positions, the new head row
+    // starts as a copy of it and follows the bodies until the next sample
+    int next = (head + 1) % length;
+    copy(samples.begin() + (size_t)head * capacity,
+         samples.begin() + (size_t)head * capacity + trailCount,
+         samples.begin() + (size_t)next * capacity);
+    head = next;
+    sinceSample = min(sinceSample - interval, interval);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  if (needsFullUpload) {
+    // only when trails were added, their whole history changed
+    glBufferSubData(GL_ARRAY_BUFFER, 0, samples.size() * sizeof(vec3),
+                    samples.data());
+    needsFullUpload = false;
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, (size_t)head * capacity * sizeof(vec3),
+                    trailCount * sizeof(vec3),
+                    &samples[(size_t)head * capacity]);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TrailRenderer::render(Shader &shader) {
+  if (trailCount == 0)
+    return;
+
+  shader.use();
+  shader.setInt("trailStride", capacity);
+  shader.setInt("sampleCount", length);
+  shader.setInt("head", head);
+  shader.setInt("trailColors", 0);
+
+  GLState::activeTexture(0);
+  GLState::bindTexture(GL_TEXTURE_BUFFER, colorTexture);
+
+  // faded lines blend over the scene but must not hide what's behind them
+  GLState::setBlended(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, false);
+
+  GLState::bindVertexArray(VAO);
+  glDrawElements(GL_LINES, trailCount * length * 2, GL_UNSIGNED_INT, 0);
+}
+
+size_t TrailRenderer::getMemoryBytes() const {
+  size_t vertices = samples.size() * sizeof(vec3);
+  size_t indices = (size_t)capacity * length * 2 * sizeof(unsigned int);
+  size_t colors = (size_t)capacity * 4;
+  // the vertex data is held on both sides, the cpu copy seeds new trails
+  return vertices * 2 + indices + colors;
+}
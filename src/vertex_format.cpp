@@ -0,0 +1,132 @@
+#include "vertex_format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// cpu-side packing, linked by tools/meshgen without a gl context
+
+using namespace std;
+
+static float signOf(float value) { return value < 0.0f ? -1.0f : 1.0f; }
+
+// folds the lower hemisphere of the octahedron over the upper one, so a unit
+// vector lands in [-1, 1]^2
+static void octahedralEncode(const float *v, float *out) {
+  float sum = fabs(v[0]) + fabs(v[1]) + fabs(v[2]);
+  float x = v[0] / sum, y = v[1] / sum;
+  if (v[2] < 0.0f) {
+    float fx = (1.0f - fabs(y)) * signOf(x);
+    float fy = (1.0f - fabs(x)) * signOf(y);
+    x = fx;
+    y = fy;
+  }
+  out[0] = x;
+  out[1] = y;
+}
+
+static void octahedralDecode(const float *p, float *out) {
+  float x = p[0], y = p[1];
+  float z = 1.0f - fabs(x) - fabs(y);
+  if (z < 0.0f) {
+    float fx = (1.0f - fabs(y)) * signOf(x);
+    float fy = (1.0f - fabs(x)) * signOf(y);
+    x = fx;
+    y = fy;
+  }
+  float length = sqrt(x * x + y * y + z * z);
+  out[0] = x / length;
+  out[1] = y / length;
+  out[2] = z / length;
+}
+
+static void writeComponent(VertexComponentType type, float value,
+                           unsigned char *out) {
+  switch (type) {
+  case VERTEX_FLOAT:
+    memcpy(out, &value, sizeof(float));
+    break;
+  case VERTEX_SNORM16: {
+    int16_t packed =
+        (int16_t)lround(min(max(value, -1.0f), 1.0f) * 32767.0f);
+    memcpy(out, &packed, sizeof(packed));
+    break;
+  }
+  case VERTEX_UNORM16: {
+    uint16_t packed =
+        (uint16_t)lround(min(max(value, 0.0f), 1.0f) * 65535.0f);
+    memcpy(out, &packed, sizeof(packed));
+    break;
+  }
+  }
+}
+
+// same conversion as gl 4.2+ for normalized integers
+static float readComponent(VertexComponentType type,
+                           const unsigned char *in) {
+  switch (type) {
+  case VERTEX_FLOAT: {
+    float value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+  }
+  case VERTEX_SNORM16: {
+    int16_t packed;
+    memcpy(&packed, in, sizeof(packed));
+    return max(packed / 32767.0f, -1.0f);
+  }
+  case VERTEX_UNORM16: {
+    uint16_t packed;
+    memcpy(&packed, in, sizeof(packed));
+    return packed / 65535.0f;
+  }
+  }
+  return 0.0f;
+}
+
+static int componentBytes(VertexComponentType type) {
+  return type == VERTEX_FLOAT ? 4 : 2;
+}
+
+void packVertices(const VertexFormat &format, const float *vertices,
+                  int vertexCount, vector<unsigned char> &out) {
+  // padding stays zero
+  out.assign((size_t)vertexCount * format.stride, 0);
+
+  for (int v = 0; v < vertexCount; ++v) {
+    const float *source = vertices + (size_t)v * format.sourceFloats;
+    unsigned char *vertex = out.data() + (size_t)v * format.stride;
+
+    for (int a = 0; a < format.attributeCount; ++a) {
+      const VertexAttribute &attribute = format.attributes[a];
+      float encoded[4];
+      const float *values = source + attribute.source;
+      if (attribute.encoding == ENCODE_OCTAHEDRAL) {
+        octahedralEncode(values, encoded);
+        values = encoded;
+      }
+
+      int size = componentBytes(attribute.type);
+      for (int c = 0; c < attribute.components; ++c) {
+        writeComponent(attribute.type, values[c],
+                       vertex + attribute.offset + c * size);
+      }
+    }
+  }
+}
+
+void unpackAttribute(const VertexAttribute &attribute,
+                     const unsigned char *vertex, float *out) {
+  int size = componentBytes(attribute.type);
+  float values[4];
+  for (int c = 0; c < attribute.components; ++c)
+    values[c] = readComponent(attribute.type, vertex + attribute.offset +
+                                                  c * size);
+
+  if (attribute.encoding == ENCODE_OCTAHEDRAL) {
+    octahedralDecode(values, out);
+    return;
+  }
+  for (int c = 0; c < attribute.components; ++c)
+    out[c] = values[c];
+}
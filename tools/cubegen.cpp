@@ -0,0 +1,60 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "clock.h"
+#include "cubemap.h"
+#include "thread_pool.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// converts an equirectangular texture into a cubemap file in the format of
+// cubemap.h with its prefiltered mip chain, and reports the conversion
+// throughput and the texture memory against the equirect map. the game reads
+// these instead of converting at load time when CUBEMAP_TEXTURES is on. run by
+// make cubemaps: cubegen INPUT OUTPUT [FACE_SIZE] [THREADS]
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 5) {
+    fprintf(stderr, "Usage: %s INPUT OUTPUT [FACE_SIZE] [THREADS]\n",
+            argv[0]);
+    return 1;
+  }
+  int requestedSize = argc > 3 ? atoi(argv[3]) : 0;
+  unsigned int threads = argc > 4 ? (unsigned int)atoi(argv[4]) : 0;
+
+  double start = now();
+  int width, height, channels;
+  unsigned char *pixels = stbi_load(argv[1], &width, &height, &channels, 0);
+  if (!pixels) {
+    fprintf(stderr, "Failed to load %s\n", argv[1]);
+    return 1;
+  }
+  double decoded = now();
+
+  int faceSize = requestedSize > 0 ? requestedSize : cubemapFaceSize(width);
+  ThreadPool pool(threads);
+  CubemapImage cubemap;
+  convertEquirect(pixels, width, height, channels, faceSize, &pool, cubemap);
+  double converted = now();
+  stbi_image_free(pixels);
+
+  if (!writeCubemap(argv[2], cubemap)) {
+    fprintf(stderr, "Failed to write %s\n", argv[2]);
+    return 1;
+  }
+
+  double seconds = converted - decoded;
+  double texels = 6.0 * faceSize * faceSize;
+  size_t before = equirectBytes(width, height, channels);
+  size_t after = cubemap.getBytes();
+  printf("cubegen: %s %dx%d -> 6x%dx%d, decode %.0f ms, convert %.0f ms "
+         "(%.1f Mtexel/s on %u threads), %.1f -> %.1f MB with mips (%+.0f%%), "
+         "%.0f%% of the equator resolution at the face centres\n",
+         argv[1], width, height, faceSize, faceSize,
+         (decoded - start) * 1000.0, seconds * 1000.0,
+         texels / seconds / 1e6, pool.size(), before / 1048576.0,
+         after / 1048576.0, 100.0 * ((double)after / before - 1.0),
+         100.0 * cubemapCentreResolution(faceSize, width));
+  return 0;
+}
@@ -0,0 +1,208 @@
+#include "body.h"
+#include "ring.h"
+#include "vertex_format.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+// writes the canonical meshes as a c++ header of static arrays, so the game
+// uploads them straight from read-only data instead of building them at
+// startup. vertices are packed with their vertex format and indices are 16
+// bit; the size before and after is printed and kept in the header. run by
+// the makefile: meshgen build/generated/mesh_data.h
+
+// sphere detail levels, coarse to fine: stacks, sectors
+static const int SPHERE_LODS[][2] = {{6, 8}, {16, 16}, {30, 30}, {64, 64}};
+static const int RING_SEGMENTS = 100;
+
+static void writeBytes(FILE *out, const char *name,
+                       const vector<unsigned char> &values) {
+  fprintf(out, "static const unsigned char %s[%d] = {\n", name,
+          (int)values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    fprintf(out, "%s0x%02x,%s", i % 16 == 0 ? "    " : " ", values[i],
+            (i % 16 == 15 || i + 1 == values.size()) ? "\n" : "");
+  }
+  fprintf(out, "};\n\n");
+}
+
+static void writeIndices(FILE *out, const char *name,
+                         const unsigned int *values, int count) {
+  fprintf(out, "static const unsigned short %s[%d] = {\n", name, count);
+  for (int i = 0; i < count; ++i) {
+    fprintf(out, "%s%u,%s", i % 12 == 0 ? "    " : " ", values[i],
+            (i % 12 == 11 || i == count - 1) ? "\n" : "");
+  }
+  fprintf(out, "};\n\n");
+}
+
+// largest difference between the packed attribute and the source floats
+static float packingError(const VertexFormat &format, const float *vertices,
+                          const vector<unsigned char> &packed,
+                          int vertexCount, int attribute) {
+  const VertexAttribute &a = format.attributes[attribute];
+  int count = a.encoding == ENCODE_OCTAHEDRAL ? 3 : a.components;
+  float worst = 0.0f;
+  for (int v = 0; v < vertexCount; ++v) {
+    float values[4];
+    unpackAttribute(a, packed.data() + (size_t)v * format.stride, values);
+    const float *source = vertices + (size_t)v * format.sourceFloats + a.source;
+    for (int c = 0; c < count; ++c)
+      worst = fmax(worst, fabs(values[c] - source[c]));
+  }
+  return worst;
+}
+
+// one line of the report, printed and written into the header
+static string reportLine(const char *mesh, const VertexFormat &packed,
+                         const VertexFormat &reference, int vertexCount,
+                         int indexCount, float error, size_t &before,
+                         size_t &after) {
+  size_t oldBytes = (size_t)vertexCount * reference.stride +
+                    (size_t)indexCount * sizeof(unsigned int);
+  size_t newBytes = (size_t)vertexCount * packed.stride +
+                    (size_t)indexCount * sizeof(unsigned short);
+  before += oldBytes;
+  after += newBytes;
+
+  char line[160];
+  snprintf(line, sizeof(line),
+           "%-14s %5d vertices, %2d -> %2d bytes each, %7zu -> %7zu bytes "
+           "with indices (%.1fx), max error %.1e",
+           mesh, vertexCount, reference.stride, packed.stride, oldBytes,
+           newBytes, (double)oldBytes / newBytes, error);
+  return line;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s OUTPUT_HEADER\n", argv[0]);
+    return 1;
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if (!out) {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+
+  fprintf(out, "// generated by tools/meshgen, do not edit\n"
+               "#ifndef MESH_DATA_H\n"
+               "#define MESH_DATA_H\n\n"
+               "#include \"vertex_format.h\"\n\n"
+               "struct MeshData {\n"
+               "  const VertexFormat *format;\n"
+               "  const unsigned char *vertices;\n"
+               "  int vertexCount;\n"
+               "  const unsigned short *indices;\n"
+               "  int indexCount;\n"
+               "};\n\n");
+
+  vector<string> report;
+  size_t before = 0, after = 0;
+  vector<unsigned char> packed;
+
+  // unit spheres: position and normal, scaled per body by the model matrix
+  const int lodCount = sizeof(SPHERE_LODS) / sizeof(SPHERE_LODS[0]);
+  int vertexCounts[lodCount], indexCounts[lodCount];
+
+  for (int lod = 0; lod < lodCount; ++lod) {
+    int stacks = SPHERE_LODS[lod][0];
+    int sectors = SPHERE_LODS[lod][1];
+
+    Vertex *vertices = CelestialBody::createSphereVertices(
+        vec3(0.0f), 1.0f, stacks, sectors, vertexCounts[lod]);
+    unsigned int *indices =
+        CelestialBody::createSphereIndices(stacks, sectors, indexCounts[lod]);
+    if (vertexCounts[lod] > 65536) {
+      fprintf(stderr, "Sphere lod %d has too many vertices for 16-bit "
+                      "indices\n",
+              lod);
+      fclose(out);
+      return 1;
+    }
+
+    const float *floats = &vertices[0].x;
+    packVertices(VERTEX_FORMAT_SPHERE, floats, vertexCounts[lod], packed);
+
+    char name[64];
+    fprintf(out, "// sphere lod %d: %d stacks x %d sectors\n", lod, stacks,
+            sectors);
+    snprintf(name, sizeof(name), "SPHERE_LOD%d_VERTICES", lod);
+    writeBytes(out, name, packed);
+    snprintf(name, sizeof(name), "SPHERE_LOD%d_INDICES", lod);
+    writeIndices(out, name, indices, indexCounts[lod]);
+
+    snprintf(name, sizeof(name), "sphere lod %d", lod);
+    report.push_back(reportLine(
+        name, VERTEX_FORMAT_SPHERE, VERTEX_FORMAT_SPHERE_FLOAT,
+        vertexCounts[lod], indexCounts[lod],
+        packingError(VERTEX_FORMAT_SPHERE, floats, packed, vertexCounts[lod],
+                     0),
+        before, after));
+
+    delete[] vertices;
+    delete[] indices;
+  }
+
+  fprintf(out, "static const int SPHERE_LOD_COUNT = %d;\n", lodCount);
+  fprintf(out, "static const MeshData SPHERE_LODS[SPHERE_LOD_COUNT] = {\n");
+  for (int lod = 0; lod < lodCount; ++lod) {
+    fprintf(out,
+            "    {&VERTEX_FORMAT_SPHERE, SPHERE_LOD%d_VERTICES, %d, "
+            "SPHERE_LOD%d_INDICES, %d},\n",
+            lod, vertexCounts[lod], lod, indexCounts[lod]);
+  }
+  fprintf(out, "};\n\n");
+
+  // canonical ring: both radii 1, so every vertex is a unit direction and u
+  // tells the ring shader whether it sits on the inner or the outer edge
+  float *ringVertices;
+  unsigned int *ringIndices;
+  int ringVertexCount, ringIndexCount;
+  Ring::createRingGeometry(1.0f, 1.0f, RING_SEGMENTS, ringVertices,
+                           ringVertexCount, ringIndices, ringIndexCount);
+  packVertices(VERTEX_FORMAT_RING, ringVertices, ringVertexCount, packed);
+
+  fprintf(out, "// ring: %d segments, position, normal, texture coordinates\n",
+          RING_SEGMENTS);
+  writeBytes(out, "RING_VERTICES", packed);
+  writeIndices(out, "RING_INDICES", ringIndices, ringIndexCount);
+  fprintf(out,
+          "static const MeshData RING_MESH = {&VERTEX_FORMAT_RING, "
+          "RING_VERTICES, %d,\n                                   "
+          "RING_INDICES, %d};\n\n",
+          ringVertexCount, ringIndexCount);
+
+  float ringError = 0.0f;
+  for (int a = 0; a < VERTEX_FORMAT_RING.attributeCount; ++a) {
+    ringError = fmax(ringError, packingError(VERTEX_FORMAT_RING, ringVertices,
+                                             packed, ringVertexCount, a));
+  }
+  report.push_back(reportLine("ring", VERTEX_FORMAT_RING,
+                              VERTEX_FORMAT_RING_FLOAT, ringVertexCount,
+                              ringIndexCount, ringError, before, after));
+
+  delete[] ringVertices;
+  delete[] ringIndices;
+
+  char total[96];
+  snprintf(total, sizeof(total), "total %zu -> %zu bytes (%.1fx)", before,
+           after, (double)before / after);
+  report.push_back(total);
+
+  fprintf(out, "// packed sizes, float vertices and 32-bit indices before:\n");
+  for (const string &line : report) {
+    fprintf(out, "//   %s\n", line.c_str());
+    printf("meshgen: %s\n", line.c_str());
+  }
+  fprintf(out, "\n#endif\n");
+
+  bool ok = ferror(out) == 0;
+  fclose(out);
+  if (!ok) {
+    fprintf(stderr, "Failed to write %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include "star_catalog.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// writes a synthetic star catalog in the format of star_catalog.h. counts
+// grow with magnitude roughly like the real sky (about 5k stars brighter
+// than 6.5, 120k brighter than 9.5) and faint ones crowd towards the galactic
+// plane, which lies along y = 0 like the band of the milky way texture. run
+// by the makefile: stargen build/generated/stars.bin [count] [faintest]
+
+static const int DEFAULT_COUNT = 120000;
+static const float DEFAULT_FAINTEST = 9.5f;
+static const float BRIGHTEST = -1.5f;
+// log10 of the count brighter than m grows by this per magnitude
+static const float COUNT_SLOPE = 0.45f;
+static const unsigned int SEED = 1977;
+
+// colour of a black body, fitted to the planckian locus
+static void temperatureToColor(float kelvin, uint8_t color[3]) {
+  float t = kelvin / 100.0f;
+  float r, g, b;
+  if (t <= 66.0f) {
+    r = 255.0f;
+    g = 99.4708025861f * log(t) - 161.1195681661f;
+    b = t <= 19.0f ? 0.0f : 138.5177312231f * log(t - 10.0f) - 305.0447927307f;
+  } else {
+    r = 329.698727446f * pow(t - 60.0f, -0.1332047592f);
+    g = 288.1221695283f * pow(t - 60.0f, -0.0755148492f);
+    b = 255.0f;
+  }
+  color[0] = (uint8_t)min(max(r, 0.0f), 255.0f);
+  color[1] = (uint8_t)min(max(g, 0.0f), 255.0f);
+  color[2] = (uint8_t)min(max(b, 0.0f), 255.0f);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "Usage: %s OUTPUT [COUNT] [FAINTEST_MAGNITUDE]\n",
+            argv[0]);
+    return 1;
+  }
+  int count = argc > 2 ? atoi(argv[2]) : DEFAULT_COUNT;
+  float faintest = argc > 3 ? (float)atof(argv[3]) : DEFAULT_FAINTEST;
+  if (count <= 0 || faintest <= BRIGHTEST) {
+    fprintf(stderr, "COUNT must be positive and the faintest magnitude above "
+                    "%.1f\n",
+            BRIGHTEST);
+    return 1;
+  }
+
+  mt19937 rng(SEED);
+  uniform_real_distribution<float> unit(0.0f, 1.0f);
+  normal_distribution<float> colorIndex(0.65f, 0.35f);
+
+  // inverse of the cumulative count 10^(slope * (m - brightest))
+  float range = pow(10.0f, COUNT_SLOPE * (faintest - BRIGHTEST)) - 1.0f;
+
+  vector<StarRecord> stars(count);
+  for (StarRecord &star : stars) {
+    float magnitude =
+        BRIGHTEST + log10(1.0f + unit(rng) * range) / COUNT_SLOPE;
+
+    // the fainter the star, the likelier it belongs to the disc
+    float discShare = 0.7f * (magnitude - BRIGHTEST) / (faintest - BRIGHTEST);
+    float y;
+    if (unit(rng) < discShare) {
+      // laplace distributed latitude, about 10 degrees wide
+      float u = unit(rng) - 0.5f;
+      float latitude = -0.17f * (u < 0.0f ? -1.0f : 1.0f) *
+                       log(1.0f - 2.0f * fabs(u) + 1e-7f);
+      y = sin(max(-1.5707963f, min(1.5707963f, latitude)));
+    } else {
+      y = 2.0f * unit(rng) - 1.0f;
+    }
+    float longitude = 6.2831853f * unit(rng);
+    float ring = sqrt(max(0.0f, 1.0f - y * y));
+    float direction[3] = {ring * cos(longitude), y, ring * sin(longitude)};
+
+    for (int i = 0; i < 3; ++i)
+      star.direction[i] = (int16_t)lround(direction[i] * 32767.0f);
+    star.magnitude = (int16_t)lround(magnitude * 1000.0f);
+
+    // b - v colour index to temperature (ballesteros)
+    float bv = min(max(colorIndex(rng), -0.3f), 1.9f);
+    float kelvin =
+        4600.0f * (1.0f / (0.92f * bv + 1.7f) + 1.0f / (0.92f * bv + 0.62f));
+    temperatureToColor(kelvin, star.color);
+    star.padding = 0;
+  }
+
+  sort(stars.begin(), stars.end(),
+       [](const StarRecord &a, const StarRecord &b) {
+         return a.magnitude < b.magnitude;
+       });
+
+  FILE *out = fopen(argv[1], "wb");
+  if (!out) {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+
+  StarCatalogHeader header;
+  copy(STAR_CATALOG_MAGIC, STAR_CATALOG_MAGIC + 4, header.magic);
+  header.version = STAR_CATALOG_VERSION;
+  header.count = (uint32_t)count;
+  header.recordSize = sizeof(StarRecord);
+
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(stars.data(), sizeof(StarRecord), stars.size(), out) ==
+                stars.size();
+  ok = fclose(out) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "Failed to write %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}